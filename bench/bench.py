@@ -0,0 +1,188 @@
+"""
+Benchmark of hex2bin and mot2bin on the synthetic corpus of gen_corpus.py.
+
+Every case is converted without check value, and the dense cases with
+32-byte records are also converted with each check method (-k). For each
+run, the wall time, the throughput (input MB/s) and the peak RSS of the
+converter are reported in JSON, with the time of each phase given by the
+converter's --stats=json report (--no-stats for older converters).
+
+    python3 bench.py --bin ../src --sizes 1K,1M,16M -o results.json
+    python3 bench.py --bin ../src --baseline results.json --threshold 10
+
+With --baseline, the run fails if a case is slower than in the baseline by
+more than the threshold (in percent).
+"""
+import argparse
+import datetime
+import json
+import os
+import platform
+import subprocess
+import sys
+import tempfile
+import time
+
+import gen_corpus
+
+CHECK_METHODS = ('none', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9')
+
+
+def run_converter(tool, args, input_file, cwd):
+    """Runs a converter; returns the wall time, peak RSS (KB), exit code and stdout."""
+    with open(os.devnull, 'r') as devnull, tempfile.TemporaryFile() as stdout:
+        start = time.perf_counter()
+        proc = subprocess.Popen([tool] + args + [input_file], cwd=cwd, stdin=devnull,
+                                stdout=stdout, stderr=subprocess.DEVNULL)
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        stdout.seek(0)
+        output = stdout.read().decode(errors='replace')
+    proc.returncode = os.waitstatus_to_exitcode(status)
+
+    # ru_maxrss is in KB on Linux, in bytes on macOS. The child inherits the
+    # high-water mark of this script before exec(), so small cases all show
+    # the RSS of the Python interpreter.
+    rss = rusage.ru_maxrss // 1024 if sys.platform == 'darwin' else rusage.ru_maxrss
+    return wall, rss, proc.returncode, output
+
+
+def parse_stats(output):
+    """Returns the phase times (ms) of a --stats=json report, None if there is none."""
+    for line in reversed(output.splitlines()):
+        if line.startswith('{'):
+            try:
+                report = json.loads(line)
+            except ValueError:
+                return None
+            phases = {name: phase['time_ms'] for name, phase in report['phases'].items()}
+            phases['peak_rss_kb'] = report['peak_rss_kb']
+            return phases
+    return None
+
+
+def bench_case(bin_dir, corpus, fmt, size, reclen, layout, method, repeat, stats):
+    tool_name, _, base, _ = gen_corpus.FORMATS[fmt]
+    path = gen_corpus.generate(corpus, fmt, size, reclen, layout)
+    name = gen_corpus.case_name(fmt, size, reclen, layout)
+    output = os.path.splitext(path)[0] + '.bin'
+
+    args = ['--stats=json'] if stats else []
+    if method != 'none':
+        args += ['-k', method, '-f', '%X' % base]
+
+    best = None
+    for _ in range(repeat):
+        wall, rss, code, report = run_converter(os.path.abspath(os.path.join(bin_dir, tool_name)), args,
+                                                os.path.basename(path), corpus)
+        if best is None or wall < best[0]:
+            best = (wall, rss, code, report)
+
+    wall, rss, code, report = best
+    input_bytes = os.path.getsize(path)
+    result = {
+        'case': name,
+        'tool': tool_name,
+        'format': fmt,
+        'size': size,
+        'record_length': reclen,
+        'layout': layout,
+        'method': method,
+        'input_bytes': input_bytes,
+        'output_bytes': os.path.getsize(output) if os.path.exists(output) else 0,
+        'wall_s': round(wall, 6),
+        'throughput_mb_s': round(input_bytes / wall / 1e6, 3) if wall > 0 else None,
+        'peak_rss_kb': rss,
+        'exit_code': code,
+        'phases_ms': parse_stats(report) if stats else None,
+    }
+
+    if os.path.exists(output):
+        os.remove(output)
+
+    return result
+
+
+def compare(results, baseline_file, threshold):
+    """Returns the list of the cases slower than the baseline."""
+    with open(baseline_file) as f:
+        baseline = {(r['case'], r['method']): r for r in json.load(f)['results']}
+
+    regressions = []
+    for r in results:
+        old = baseline.get((r['case'], r['method']))
+        if old is None or not old['wall_s'] or not r['wall_s']:
+            continue
+        change = (r['wall_s'] - old['wall_s']) / old['wall_s'] * 100
+        if change > threshold:
+            regressions.append({'case': r['case'], 'method': r['method'], 'baseline_s': old['wall_s'],
+                                'wall_s': r['wall_s'], 'change_pct': round(change, 1)})
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark hex2bin and mot2bin')
+    parser.add_argument('--bin', default='.', help='directory of hex2bin and mot2bin')
+    parser.add_argument('--corpus', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), 'corpus'),
+                        help='corpus directory (generated files are kept there)')
+    parser.add_argument('--sizes', default='1K,64K,1M,16M', help='data sizes, e.g. 1K,1M,1G')
+    parser.add_argument('--reclens', default='16,32,255', help='data bytes per record')
+    parser.add_argument('--layouts', default=','.join(gen_corpus.LAYOUTS))
+    parser.add_argument('--formats', default=','.join(gen_corpus.FORMATS))
+    parser.add_argument('--methods', default=','.join(CHECK_METHODS), help='check methods for the dense cases')
+    parser.add_argument('--no-stats', action='store_true', help="don't pass --stats=json (older converters)")
+    parser.add_argument('--repeat', type=int, default=3, help='runs per case, the fastest is kept')
+    parser.add_argument('-o', '--output', help='JSON result file (default: stdout)')
+    parser.add_argument('--baseline', help='JSON result file to compare with')
+    parser.add_argument('--threshold', type=float, default=10.0, help='allowed slowdown in percent')
+    args = parser.parse_args()
+
+    sizes = [gen_corpus.parse_size(s) for s in args.sizes.split(',')]
+    methods = args.methods.split(',')
+    results = []
+
+    for fmt, size, reclen, layout in gen_corpus.cases(args.formats.split(','), sizes,
+                                                      [int(r) for r in args.reclens.split(',')],
+                                                      args.layouts.split(',')):
+        case_methods = ['none']
+        if layout == 'dense' and reclen == 32:
+            case_methods = methods
+        for method in case_methods:
+            result = bench_case(args.bin, args.corpus, fmt, size, reclen, layout, method, args.repeat,
+                                not args.no_stats)
+            print('%-32s k=%-4s %10.3f MB/s %8d KB' % (result['case'], method, result['throughput_mb_s'] or 0,
+                                                       result['peak_rss_kb']), file=sys.stderr)
+            results.append(result)
+
+    report = {
+        'date': datetime.datetime.now().isoformat(timespec='seconds'),
+        'host': platform.node(),
+        'machine': platform.machine(),
+        'results': results,
+    }
+
+    regressions = []
+    if args.baseline:
+        regressions = compare(results, args.baseline, args.threshold)
+        report['regressions'] = regressions
+
+    text = json.dumps(report, indent=1)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+
+    for r in regressions:
+        print('REGRESSION %s k=%s: %.6f s -> %.6f s (+%.1f%%)' % (r['case'], r['method'], r['baseline_s'], r['wall_s'],
+                                                                  r['change_pct']), file=sys.stderr)
+
+    failed = [r for r in results if r['exit_code'] != 0]
+    for r in failed:
+        print('FAILED %s k=%s: exit code %d' % (r['case'], r['method'], r['exit_code']), file=sys.stderr)
+
+    return 1 if regressions or failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
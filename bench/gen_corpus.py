@@ -0,0 +1,184 @@
+"""
+Deterministic synthetic corpus generator for hex2bin and mot2bin.
+
+Each case is defined by a format, a data size, a record length and a
+layout. The same case always produces the same file (the random generator
+is seeded with the case name), so results from different runs and
+different machines can be compared.
+
+    python3 gen_corpus.py --out corpus --sizes 1K,1M --formats ihex-linear,s3
+"""
+import argparse
+import os
+import random
+import sys
+
+# format: (tool, extension, base address, highest address + 1)
+FORMATS = {
+    'ihex-linear': ('hex2bin', 'hex', 0x08000000, 1 << 32),
+    'ihex-seg':    ('hex2bin', 'hex', 0x00000000, 1 << 20),
+    's1':          ('mot2bin', 's19', 0x00000000, 1 << 16),
+    's2':          ('mot2bin', 's28', 0x00000000, 1 << 24),
+    's3':          ('mot2bin', 's37', 0x08000000, 1 << 32),
+}
+
+LAYOUTS = ('dense', 'sparse')
+RECORD_LENGTHS = (16, 32, 255)
+
+# sparse layout: blocks of data, followed by a gap of 1 to 5 times their size
+SPARSE_BLOCK = 4096
+
+SUFFIXES = {'K': 1 << 10, 'M': 1 << 20, 'G': 1 << 30}
+
+
+def parse_size(text):
+    text = text.strip().upper()
+    if text[-1] in SUFFIXES:
+        return int(text[:-1]) * SUFFIXES[text[-1]]
+    return int(text, 0)
+
+
+def size_name(size):
+    for suffix in ('G', 'M', 'K'):
+        if size % SUFFIXES[suffix] == 0:
+            return '%d%s' % (size // SUFFIXES[suffix], suffix)
+    return str(size)
+
+
+def case_name(fmt, size, reclen, layout):
+    return '%s-%s-%d-%s' % (fmt, size_name(size), reclen, layout)
+
+
+def blocks(size, layout, base, rng):
+    """Yields (address, length) of the data blocks of the image."""
+    if layout == 'dense':
+        yield base, size
+        return
+
+    address = base
+    while size > 0:
+        length = min(SPARSE_BLOCK, size)
+        yield address, length
+        size -= length
+        address += length + SPARSE_BLOCK * rng.randint(1, 5)
+
+
+def span(size, layout):
+    """Upper bound of the address span of a case."""
+    if layout == 'dense':
+        return size
+    return size + (size // SPARSE_BLOCK + 1) * SPARSE_BLOCK * 5
+
+
+def ihex_record(rtype, offset, data):
+    body = bytes((len(data), offset >> 8, offset & 0xFF, rtype)) + data
+    return ':%s%02X\n' % (body.hex().upper(), -sum(body) & 0xFF)
+
+
+def srec_record(stype, address, addr_len, data):
+    body = bytes((addr_len + len(data) + 1,)) + address.to_bytes(addr_len, 'big') + data
+    return 'S%d%s%02X\n' % (stype, body.hex().upper(), ~sum(body) & 0xFF)
+
+
+def write_ihex(out, fmt, size, reclen, layout, rng):
+    base = FORMATS[fmt][2]
+    upper = None
+
+    for address, length in blocks(size, layout, base, rng):
+        data = rng.randbytes(length)
+        pos = 0
+        while pos < length:
+            # A record doesn't cross a 64K boundary
+            n = min(reclen, length - pos, 0x10000 - (address & 0xFFFF))
+            if (address >> 16) != upper:
+                upper = address >> 16
+                if fmt == 'ihex-linear':
+                    out.write(ihex_record(4, 0, upper.to_bytes(2, 'big')))
+                else:
+                    out.write(ihex_record(2, 0, (upper << 12).to_bytes(2, 'big')))
+            out.write(ihex_record(0, address & 0xFFFF, data[pos:pos + n]))
+            address += n
+            pos += n
+
+    out.write(':00000001FF\n')
+
+
+def write_srec(out, fmt, size, reclen, layout, rng):
+    stype = int(fmt[1])
+    addr_len = stype + 1
+    base = FORMATS[fmt][2]
+    count = 0
+
+    # The S-record count byte limits the data to 255 - address - checksum
+    reclen = min(reclen, 255 - addr_len - 1)
+
+    out.write(srec_record(0, 0, 2, b'HDR'))
+    for address, length in blocks(size, layout, base, rng):
+        data = rng.randbytes(length)
+        for pos in range(0, length, reclen):
+            chunk = data[pos:pos + reclen]
+            out.write(srec_record(stype, address + pos, addr_len, chunk))
+            count += 1
+
+    if count <= 0xFFFF:
+        out.write(srec_record(5, count, 2, b''))
+    else:
+        out.write(srec_record(6, count, 3, b''))
+    out.write(srec_record(10 - stype, base, addr_len, b''))
+
+
+def supported(fmt, size, layout):
+    _, _, base, limit = FORMATS[fmt]
+    return base + span(size, layout) <= limit
+
+
+def generate(directory, fmt, size, reclen, layout, force=False):
+    """Generates a case if needed and returns its file name."""
+    _, ext, _, _ = FORMATS[fmt]
+    name = case_name(fmt, size, reclen, layout)
+    path = os.path.join(directory, '%s.%s' % (name, ext))
+
+    if os.path.exists(path) and not force:
+        return path
+
+    os.makedirs(directory, exist_ok=True)
+    rng = random.Random(name)
+    tmp = path + '.tmp'
+    with open(tmp, 'w', newline='\n', buffering=1 << 20) as out:
+        if fmt.startswith('ihex'):
+            write_ihex(out, fmt, size, reclen, layout, rng)
+        else:
+            write_srec(out, fmt, size, reclen, layout, rng)
+    os.replace(tmp, path)
+
+    return path
+
+
+def cases(formats, sizes, reclens, layouts):
+    for fmt in formats:
+        for size in sizes:
+            for reclen in reclens:
+                for layout in layouts:
+                    if supported(fmt, size, layout):
+                        yield fmt, size, reclen, layout
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate the benchmark corpus')
+    parser.add_argument('--out', default='corpus', help='output directory')
+    parser.add_argument('--sizes', default='1K,64K,1M,16M', help='data sizes, e.g. 1K,1M,1G')
+    parser.add_argument('--reclens', default='16,32,255', help='data bytes per record')
+    parser.add_argument('--layouts', default=','.join(LAYOUTS))
+    parser.add_argument('--formats', default=','.join(FORMATS))
+    parser.add_argument('--force', action='store_true', help='regenerate existing files')
+    args = parser.parse_args()
+
+    for fmt, size, reclen, layout in cases(args.formats.split(','), [parse_size(s) for s in args.sizes.split(',')],
+                                           [int(r) for r in args.reclens.split(',')], args.layouts.split(',')):
+        print(generate(args.out, fmt, size, reclen, layout, args.force))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
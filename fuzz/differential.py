@@ -0,0 +1,320 @@
+"""
+Differential test of hex2bin and mot2bin against the legacy converters.
+
+The legacy converters are built from the frozen copy of their sources in
+LEGACY_DIR, the last revision with the fgets/sscanf decoders and the
+two-pass mot2bin, or taken from --legacy. Both are run with a set of options on the corpus of
+bench/gen_corpus.py and on mutated copies of it, and must give:
+
+  - the same output files (image, padding and check value),
+  - the same exit code,
+  - the same number of checksum errors in log.txt,
+  - overlap and syntax error diagnostics in the same cases.
+
+The converters alone check a round trip on the corpus: the binary file
+written with a CRC-32 after its range must pass --verify, and a value
+inside its range must be refused rather than reported as wrong.
+
+Well-formed mutations keep every record made of hex digits with a length
+that matches its data: addresses, data, types, checksums and the order of
+the records change. Malformed mutations (cut records, other characters)
+are decoded differently on purpose, the legacy sscanf() reads past the
+end of the line: for those only the new converters are run, and they must
+exit with 0 or 1 without crashing or hanging.
+
+    python3 differential.py --bin ../src --iterations 300
+    python3 differential.py --bin ../src --legacy /tmp/legacy --seed 3
+
+The inputs that differ are kept in --failures, with their options.
+"""
+import argparse
+import glob
+import hashlib
+import os
+import random
+import re
+import resource
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'bench'))
+import gen_corpus  # noqa: E402
+
+LEGACY_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'legacy')
+TIMEOUT = 20
+# Mutated addresses can spread the records over 4 GB: the converters are
+# limited, and the inputs whose image doesn't fit aren't compared
+MEMORY_LIMIT = 1 << 30
+FILE_LIMIT = 256 << 20
+# Shortest length of each S-record type: address and checksum. Not S6: its
+# 24-bit record count is read since the single-pass mot2bin
+SREC_MIN_LENGTH = {'0': 3, '1': 3, '2': 4, '3': 5, '5': 3, '7': 5, '8': 4, '9': 3}
+
+
+def build_legacy(directory):
+    """Builds hex2bin and mot2bin of LEGACY_DIR in directory; returns their directory."""
+    src = os.path.join(directory, 'legacy')
+    shutil.copytree(LEGACY_DIR, src)
+    subprocess.run(['make', '-C', src, 'hex2bin', 'mot2bin'], check=True, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL)
+    return src
+
+
+def options(fmt):
+    """Options of each run; the addresses depend on the format."""
+    base = gen_corpus.FORMATS[fmt][2]
+    result = [[], ['-c'], ['-w'], ['-p', '00'], ['-l', '200'], ['-m', '1000'],
+              ['-s', '%X' % max(base - 0x100, 0)], ['-k', '4', '-f', '%X' % (base + 0x10)],
+              ['-c', '-k', '1', '-f', '%X' % (base + 0x20), '-w'],
+              ['-R', 'a', '%X' % base, '%X' % (base + 0x17F), 'FF', '0', '-R', 'b', '%X' % (base + 0x180),
+               'FFFFFFFF', '00', '0']]
+    if gen_corpus.FORMATS[fmt][0] == 'hex2bin':
+        result += [['-t', '%X' % (base + 0x40), '-T', '%X' % (base + 0x300)], ['-a']]
+    return result
+
+
+def checksum_ihex(body):
+    return '%02X' % (-sum(bytes.fromhex(body)) & 0xFF)
+
+
+def checksum_srec(body):
+    return '%02X' % (~sum(bytes.fromhex(body)) & 0xFF)
+
+
+def fix_checksum(line):
+    """Recomputes the checksum of a well-formed record."""
+    if line.startswith(':'):
+        return line[:-2] + checksum_ihex(line[1:-2])
+    return line[:-2] + checksum_srec(line[2:-2])
+
+
+def hex_positions(line):
+    """Positions of the hex digits of a record (after the start and S-record type)."""
+    return range(2 if line.startswith('S') else 1, len(line))
+
+
+def mutate_well_formed(lines, rng):
+    kind = rng.choice(['digit', 'digit-fixed', 'checksum', 'duplicate', 'delete', 'swap', 'type', 'address'])
+    k = rng.randrange(len(lines))
+    line = lines[k]
+    if kind in ('digit', 'digit-fixed', 'address') and len(line) > 4:
+        if kind == 'address':
+            j = rng.randrange(3, 7) if line.startswith(':') else rng.randrange(4, min(len(line) - 2, 12))
+        else:
+            j = rng.choice(hex_positions(line)[2:])
+        line = line[:j] + rng.choice('0123456789ABCDEF') + line[j + 1:]
+        lines[k] = fix_checksum(line) if kind != 'digit' else line
+    elif kind == 'checksum' and len(line) > 4:
+        lines[k] = line[:-2] + '%02X' % rng.randrange(256)
+    elif kind == 'duplicate':
+        lines.insert(rng.randrange(len(lines) + 1), line)
+    elif kind == 'delete' and len(lines) > 1:
+        del lines[k]
+    elif kind == 'swap':
+        j = rng.randrange(len(lines))
+        lines[k], lines[j] = lines[j], lines[k]
+    elif kind == 'type' and len(line) > 4:
+        if line.startswith(':'):
+            line = line[:7] + '%02X' % rng.choice([0, 1, 2, 3, 4, 5]) + line[9:]
+        else:
+            # A type whose address and checksum fit in the length of the record
+            types = [t for t in SREC_MIN_LENGTH if SREC_MIN_LENGTH[t] <= int(line[2:4], 16)]
+            line = 'S' + rng.choice(types) + line[2:]
+        lines[k] = fix_checksum(line)
+    return kind
+
+
+def mutate_malformed(lines, rng):
+    kind = rng.choice(['cut', 'character', 'length', 'empty', 'long'])
+    k = rng.randrange(len(lines))
+    line = lines[k]
+    if kind == 'cut':
+        lines[k] = line[:rng.randrange(len(line) + 1)]
+    elif kind == 'character' and len(line) > 2:
+        j = rng.randrange(1, len(line))
+        lines[k] = line[:j] + rng.choice('G \t.z\x00\r:S') + line[j + 1:]
+    elif kind == 'length' and len(line) > 4:
+        j = 1 if line.startswith(':') else 2
+        lines[k] = line[:j] + '%02X' % rng.randrange(256) + line[j + 2:]
+    elif kind == 'empty':
+        lines.insert(k, '')
+    elif kind == 'long':
+        lines[k] = line + '0' * rng.randrange(1, 2000)
+    return kind
+
+
+def limit_resources():
+    resource.setrlimit(resource.RLIMIT_AS, (MEMORY_LIMIT, MEMORY_LIMIT))
+    resource.setrlimit(resource.RLIMIT_FSIZE, (FILE_LIMIT, FILE_LIMIT))
+
+
+def digest(name):
+    """Size and SHA-256 of a file, read by blocks."""
+    sha = hashlib.sha256()
+    with open(name, 'rb') as f:
+        for block in iter(lambda: f.read(1 << 20), b''):
+            sha.update(block)
+    return os.path.getsize(name), sha.hexdigest()
+
+
+def run(tool, args, input_name, cwd):
+    """Runs a converter in cwd; returns its exit code, output files (size and
+    digest), diagnostics and whether it ran out of memory or file size."""
+    for name in glob.glob(os.path.join(cwd, '*.bin')) + [os.path.join(cwd, 'log.txt')]:
+        if os.path.exists(name):
+            os.remove(name)
+    try:
+        code = subprocess.run([tool, '-b'] + args + [input_name], cwd=cwd, stdin=subprocess.DEVNULL,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=TIMEOUT,
+                              preexec_fn=limit_resources).returncode
+    except subprocess.TimeoutExpired:
+        code = 'timeout'
+    outputs = {}
+    for name in sorted(glob.glob(os.path.join(cwd, '*.bin'))):
+        outputs[os.path.basename(name)] = digest(name)
+    log = ''
+    if os.path.exists(os.path.join(cwd, 'log.txt')):
+        with open(os.path.join(cwd, 'log.txt'), errors='replace') as f:
+            log = f.read()
+    diagnostics = {
+        'checksum errors': log.count('checksum error in record'),
+        'overlap': 'Overlapped record detected' in log,
+        'syntax error': re.search(r'error in line', log, re.IGNORECASE) is not None,
+    }
+    limited = "Can't allocate memory" in log or code == -signal.SIGXFSZ
+    return code, outputs, diagnostics, limited
+
+
+def verify_round_trip(tool, fmt, input_name, cwd):
+    """Converts with a CRC-32 at base + 0x10 and verifies the binary file;
+    returns the differences."""
+    base = gen_corpus.FORMATS[fmt][2]
+    binary = os.path.splitext(input_name)[0] + '.bin'
+    outside = ['-k', '6', '-r', '%X' % base, '%X' % (base + 0xF), '-f', '%X' % (base + 0x10)]
+    inside = ['-k', '6', '-f', '%X' % (base + 0x10)]
+    differences = []
+    for opts, verify_code in ((outside, 0), (inside, 1)):
+        code = subprocess.run([tool, '-b'] + opts + [input_name], cwd=cwd, stdin=subprocess.DEVNULL,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=TIMEOUT).returncode
+        if code != 0:
+            differences.append('%s: exit code %d' % (' '.join(opts), code))
+            continue
+        code = subprocess.run([tool, '--verify', '-s', '%X' % base] + opts + [binary], cwd=cwd,
+                              stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                              timeout=TIMEOUT).returncode
+        with open(os.path.join(cwd, 'log.txt'), errors='replace') as f:
+            refused = 'inside its range' in f.read()
+        if (code != verify_code) or (refused != (verify_code == 1)):
+            differences.append('--verify %s: exit code %d' % (' '.join(opts), code))
+    return differences
+
+
+def compare(old, new):
+    """Returns the differences between two results."""
+    differences = []
+    if old[0] != new[0]:
+        differences.append('exit code %s -> %s' % (old[0], new[0]))
+    if old[1].keys() != new[1].keys():
+        differences.append('files %s -> %s' % (sorted(old[1]), sorted(new[1])))
+    for name in sorted(old[1].keys() & new[1].keys()):
+        if old[1][name] != new[1][name]:
+            differences.append('%s differs (%d -> %d bytes)' % (name, old[1][name][0], new[1][name][0]))
+    for key in old[2]:
+        if old[2][key] != new[2][key]:
+            differences.append('%s %s -> %s' % (key, old[2][key], new[2][key]))
+    return differences
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Differential test of hex2bin and mot2bin')
+    parser.add_argument('--bin', default='../src', help='directory of the converters to test')
+    parser.add_argument('--legacy', help='directory of the legacy converters (default: built from legacy/)')
+    parser.add_argument('--formats', default=','.join(gen_corpus.FORMATS))
+    parser.add_argument('--sizes', default='1K,16K', help='data sizes of the corpus')
+    parser.add_argument('--iterations', type=int, default=200, help='mutated inputs of each kind')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--failures', default='failures', help='directory of the inputs that differ')
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    work = tempfile.mkdtemp(prefix='differential-')
+    try:
+        legacy = args.legacy or build_legacy(work)
+        corpus = os.path.join(work, 'corpus')
+        os.makedirs(corpus)
+        seeds = [gen_corpus.generate(corpus, fmt, size, reclen, layout)
+                 for fmt, size, reclen, layout in gen_corpus.cases(args.formats.split(','),
+                                                                   [gen_corpus.parse_size(s)
+                                                                    for s in args.sizes.split(',')],
+                                                                   [16, 255], list(gen_corpus.LAYOUTS))]
+        run_dir = os.path.join(work, 'run')
+        os.makedirs(run_dir)
+
+        cases = [(path, None, None) for path in seeds]
+        for i in range(args.iterations):
+            cases.append((rng.choice(seeds), 'well-formed', rng.randrange(1 << 30)))
+            cases.append((rng.choice(seeds), 'malformed', rng.randrange(1 << 30)))
+
+        runs = failures = skipped = 0
+        for path, category, case_seed in cases:
+            fmt = next(f for f in gen_corpus.FORMATS if os.path.basename(path).startswith(f + '-'))
+            tool = gen_corpus.FORMATS[fmt][0]
+            with open(path) as f:
+                lines = f.read().splitlines()
+            kinds = []
+            if category is not None:
+                case_rng = random.Random(case_seed)
+                mutate = mutate_well_formed if category == 'well-formed' else mutate_malformed
+                kinds = [mutate(lines, case_rng) for _ in range(case_rng.randint(1, 8))]
+            input_name = 'input.' + gen_corpus.FORMATS[fmt][1]
+            # Without a line end after the last record: the legacy loop
+            # (fgets() until feof()) would read it twice
+            with open(os.path.join(run_dir, input_name), 'w', newline='') as f:
+                f.write('\n'.join(lines))
+
+            if category is None:
+                runs += 1
+                differences = verify_round_trip(os.path.abspath(os.path.join(args.bin, tool)), fmt, input_name,
+                                                run_dir)
+                if differences:
+                    failures += 1
+                    print('DIFF %s round trip: %s' % (os.path.basename(path), '; '.join(differences)),
+                          file=sys.stderr)
+
+            for opts in options(fmt):
+                runs += 1
+                new = run(os.path.abspath(os.path.join(args.bin, tool)), opts, input_name, run_dir)
+                if new[3]:
+                    skipped += 1
+                    continue
+                if category == 'malformed':
+                    differences = [] if new[0] in (0, 1) else ['exit code %s' % new[0]]
+                else:
+                    old = run(os.path.abspath(os.path.join(legacy, tool)), opts, input_name, run_dir)
+                    # With -w and an odd length, the legacy converters swap the last
+                    # byte after the end of their buffer: the result is undefined
+                    if old[3] or ('-w' in opts and any(size % 2 for size, _ in old[1].values())):
+                        skipped += 1
+                        continue
+                    differences = compare(old, new)
+                if differences:
+                    failures += 1
+                    os.makedirs(args.failures, exist_ok=True)
+                    name = os.path.join(args.failures, '%04d-%s' % (failures, input_name))
+                    shutil.copy(os.path.join(run_dir, input_name), name)
+                    with open(name + '.txt', 'w') as f:
+                        f.write('%s %s\n%s\n%s\n' % (tool, ' '.join(opts), ', '.join(kinds), '\n'.join(differences)))
+                    print('DIFF %s %s %s [%s]: %s' % (os.path.basename(path), category or 'corpus', ' '.join(opts),
+                                                      ', '.join(kinds), '; '.join(differences)), file=sys.stderr)
+    finally:
+        shutil.rmtree(work)
+
+    print('%d runs, %d differences, %d skipped (image too large or undefined)' % (runs, failures, skipped))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
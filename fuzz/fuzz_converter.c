@@ -0,0 +1,129 @@
+/*
+  Fuzz target for hex2bin and mot2bin.
+
+  The converter is compiled with its main() renamed converter_main() and
+  exit() replaced by fuzz_exit(), which jumps back here: each input is
+  converted in the same process, as libFuzzer needs. Built with
+  -DFUZZ_STANDALONE, main() converts the files given on the command line,
+  for AFL (afl-fuzz ... -- ./fuzz_hex2bin @@) or to replay a crash.
+
+  The options of the conversion are read once from FUZZ_OPTIONS, e.g.
+  FUZZ_OPTIONS="-w -k 4 -f 10". See fuzz/Makefile.
+*/
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "scanner.h"
+
+/* Compiled with the converter: main and exit are its own here */
+#undef main
+#undef exit
+
+#if defined(FUZZ_HEX2BIN)
+#define FUZZ_INPUT "fuzz-input.hex"
+#else
+#define FUZZ_INPUT "fuzz-input.s19"
+#endif
+
+#define MAX_FUZZ_ARGS 32
+
+extern int converter_main(int argc, char *argv[]);
+#if defined(FUZZ_HEX2BIN)
+extern uint32_t segment_line_select;
+#endif
+
+static jmp_buf fuzz_jump;
+static char *fuzz_argv[MAX_FUZZ_ARGS + 4];
+static int fuzz_argc;
+static char fuzz_input[] = FUZZ_INPUT;
+
+/* exit() of the converter */
+void fuzz_exit(int status)
+{
+    longjmp(fuzz_jump, (status == 0) ? -1 : status);
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    static char options[1024];
+    const char *env = getenv("FUZZ_OPTIONS");
+    char *option;
+
+    (void)argc;
+    (void)argv;
+
+    fuzz_argv[fuzz_argc++] = (char *)"converter";
+    fuzz_argv[fuzz_argc++] = (char *)"-b";
+    if (env != NULL) {
+        strncpy(options, env, sizeof(options) - 1);
+        for (option = strtok(options, " "); (option != NULL) && (fuzz_argc < MAX_FUZZ_ARGS);
+             option = strtok(NULL, " ")) {
+            fuzz_argv[fuzz_argc++] = option;
+        }
+    }
+    fuzz_argv[fuzz_argc++] = fuzz_input;
+    fuzz_argv[fuzz_argc] = NULL;
+
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    FILE *input = fopen(fuzz_input, "wb");
+
+    if (input == NULL) {
+        return 0;
+    }
+    fwrite(data, 1, size, input);
+    fclose(input);
+
+    /* State that main() doesn't set again */
+#if defined(FUZZ_HEX2BIN)
+    segment_line_select = 0;
+#endif
+    SetStatusChecksumError(false);
+
+    if (setjmp(fuzz_jump) == 0) {
+        converter_main(fuzz_argc, fuzz_argv);
+    } else {
+        /* The converter exited before closing its files */
+        ScannerEnd();
+        ImageAbort();
+        NoFailCloseInputFile(NULL);
+        NoFailCloseOutputFile(NULL);
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    }
+    fp = NULL;
+
+    return 0;
+}
+
+#if defined(FUZZ_STANDALONE)
+int main(int argc, char *argv[])
+{
+    static uint8_t data[1 << 20];
+    FILE *file;
+    size_t size;
+    int i;
+
+    LLVMFuzzerInitialize(&argc, &argv);
+    for (i = 1; i < argc; i++) {
+        file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "%s cannot be opened\n", argv[i]);
+            return 1;
+        }
+        size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+        LLVMFuzzerTestOneInput(data, size);
+    }
+
+    return 0;
+}
+#endif
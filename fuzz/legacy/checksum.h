@@ -0,0 +1,24 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+//extern uint8_t *memory_block;
+
+extern void *NoFailMalloc(size_t size);
+extern void *NoFailRealloc(void *ptr, size_t size);
+extern int GetHex(const char *str);
+extern uint64_t GetHex64(const char *str);
+
+extern void ChecksumLoop(uint8_t type);
+extern void CrcParamsCheck(void);
+extern void WriteMemory(uint8_t *memory_block);
+
+extern void Para_E(const char *str);
+extern void Para_f(const char *str);
+extern void Para_F(const char *str1, const char *str2);
+extern void Para_k(const char *str);
+extern void Para_r(const char *str1, const char *str2);
+extern void Para_C(const char *str1, const char *str2, const char *str3, const char *str4, const char *str5);
+
+#endif
@@ -0,0 +1,934 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  20151124 Donna Whisnant: Bug fix for range checking of WriteMemory()
+           and Allocate_Memory_And_Rewind() report of addresses in hexadecimal
+  20160930 JP: corrected the wrong error report "Force/Check"
+  20170304 JP: added the 16-bit checksum 8-bit wide
+*/
+
+#include "common.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "binary.h"
+#include "libcrc.h"
+#include "checksum.h"
+#include "stats.h"
+
+/* We use buffer to speed disk access. */
+#ifdef USE_FILE_BUFFERS
+#define BUFFSZ 4096
+#endif
+
+/* option character */
+#if defined(MSDOS) || defined(__DOS__) || defined(__MSDOS__) || defined(_MSDOS)
+#define _IS_OPTION_(x) (((x) == '-') || ((x) == '/'))
+#else
+/* Assume unix and similar */
+/* We don't accept an option beginning with a '/' because it could be a file name. */
+#define _IS_OPTION_(x) ((x) == '-')
+#endif
+
+// static char extension[MAX_EXTENSION_SIZE]; /* filename extension for output files */
+
+static FILE *file_in;  /* input files */
+static FILE *file_out; /* output files */
+
+#ifdef USE_FILE_BUFFERS
+char *FilinBuf;  /* text buffer for file input */
+char *FiloutBuf; /* text buffer for file output */
+#endif
+
+static int pad_byte = 0xFF;
+
+static uint64_t starting_address;
+static uint64_t max_length = 0;
+static uint64_t minimum_block_size = 0x1000; // 4096 byte
+static uint64_t floor_address = 0x00;
+static uint64_t ceiling_address = 0xFFFFFFFF;
+static bool minimum_block_size_setted = false;
+static bool starting_address_setted = false;
+static bool floor_address_setted = false;
+static bool ceiling_address_setted = false;
+static bool max_length_setted = false;
+static bool swap_wordwise = false;
+static bool address_alignment_word = false;
+static bool batch_mode = false;
+
+/* Memory regions, each one written to its own output file (-R option) */
+#define MAX_REGIONS 16
+#define MAX_REGION_NAME_SIZE 32
+
+struct Region {
+    char name[MAX_REGION_NAME_SIZE];
+    uint64_t floor;
+    uint64_t ceiling;
+    int pad_byte;
+    uint64_t minimum_block_size;
+    uint8_t *memory_block; /* grows with the records falling in the region */
+    uint64_t allocated;
+    uint64_t length;       /* highest offset written + 1 */
+};
+
+static struct Region regions[MAX_REGIONS];
+static uint32_t region_count = 0;
+static struct Region *current_region = NULL;
+
+static bool enable_checksum_error = false;
+static bool status_checksum_error = false;
+
+bool verbose_flag = false;
+
+/* This will hold binary codes translated from hex file. */
+uint64_t g_lowest_address;
+uint64_t g_highest_address;
+uint64_t g_phys_addr;
+FILE *fp = NULL;
+
+/* procedure USAGE */
+void usage(const char *func, uint32_t line)
+{
+    fprintf(fp,
+        "\n"
+        "usage: %s [OPTIONS] filename\n"
+        "func: %s\n"
+        "line: %d\n"
+        "Options:\n"
+        "  -a            address Alignment Word (hex2bin only)\n"
+        "  -b            Batch mode: exits if specified file doesn't exist\n"
+        "  -c            Enable record checksum verification\n"
+        "  -C [Poly][Init][RefIn][RefOut][XorOut]\n                CRC parameters\n"
+        "  -e [ext]      Output filename extension (without the dot)\n"
+        "  -E [0|1]      Endian for checksum/CRC, 0: little, 1: big\n"
+        "  -f [address]  address of check result to write\n"
+        "  -F [address] [value]\n                address and value to force\n"
+        "  -k [0-6]      Select check method (checksum or CRC) and size\n"
+        "  -d            display list of check methods/value size\n"
+        "  -l [length]   Maximal Length (Starting address + Length -1 is Max address)\n"
+        "                File will be filled with Pattern until Max address is reached\n"
+        "  -m [size]     Minimum Block Size\n"
+        "                File Size Dimension will be a multiple of Minimum block size\n"
+        "                File will be filled with Pattern\n"
+        "                Length must be a power of 2 in hexadecimal [see -l option]\n"
+        "                Attention this option is STRONGER than Maximal Length  \n"
+        "  -p [value]    Pad-byte value in hex (default: %x)\n"
+        "  -r [start] [end]\n"
+        "                Range to compute checksum over (default is min and max addresses)\n"
+        "  -R [name] [floor] [ceiling] [pad] [size]\n"
+        "                Region written to file_name.bin, may be repeated\n"
+        "                size is the Minimum Block Size of the region (0: none)\n"
+        "  -s [address]  Starting address in hex for binary file (default: 0)\n"
+        "                ex.: if the first record is :nn010000ddddd...\n"
+        "                the data supposed to be stored at 0100 will start at 0000\n"
+        "                in the binary file.\n"
+        "                Specifying this starting address will put pad bytes in the\n"
+        "                binary file so that the data supposed to be stored at 0100\n"
+        "                will start at the same address in the binary file.\n"
+        "  -t [address]  Floor address in hex (hex2bin only)\n"
+        "  -T [address]  Ceiling address in hex (hex2bin only)\n"
+        "  -v            Verbose messages for debugging purposes\n"
+        "  -w            Swap wordwise (low <-> high)\n"
+        "  --stats[=json]\n"
+        "                Time, records and memory of each phase on stdout\n\n",
+        program_name, func, line, pad_byte);
+    exit(1);
+}
+
+static void DisplayCheckMethods(void)
+{
+    fprintf(fp, "Check methods/value size:\n"
+        "0:  checksum  8-bit\n"
+        "1:  checksum 16-bit (adds 16-bit words into a 16-bit sum, data and result BE or LE)\n"
+        "2:  CRC8\n"
+        "3:  CRC16\n"
+        "4:  CRC32\n"
+        "5:  checksum 16-bit (adds bytes into a 16-bit sum, result BE or LE)\n");
+    exit(1);
+}
+
+/* Open the input file, with error checking */
+bool NoFailOpenInputFile(char *file_name)
+{
+    file_in = fopen(file_name, "r");
+    if (file_in == NULL) {
+        if (batch_mode) {
+            fprintf(fp, "Input file %s cannot be opened.\n", file_name);
+            exit(1);
+        } else {
+            fprintf(fp, "Input file %s cannot be opened. Enter new filename: ", file_name);
+            if (file_name[strlen(file_name) - 1] == '\n') {
+                file_name[strlen(file_name) - 1] = '\0';
+            }
+        }
+        return false;
+    }
+
+#ifdef USE_FILE_BUFFERS
+    FilinBuf = (char *)NoFailMalloc(BUFFSZ);
+    setvbuf(file_in, FilinBuf, _IOFBF, BUFFSZ);
+#endif
+
+    return true;
+}
+
+void NoFailCloseInputFile(char *file_name)
+{
+    fclose(file_in);
+}
+
+/* Open the output file, with error checking */
+void NoFailOpenOutputFile(char *file_name)
+{
+    while ((file_out = fopen(file_name, "wb")) == NULL) {
+        if (batch_mode) {
+            fprintf(fp, "Output file %s cannot be opened.\n", file_name);
+            exit(1);
+        } else {
+            /* Failure to open the output file may be
+             simply due to an insufficient permission setting. */
+            fprintf(fp, "Output file %s cannot be opened. Enter new file name: ", file_name);
+            if (file_name[strlen(file_name) - 1] == '\n') {
+                file_name[strlen(file_name) - 1] = '\0';
+            }
+        }
+    }
+
+#ifdef USE_FILE_BUFFERS
+    FiloutBuf = (char *)NoFailMalloc(BUFFSZ);
+    setvbuf(file_out, FiloutBuf, _IOFBF, BUFFSZ);
+#endif
+} /* procedure OPENFILOUT */
+
+void NoFailCloseOutputFile(char *file_name)
+{
+    //fclose(fileOut);
+}
+
+void GetLine(char *str, FILE *in)
+{
+    char *result;
+
+    result = fgets(str, MAX_LINE_SIZE, in);
+    STATS_ADD_PHASE(records, 1);
+    if ((result == NULL) && !feof(in)) {
+        fprintf(fp, "Error occurred while reading from file\n");
+    }
+}
+
+#if 0
+static int GetDec(const char *str)
+{
+    int result;
+    uint32_t value;
+
+    result = sscanf(str, "%u", &value);
+
+    if (result == 1) {
+        return value;
+    } else {
+        fprintf(fp, "GetDec: some error occurred when parsing options.\n");
+        exit(1);
+    }
+}
+#endif
+
+void GetFilename(char *dest, char *src)
+{
+    if (strlen(src) < MAX_FILE_NAME_SIZE) {
+        strcpy(dest, src);
+    } else {
+        fprintf(fp, "filename length exceeds %d characters.\n", MAX_FILE_NAME_SIZE);
+        exit(1);
+    }
+}
+
+static void GetExtension(const char *str, char *ext)
+{
+    if (strlen(str) > MAX_EXTENSION_SIZE) {
+        usage(__func__, __LINE__);
+    }
+
+    strcpy(ext, str);
+}
+
+/* Adds an extension to a file name */
+void PutExtension(char *file_name, char *extension)
+{
+    char *period; /* location of period in file name */
+
+    /* This assumes DOS like file names */
+    /* Don't use strchr(): consider the following filename:
+     ../my.dir/file.hex
+    */
+    if ((period = strrchr(file_name, '.')) != NULL) {
+        *(period) = '\0';
+        if (strcmp(extension, period + 1) == 0) {
+            fprintf(fp, "Input and output filenames (%s) are the same.\n", file_name);
+            exit(1);
+        }
+    }
+    strcat(file_name, ".");
+    strcat(file_name, extension);
+}
+
+/* Check if are set Floor and Ceiling address and range is coherent */
+void VerifyRangeFloorCeil(void)
+{
+    if (floor_address_setted && ceiling_address_setted && (floor_address >= ceiling_address)) {
+        fprintf(fp, "Floor address %08" PRIX64 " higher than Ceiling address %08" PRIX64 "\n", floor_address,
+            ceiling_address);
+        exit(1);
+    }
+}
+
+/*
+ * Allocate a buffer filled with the pad byte. A large zero-filled block
+ * from calloc() comes straight from the OS: its pages are only mapped when
+ * a record writes in them, so a sparse image of a few hundreds MB doesn't
+ * cost more than its data.
+ */
+uint8_t *AllocateImage(uint64_t length, int pad)
+{
+    uint8_t *block;
+
+    if ((length == 0) || (length > (uint64_t)SIZE_MAX)) {
+        fprintf(fp, "Can't allocate memory: length 0x%" PRIX64 "\n", length);
+        exit(1);
+    }
+
+    if (pad == 0) {
+        block = (uint8_t *)calloc((size_t)length, 1);
+        if (block == NULL) {
+            fprintf(fp, "Can't allocate memory.\n");
+            exit(1);
+        }
+        STATS_ADD(allocations, 1);
+        STATS_ADD(allocated_bytes, length);
+    } else {
+        /* For EPROM or FLASH memory types, fill unused bytes with FF or the value specified by the p option */
+        block = (uint8_t *)NoFailMalloc((size_t)length);
+        memset(block, pad, (size_t)length);
+    }
+
+    return block;
+}
+
+void Allocate_Memory_And_Rewind(uint8_t **memory_block)
+{
+    if (starting_address_setted == true) {
+        g_lowest_address = starting_address;
+    } else {
+        starting_address = g_lowest_address;
+    }
+
+    if (max_length_setted == false) {
+        if (g_highest_address < g_lowest_address) {
+            fprintf(fp, "No data from address 0x%08" PRIX64 "\n", g_lowest_address);
+            exit(1);
+        }
+        max_length = g_highest_address - g_lowest_address + 1;
+    } else {
+        g_highest_address = g_lowest_address + max_length - 1;
+    }
+
+    fprintf(fp, "Allocate_Memory_and_Rewind:\n");
+    fprintf(fp, "Lowest address:   = 0x%08" PRIX64 "\n", g_lowest_address);
+    fprintf(fp, "Highest address:  = 0x%08" PRIX64 "\n", g_highest_address);
+    fprintf(fp, "Starting address: = 0x%08" PRIX64 "\n", starting_address);
+    fprintf(fp, "Max Length:       = 0x%" PRIX64 "\n\n", max_length);
+
+    /* Now that we know the buffer size, we can allocate it. */
+    *memory_block = AllocateImage(max_length, pad_byte);
+
+    rewind(file_in);
+}
+
+static void ParseRegion(const char *name, const char *floor_str, const char *ceiling_str, const char *pad_str,
+    const char *size_str)
+{
+    struct Region *region;
+    uint32_t i;
+
+    if (region_count == MAX_REGIONS) {
+        fprintf(fp, "Too many regions (max %d)\n", MAX_REGIONS);
+        exit(1);
+    }
+    if (strlen(name) >= MAX_REGION_NAME_SIZE) {
+        fprintf(fp, "Region name %s exceeds %d characters\n", name, MAX_REGION_NAME_SIZE - 1);
+        exit(1);
+    }
+
+    region = &regions[region_count];
+    strcpy(region->name, name);
+    region->floor = GetHex64(floor_str);
+    region->ceiling = GetHex64(ceiling_str);
+    region->pad_byte = GetHex(pad_str) & 0xFF;
+    region->minimum_block_size = GetHex64(size_str);
+
+    if (region->floor > region->ceiling) {
+        fprintf(fp, "Region %s: floor address %08" PRIX64 " higher than ceiling address %08" PRIX64 "\n", name,
+            region->floor, region->ceiling);
+        exit(1);
+    }
+
+    for (i = 0; i < region_count; i++) {
+        if ((region->floor <= regions[i].ceiling) && (region->ceiling >= regions[i].floor)) {
+            fprintf(fp, "Region %s overlaps region %s\n", name, regions[i].name);
+            exit(1);
+        }
+    }
+
+    region_count++;
+}
+
+bool RegionsDefined(void)
+{
+    return region_count != 0;
+}
+
+static struct Region *FindRegion(uint64_t address)
+{
+    uint32_t i;
+
+    /* Consecutive bytes are usually in the same region */
+    if ((current_region != NULL) && (address >= current_region->floor) && (address <= current_region->ceiling)) {
+        return current_region;
+    }
+
+    for (i = 0; i < region_count; i++) {
+        if ((address >= regions[i].floor) && (address <= regions[i].ceiling)) {
+            current_region = &regions[i];
+            return current_region;
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns false if the address isn't in a region */
+static bool RegionWriteByte(uint64_t address, uint8_t value, bool *overlap)
+{
+    struct Region *region = FindRegion(address);
+    uint64_t region_size;
+    uint64_t size;
+    uint64_t offset;
+
+    if (region == NULL) {
+        return false;
+    }
+
+    offset = address - region->floor;
+    if (swap_wordwise) {
+        offset ^= 1;
+    }
+
+    region_size = region->ceiling - region->floor + 1;
+    if ((offset >= region_size) || (offset >= (uint64_t)SIZE_MAX)) {
+        return false;
+    }
+
+    /* Extend the region buffer, filled with its pad byte */
+    if (offset >= region->allocated) {
+        size = region->allocated * 2;
+        if (size <= offset) {
+            size = (offset + 0x1000) & ~(uint64_t)0xFFF;
+        }
+        if ((size > region_size) || (size > (uint64_t)SIZE_MAX)) {
+            size = (region_size < (uint64_t)SIZE_MAX) ? region_size : (uint64_t)SIZE_MAX;
+        }
+        region->memory_block = (uint8_t *)NoFailRealloc(region->memory_block, (size_t)size);
+        memset(region->memory_block + region->allocated, region->pad_byte, (size_t)(size - region->allocated));
+        region->allocated = size;
+    }
+
+    if (offset < region->length) {
+        if (region->memory_block[offset] != region->pad_byte) {
+            STATS_ADD(overlaps, 1);
+            *overlap = true;
+        }
+    } else {
+        region->length = offset + 1;
+    }
+    region->memory_block[offset] = value;
+
+    return true;
+}
+
+/* Region mode: g_lowest_address is 0 so g_phys_addr is the absolute address */
+static void RegionWriteBytes(const uint8_t *data, uint64_t nb_bytes)
+{
+    uint64_t i;
+    bool overlap = false;
+    bool skipped = false;
+
+    for (i = 0; i < nb_bytes; i++) {
+        if (RegionWriteByte(g_phys_addr++, data[i], &overlap) == false) {
+            STATS_ADD(skipped, 1);
+            skipped = true;
+        }
+    }
+
+    if (overlap) {
+        fprintf(fp, "Overlapped record detected\n");
+    }
+    if (skipped) {
+        fprintf(fp, "Data outside of regions skipped at %08" PRIX64 "\n", g_phys_addr - nb_bytes);
+    }
+}
+
+/* Write each region in file_name_regionname.extension */
+void RegionsWriteOutFiles(const char *file_name, const char *extension)
+{
+    char region_file_name[MAX_FILE_NAME_SIZE];
+    const char *period;
+    size_t base_length;
+    struct Region *region;
+    uint8_t *memory_block_new;
+    uint64_t module;
+    uint32_t i;
+
+    /* Don't use strchr(), see PutExtension() */
+    period = strrchr(file_name, '.');
+    base_length = (period != NULL) ? (size_t)(period - file_name) : strlen(file_name);
+
+    for (i = 0; i < region_count; i++) {
+        region = &regions[i];
+
+        if (region->length == 0) {
+            fprintf(fp, "Region %s: no data, no file written\n\n", region->name);
+            continue;
+        }
+
+        if (base_length + strlen(region->name) + strlen(extension) + 3 > MAX_FILE_NAME_SIZE) {
+            fprintf(fp, "filename length exceeds %d characters.\n", MAX_FILE_NAME_SIZE);
+            exit(1);
+        }
+        memcpy(region_file_name, file_name, base_length);
+        sprintf(region_file_name + base_length, "_%s.%s", region->name, extension);
+
+        /* The check value is written only in the region containing its address */
+        g_lowest_address = region->floor;
+        g_highest_address = region->floor + region->length - 1;
+
+        fprintf(fp, "Region %s: %s\n", region->name, region_file_name);
+        fprintf(fp, "Lowest address:   = 0x%08" PRIX64 "\n", g_lowest_address);
+        fprintf(fp, "Highest address:  = 0x%08" PRIX64 "\n", g_highest_address);
+        fprintf(fp, "Pad Byte          = 0x%X\n", region->pad_byte);
+
+        WriteMemory(region->memory_block);
+
+        NoFailOpenOutputFile(region_file_name);
+        fwrite(region->memory_block, (size_t)region->length, 1, file_out);
+        STATS_ADD_PHASE(data_bytes, region->length);
+
+        if (region->minimum_block_size != 0) {
+            module = region->length % region->minimum_block_size;
+            if (module) {
+                module = region->minimum_block_size - module;
+                memory_block_new = AllocateImage(module, region->pad_byte);
+                fwrite(memory_block_new, (size_t)module, 1, file_out);
+                STATS_ADD_PHASE(data_bytes, module);
+                free(memory_block_new);
+                fprintf(fp, "Extended by %" PRIu64 " bytes\n", module);
+            }
+        }
+        fprintf(fp, "\n");
+
+        fclose(file_out);
+        free(region->memory_block);
+        region->memory_block = NULL;
+    }
+}
+
+char *ReadDataBytes(char *p, uint8_t *memory_block, uint8_t *cs, uint16_t record_nb, uint32_t nb_bytes)
+{
+    uint32_t i, temp2;
+    uint8_t data[MAX_LINE_SIZE / 2];
+    int result;
+
+    STATS_ADD_PHASE(data_bytes, nb_bytes);
+
+    /* Read the Data bytes. */
+    /* Bytes are written in the Memory block even if checksum is wrong. */
+    if (region_count != 0) {
+        if (nb_bytes > sizeof(data)) {
+            fprintf(fp, "ReadDataBytes: error in line %d of hex file\n", record_nb);
+            return p;
+        }
+
+        for (i = 0; i < nb_bytes; i++) {
+            result = sscanf(p, "%2x", &temp2);
+            if (result != 1) {
+                fprintf(fp, "ReadDataBytes: error in line %d of hex file\n", record_nb);
+            }
+            p += 2;
+
+            data[i] = temp2;
+            *cs = (*cs + temp2) & 0xFF;
+        }
+        RegionWriteBytes(data, nb_bytes);
+
+        return p;
+    }
+
+    i = nb_bytes;
+
+    do {
+        result = sscanf(p, "%2x", &temp2);
+        if (result != 1) {
+            fprintf(fp, "ReadDataBytes: error in line %d of hex file\n", record_nb);
+        }
+        p += 2;
+
+        /* Check that the physical address stays in the buffer's range. */
+        if (g_phys_addr < max_length) {
+            /* Overlapping record will erase the pad bytes */
+            if (swap_wordwise) {
+                if (memory_block[g_phys_addr ^ 1] != pad_byte) {
+                    STATS_ADD(overlaps, 1);
+                    fprintf(fp, "Overlapped record detected\n");
+                }
+                memory_block[g_phys_addr++ ^ 1] = temp2;
+            } else {
+                if (memory_block[g_phys_addr] != pad_byte) {
+                    STATS_ADD(overlaps, 1);
+                    fprintf(fp, "Overlapped record detected\n");
+                }
+                memory_block[g_phys_addr++] = temp2;
+            }
+
+            *cs = (*cs + temp2) & 0xFF;
+        } else {
+            STATS_ADD(skipped, 1);
+        }
+    } while (--i != 0);
+
+    return p;
+}
+
+/* Same as ReadDataBytes() for data that is already binary (ELF segments) */
+void WriteDataBytes(const uint8_t *data, uint8_t *memory_block, uint64_t nb_bytes)
+{
+    uint64_t i;
+    bool overlap = false;
+
+    STATS_ADD_PHASE(data_bytes, nb_bytes);
+
+    if (region_count != 0) {
+        RegionWriteBytes(data, nb_bytes);
+        return;
+    }
+
+    for (i = 0; i < nb_bytes; i++) {
+        /* Check that the physical address stays in the buffer's range. */
+        if (g_phys_addr >= max_length) {
+            STATS_ADD(skipped, nb_bytes - i);
+            break;
+        }
+
+        /* Overlapping data will erase the pad bytes */
+        if (swap_wordwise) {
+            if (memory_block[g_phys_addr ^ 1] != pad_byte) {
+                STATS_ADD(overlaps, 1);
+                overlap = true;
+            }
+            memory_block[g_phys_addr++ ^ 1] = data[i];
+        } else {
+            if (memory_block[g_phys_addr] != pad_byte) {
+                STATS_ADD(overlaps, 1);
+                overlap = true;
+            }
+            memory_block[g_phys_addr++] = data[i];
+        }
+    }
+
+    if (overlap) {
+        fprintf(fp, "Overlapped record detected\n");
+    }
+}
+
+void WriteOutFile(uint8_t **memory_block)
+{
+    uint64_t module;
+    uint8_t *memory_block_new = NULL;
+
+    /* write binary file */
+    fwrite(*memory_block, (size_t)max_length, 1, file_out);
+    STATS_ADD_PHASE(data_bytes, max_length);
+    free(*memory_block);
+
+    // minimum_block_size is set; the memory buffer is multiple of this?
+    if (minimum_block_size_setted == false) {
+        return;
+    }
+
+    module = max_length % minimum_block_size;
+    if (module) {
+        module = minimum_block_size - module;
+        memory_block_new = AllocateImage(module, pad_byte);
+        fwrite(memory_block_new, (size_t)module, 1, file_out);
+        STATS_ADD_PHASE(data_bytes, module);
+        free(memory_block_new);
+        if (max_length_setted == true) {
+            fprintf(fp, "Attention Max Length changed by Minimum Block Size\n");
+        }
+        // extended
+        max_length += module;
+        g_highest_address += module;
+        fprintf(fp, "Extended\nHighest address: %08" PRIX64 "\n", g_highest_address);
+        fprintf(fp, "Max Length: %" PRIu64 "\n\n", max_length);
+    }
+}
+
+/* Options without a single-letter form: --name or --name=value */
+static void ParseLongOption(const char *name)
+{
+    if (strcmp(name, "stats") == 0) {
+        StatsEnable(false);
+    } else if (strcmp(name, "stats=json") == 0) {
+        StatsEnable(true);
+    } else {
+        usage(__func__, __LINE__);
+    }
+}
+
+/*
+ * Parse options on the command line
+ * variables:
+ * use p for parsing arguments
+ * use i for number of parameters to skip
+ * use c for the current option
+ */
+void ParseOptions(int argc, char *argv[])
+{
+    int param;
+    char *p;
+
+    starting_address = 0;
+
+    for (param = 1; param < argc; param++) {
+        int i = 0;
+        char c;
+
+        p = argv[param];
+        c = *(p + 1); /* Get option character */
+
+        if (_IS_OPTION_(*p)) {
+            // test for no space between option and parameter
+            if ((c != '-') && (strlen(p) != 2)) {
+                usage(__func__, __LINE__);
+            }
+
+            switch (c) {
+                case 'a':
+                    address_alignment_word = true;
+                    i = 0;
+                    break;
+                case 'b':
+                    batch_mode = true;
+                    i = 0;
+                    break;
+                case 'c':
+                    enable_checksum_error = true;
+                    i = 0;
+                    break;
+                case 'd':
+                    DisplayCheckMethods();
+                case 'e':
+                    // GetExtension(argv[param + 1], extension);
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'E':
+                    Para_E(argv[param + 1]);
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'f':
+                    Para_f(argv[param + 1]);
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'F':
+                    Para_F(argv[param + 1], argv[param + 2]);
+                    i = 2; /* add 2 to param */
+                    break;
+                case 'k':
+                    Para_k(argv[param + 1]);
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'l':
+                    max_length = GetHex64(argv[param + 1]);
+                    if (max_length == 0) {
+                        fprintf(fp, "max_length = 0\n");
+                        exit(1);
+                    }
+                    max_length_setted = true;
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'm':
+                    minimum_block_size = GetHex64(argv[param + 1]);
+                    if (minimum_block_size == 0) {
+                        usage(__func__, __LINE__);
+                    }
+                    minimum_block_size_setted = true;
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'p':
+                    pad_byte = GetHex(argv[param + 1]);
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'r':
+                    Para_r(argv[param + 1], argv[param + 2]);
+                    i = 2; /* add 2 to param */
+                    break;
+                case 'R':
+                    ParseRegion(argv[param + 1], argv[param + 2], argv[param + 3], argv[param + 4], argv[param + 5]);
+                    i = 5; /* add 5 to param */
+                    break;
+                case 's':
+                    starting_address = GetHex64(argv[param + 1]);
+                    starting_address_setted = true;
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'v':
+                    verbose_flag = true;
+                    i = 0;
+                    break;
+                case 't':
+                    floor_address = GetHex64(argv[param + 1]);
+                    floor_address_setted = true;
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'T':
+                    ceiling_address = GetHex64(argv[param + 1]);
+                    ceiling_address_setted = true;
+                    i = 1; /* add 1 to param */
+                    break;
+                case 'w':
+                    swap_wordwise = true;
+                    i = 0;
+                    break;
+                case 'C':
+                    Para_C(argv[param + 1], argv[param + 2], argv[param + 3], argv[param + 4], argv[param + 5]);
+                    i = 5; /* add 5 to param */
+                    break;
+                case '-':
+                    ParseLongOption(p + 2);
+                    i = 0;
+                    break;
+
+                case '?':
+                case 'h':
+                default:
+                    usage(__func__, __LINE__);
+                    break;
+            }
+
+            /* Last parameter is not a filename */
+            if (param == argc - 1) {
+                usage(__func__, __LINE__);
+            }
+
+            // fprintf(fp,"param: %d, option: %c\n", param, c);
+
+            /* if (param + i) < (argc -1) */
+            if (param < argc - 1 - i) {
+                param += i;
+            } else {
+                // fprintf(fp,"param: %d, argc: %d, i: %d\n", param, argc, i);
+                usage(__func__, __LINE__);
+            }
+        } else {
+            break;
+        }
+        /* if option */
+    } /* for param */
+}
+
+FILE *GetInFile(void)
+{
+    return file_in;
+}
+
+bool GetAddressAlignmentWord(void)
+{
+    return address_alignment_word;
+}
+
+bool GetStatusChecksumError(void)
+{
+    return status_checksum_error;
+}
+
+void SetStatusChecksumError(bool value)
+{
+    status_checksum_error = value;
+}
+
+bool GetEnableChecksumError(void)
+{
+    return enable_checksum_error;
+}
+
+int GetPadByte(void)
+{
+    return pad_byte;
+}
+
+bool check_floor_address(void)
+{
+    bool flag = true;
+
+    if (floor_address_setted) {
+        /* Discard if lower than floor_address */
+        if (g_phys_addr < (floor_address - starting_address)) {
+            if (verbose_flag) {
+                fprintf(fp, "Discard physical address less than %08" PRIX64 "\n",
+                    floor_address - starting_address);
+            }
+            flag = false;
+        }
+    }
+
+    return flag;
+}
+
+bool check_ceiling_address(uint64_t temp)
+{
+    bool flag = true;
+
+    if (ceiling_address_setted) {
+        /* Discard if higher than ceiling_address */
+        if (temp > (ceiling_address + starting_address)) {
+            if (verbose_flag) {
+                fprintf(fp, "Discard physical address more than %08" PRIX64 "\n",
+                    ceiling_address + starting_address);
+            }
+            flag = false;
+        }
+    }
+
+    return flag;
+}
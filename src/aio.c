@@ -0,0 +1,581 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Asynchronous I/O. The input file is read ahead by blocks while the
+  previous block is decoded: with io_uring on Linux, else with a thread
+  calling pread(). The image is written with several io_uring writes in
+  flight. Pipes, other systems and --io=stdio use stdio.
+*/
+#if defined(__linux__)
+#define _GNU_SOURCE
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "arena.h"
+#include "aio.h"
+
+#if !defined(_WIN32)
+#define USE_AIO_THREAD
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define USE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#define AIO_BLOCK_SIZE 0x40000
+#define AIO_DEPTH 4
+#define AIO_WRITE_SIZE 0x100000
+
+static enum AioMode aio_mode = AIO_AUTO;
+
+void AioSetMode(enum AioMode mode)
+{
+    aio_mode = mode;
+}
+
+#if defined(USE_AIO_THREAD)
+
+struct AioBlock {
+    char *data;
+    size_t length; /* bytes read */
+    bool done;
+};
+
+static enum AioMode aio_active = AIO_STDIO; /* backend of the current input */
+static FILE *aio_in = NULL;
+static int aio_fd;
+static uint64_t aio_start;    /* offset of the first block */
+static uint64_t aio_size;     /* size of the file */
+static uint64_t aio_total;    /* blocks to read */
+static uint64_t aio_current;  /* block being returned */
+static size_t aio_position;   /* in the current block */
+static uint64_t aio_consumed; /* bytes returned */
+static uint32_t aio_nb_blocks;
+static struct AioBlock aio_blocks[AIO_DEPTH];
+
+/* Reader thread */
+static pthread_t aio_thread;
+static pthread_mutex_t aio_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aio_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t aio_released; /* blocks returned, their buffer can be read again */
+static uint64_t aio_filled;   /* blocks read by the thread */
+static bool aio_stop;
+
+static uint64_t BlockOffset(uint64_t block)
+{
+    return aio_start + block * AIO_BLOCK_SIZE;
+}
+
+static size_t BlockLength(uint64_t block)
+{
+    uint64_t left = aio_size - BlockOffset(block);
+
+    return (left < AIO_BLOCK_SIZE) ? (size_t)left : AIO_BLOCK_SIZE;
+}
+
+/* Synchronous read of the rest of a block, after a short read */
+static size_t ReadAt(int fd, char *data, size_t length, uint64_t offset)
+{
+    size_t done = 0;
+    ssize_t nb;
+
+    while (done < length) {
+        nb = pread(fd, data + done, length - done, (off_t)(offset + done));
+        if (nb < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(fp, "Error occurred while reading from file\n");
+            break;
+        }
+        if (nb == 0) {
+            break;
+        }
+        done += (size_t)nb;
+    }
+
+    return done;
+}
+
+static void *AioThread(void *arg)
+{
+    struct AioBlock *block;
+    uint64_t k;
+    bool stop;
+
+    (void)arg;
+    for (k = 0; k < aio_total; k++) {
+        pthread_mutex_lock(&aio_mutex);
+        while (!aio_stop && (k >= aio_released + aio_nb_blocks)) {
+            pthread_cond_wait(&aio_cond, &aio_mutex);
+        }
+        stop = aio_stop;
+        pthread_mutex_unlock(&aio_mutex);
+        if (stop) {
+            break;
+        }
+
+        block = &aio_blocks[k % aio_nb_blocks];
+        block->length = ReadAt(aio_fd, block->data, BlockLength(k), BlockOffset(k));
+
+        pthread_mutex_lock(&aio_mutex);
+        aio_filled = k + 1;
+        pthread_cond_broadcast(&aio_cond);
+        pthread_mutex_unlock(&aio_mutex);
+    }
+
+    return NULL;
+}
+
+#if defined(USE_IO_URING)
+
+/* Rings of io_uring, without liburing */
+static int ring_fd = -1;
+static unsigned ring_entries;
+static unsigned *sq_tail;
+static unsigned *sq_mask;
+static unsigned *sq_array;
+static unsigned *cq_head;
+static unsigned *cq_tail;
+static unsigned *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static void *sq_ring;
+static void *cq_ring;
+static size_t sq_ring_size;
+static size_t cq_ring_size;
+static size_t sqes_size;
+
+static bool RingOpen(void)
+{
+    struct io_uring_params params;
+    uint8_t *sq;
+    uint8_t *cq;
+
+    memset(&params, 0, sizeof(params));
+    ring_fd = (int)syscall(__NR_io_uring_setup, AIO_DEPTH, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size > sq_ring_size) {
+            sq_ring_size = cq_ring_size;
+        }
+        cq_ring_size = sq_ring_size;
+    }
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        close(ring_fd);
+        ring_fd = -1;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+            IORING_OFF_CQ_RING);
+    }
+    sqes = (struct io_uring_sqe *)mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+        IORING_OFF_SQES);
+    if ((cq_ring == MAP_FAILED) || (sqes == MAP_FAILED)) {
+        munmap(sq_ring, sq_ring_size);
+        if ((cq_ring != sq_ring) && (cq_ring != MAP_FAILED)) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqes_size);
+        }
+        close(ring_fd);
+        ring_fd = -1;
+        return false;
+    }
+
+    sq = (uint8_t *)sq_ring;
+    cq = (uint8_t *)cq_ring;
+    ring_entries = params.sq_entries;
+    sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq + params.sq_off.array);
+    cq_head = (unsigned *)(cq + params.cq_off.head);
+    cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+static void RingClose(void)
+{
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    munmap(sq_ring, sq_ring_size);
+    close(ring_fd);
+    ring_fd = -1;
+}
+
+/* Queue a read or a write and submit it */
+static void RingSubmit(uint8_t opcode, int fd, void *data, size_t length, uint64_t offset, uint64_t user_data)
+{
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = (uint32_t)length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while ((syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, NULL, 0) < 0) && (errno == EINTR)) {
+    }
+}
+
+/* Wait for a completion; returns its result */
+static int32_t RingWait(uint64_t *user_data)
+{
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    int32_t result;
+
+    for (;;) {
+        head = *cq_head;
+        if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    }
+
+    cqe = &cqes[head & *cq_mask];
+    *user_data = cqe->user_data;
+    result = cqe->res;
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return result;
+}
+
+static void RingRead(uint64_t block)
+{
+    RingSubmit(IORING_OP_READ, aio_fd, aio_blocks[block % aio_nb_blocks].data, BlockLength(block),
+        BlockOffset(block), block);
+}
+
+/* Reap completions until the block is read */
+static void RingWaitBlock(uint64_t block)
+{
+    struct AioBlock *done;
+    uint64_t k;
+    int32_t result;
+
+    while (aio_blocks[block % aio_nb_blocks].done == false) {
+        result = RingWait(&k);
+        done = &aio_blocks[k % aio_nb_blocks];
+
+        /* Error or short read: the rest is read here */
+        if (result < 0) {
+            result = 0;
+        }
+        done->length = (size_t)result;
+        if (done->length < BlockLength(k)) {
+            done->length += ReadAt(aio_fd, done->data + done->length, BlockLength(k) - done->length,
+                BlockOffset(k) + done->length);
+        }
+        done->done = true;
+    }
+}
+
+#endif /* USE_IO_URING */
+
+/* Start reading in at its current position, with blocks read ahead */
+void AioBegin(FILE *in)
+{
+    struct stat st;
+    off_t start;
+    uint32_t i;
+
+    AioEnd();
+
+    aio_in = in;
+    aio_active = AIO_STDIO;
+    if (aio_mode == AIO_STDIO) {
+        return;
+    }
+
+    /* Only a regular file can be read at an offset */
+    aio_fd = fileno(in);
+    start = ftello(in);
+    if ((fstat(aio_fd, &st) != 0) || !S_ISREG(st.st_mode) || (start < 0) || (st.st_size <= start)) {
+        return;
+    }
+
+    aio_start = (uint64_t)start;
+    aio_size = (uint64_t)st.st_size;
+    aio_total = (aio_size - aio_start + AIO_BLOCK_SIZE - 1) / AIO_BLOCK_SIZE;
+    aio_nb_blocks = (aio_total < AIO_DEPTH) ? (uint32_t)aio_total : AIO_DEPTH;
+    aio_current = 0;
+    aio_position = 0;
+    aio_consumed = 0;
+    for (i = 0; i < aio_nb_blocks; i++) {
+        aio_blocks[i].data = (char *)PoolAlloc(AIO_BLOCK_SIZE, NULL);
+        aio_blocks[i].done = false;
+    }
+
+#if defined(USE_IO_URING)
+    if ((aio_mode != AIO_THREAD) && RingOpen()) {
+        aio_active = AIO_URING;
+        for (i = 0; i < aio_nb_blocks; i++) {
+            RingRead(i);
+        }
+        return;
+    }
+#endif
+    if (aio_mode == AIO_URING) {
+        fprintf(fp, "io_uring not available, the file is read by a thread\n");
+    }
+
+    aio_released = 0;
+    aio_filled = 0;
+    aio_stop = false;
+    if (pthread_create(&aio_thread, NULL, AioThread, NULL) == 0) {
+        aio_active = AIO_THREAD;
+        return;
+    }
+
+    for (i = 0; i < aio_nb_blocks; i++) {
+        PoolRelease((uint8_t *)aio_blocks[i].data);
+    }
+}
+
+/* Same as fread(dest, 1, size, in) */
+size_t AioRead(char *dest, size_t size)
+{
+    struct AioBlock *block;
+    size_t copied = 0;
+    size_t nb;
+
+    if (aio_active == AIO_STDIO) {
+        return (aio_in != NULL) ? fread(dest, 1, size, aio_in) : 0;
+    }
+
+    while ((copied < size) && (aio_current < aio_total)) {
+        block = &aio_blocks[aio_current % aio_nb_blocks];
+
+#if defined(USE_IO_URING)
+        if (aio_active == AIO_URING) {
+            RingWaitBlock(aio_current);
+        }
+#endif
+        if (aio_active == AIO_THREAD) {
+            pthread_mutex_lock(&aio_mutex);
+            while (aio_filled <= aio_current) {
+                pthread_cond_wait(&aio_cond, &aio_mutex);
+            }
+            pthread_mutex_unlock(&aio_mutex);
+        }
+
+        nb = block->length - aio_position;
+        if (nb > size - copied) {
+            nb = size - copied;
+        }
+        memcpy(dest + copied, block->data + aio_position, nb);
+        copied += nb;
+        aio_position += nb;
+
+        if (aio_position < block->length) {
+            break;
+        }
+
+        /* The file was truncated while it was read */
+        if (block->length < BlockLength(aio_current)) {
+            aio_total = aio_current + 1;
+        }
+
+        /* The buffer of the block is used for the block AIO_DEPTH ahead */
+        block->done = false;
+#if defined(USE_IO_URING)
+        if ((aio_active == AIO_URING) && (aio_current + aio_nb_blocks < aio_total)) {
+            RingRead(aio_current + aio_nb_blocks);
+        }
+#endif
+        if (aio_active == AIO_THREAD) {
+            pthread_mutex_lock(&aio_mutex);
+            aio_released = aio_current + 1;
+            pthread_cond_broadcast(&aio_cond);
+            pthread_mutex_unlock(&aio_mutex);
+        }
+        aio_current++;
+        aio_position = 0;
+    }
+
+    aio_consumed += copied;
+    return copied;
+}
+
+/* Stop reading ahead; the file position is after the bytes returned */
+void AioEnd(void)
+{
+    uint32_t i;
+
+    if (aio_active == AIO_STDIO) {
+        return;
+    }
+
+#if defined(USE_IO_URING)
+    if (aio_active == AIO_URING) {
+        uint64_t k;
+
+        /* The reads in flight write in the buffers */
+        for (k = aio_current; (k < aio_current + aio_nb_blocks) && (k < aio_total); k++) {
+            RingWaitBlock(k);
+        }
+        RingClose();
+    }
+#endif
+    if (aio_active == AIO_THREAD) {
+        pthread_mutex_lock(&aio_mutex);
+        aio_stop = true;
+        pthread_cond_broadcast(&aio_cond);
+        pthread_mutex_unlock(&aio_mutex);
+        pthread_join(aio_thread, NULL);
+    }
+
+    for (i = 0; i < aio_nb_blocks; i++) {
+        PoolRelease((uint8_t *)aio_blocks[i].data);
+    }
+    fseeko(aio_in, (off_t)(aio_start + aio_consumed), SEEK_SET);
+    aio_active = AIO_STDIO;
+}
+
+#else /* USE_AIO_THREAD */
+
+static FILE *aio_in = NULL;
+
+void AioBegin(FILE *in)
+{
+    aio_in = in;
+}
+
+size_t AioRead(char *dest, size_t size)
+{
+    return fread(dest, 1, size, aio_in);
+}
+
+void AioEnd(void)
+{
+}
+
+#endif /* USE_AIO_THREAD */
+
+/*
+ * Write the image at the current position of out. With io_uring, the
+ * writes of AIO_WRITE_SIZE are queued AIO_DEPTH at a time.
+ */
+void AioWrite(FILE *out, const uint8_t *data, uint64_t length)
+{
+#if defined(USE_IO_URING)
+    struct stat st;
+    off_t start;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t offset;
+    uint32_t in_flight = 0;
+    size_t chunk;
+    int32_t result;
+    int fd;
+
+    fflush(out);
+    fd = fileno(out);
+    start = ftello(out);
+    if ((aio_mode != AIO_AUTO) && (aio_mode != AIO_URING)) {
+        fwrite(data, 1, (size_t)length, out);
+        return;
+    }
+    if ((length < 2 * AIO_WRITE_SIZE) || (start < 0) || (fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+        (aio_active == AIO_URING) || !RingOpen()) {
+        fwrite(data, 1, (size_t)length, out);
+        return;
+    }
+
+    while (completed < length) {
+        while ((in_flight < AIO_DEPTH) && (submitted < length)) {
+            chunk = (length - submitted < AIO_WRITE_SIZE) ? (size_t)(length - submitted) : AIO_WRITE_SIZE;
+            RingSubmit(IORING_OP_WRITE, fd, (void *)(data + submitted), chunk, (uint64_t)start + submitted,
+                submitted);
+            submitted += chunk;
+            in_flight++;
+        }
+
+        result = RingWait(&offset);
+        in_flight--;
+        chunk = (length - offset < AIO_WRITE_SIZE) ? (size_t)(length - offset) : AIO_WRITE_SIZE;
+
+        /* Error or short write: the rest is written here */
+        if (result < 0) {
+            result = 0;
+        }
+        while ((size_t)result < chunk) {
+            ssize_t nb = pwrite(fd, data + offset + result, chunk - result, (off_t)(start + offset + result));
+            if (nb <= 0) {
+                if ((nb < 0) && (errno == EINTR)) {
+                    continue;
+                }
+                fprintf(fp, "Error occurred while writing to file\n");
+                break;
+            }
+            result += (int32_t)nb;
+        }
+        completed += chunk;
+    }
+
+    RingClose();
+    fseeko(out, (off_t)(start + length), SEEK_SET);
+#else
+    fwrite(data, 1, (size_t)length, out);
+#endif
+}
@@ -0,0 +1,22 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* I/O of the input and output files (--io option) */
+enum AioMode {
+    AIO_AUTO = 0, /* io_uring, else a reader thread */
+    AIO_URING,
+    AIO_THREAD,
+    AIO_STDIO
+};
+
+extern void AioSetMode(enum AioMode mode);
+extern void AioBegin(FILE *in);
+extern size_t AioRead(char *dest, size_t size);
+extern void AioEnd(void);
+extern void AioWrite(FILE *out, const uint8_t *data, uint64_t length);
+
+#endif
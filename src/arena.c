@@ -0,0 +1,340 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Memory of a conversion, for a process converting many files.
+
+  The arena is a list of chunks where the small buffers are allocated one
+  after the other; MemoryReset() empties the chunks for the next
+  conversion without freeing them.
+
+  The pool gives the large buffers: a buffer released at the end of a
+  conversion is kept in the free list of its size class (four classes for
+  each power of two from 4 KB) and given again to a buffer of this class.
+  The pool is used by the main thread only.
+
+  With --max-memory, a buffer that would take the pool beyond its budget
+  is mapped from a temporary file instead: the kernel writes its pages to
+  the file and reads them back as the image is decoded and written, so a
+  conversion larger than the RAM is slower instead of failing. The same is
+  done when calloc() fails.
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "stats.h"
+#include "arena.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+
+#define POOL_MIN_SIZE 4096
+#define POOL_CLASSES (4 * 36)          /* up to 2^47 * 1.75 */
+#define POOL_KEEP 2                    /* free buffers kept by size class */
+#define POOL_MAX_KEPT (256 * 1024 * 1024)
+#define POOL_HEADER 64                 /* struct PoolBlock, keeps the buffer aligned */
+
+struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+};
+
+/* Before each buffer of the pool */
+struct PoolBlock {
+    struct PoolBlock *next; /* free list */
+    uint64_t capacity;
+    uint32_t size_class;
+    bool spilled; /* mapped from a temporary file */
+};
+
+#define ARENA_HEADER ((sizeof(struct ArenaChunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static struct ArenaChunk *arena_first = NULL;
+static struct ArenaChunk *arena_last = NULL;
+static struct ArenaChunk *arena_current = NULL;
+
+static struct PoolBlock *pool_free[POOL_CLASSES];
+static uint32_t pool_free_count[POOL_CLASSES];
+static uint64_t pool_kept = 0;
+static uint64_t pool_budget = 0; /* --max-memory, 0 without */
+static uint64_t pool_in_use = 0; /* buffers given and not released, in memory */
+
+void *ArenaAlloc(size_t size)
+{
+    struct ArenaChunk *chunk;
+    size_t chunk_size;
+    void *result;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    /* The chunks after the current one are empty */
+    for (chunk = arena_current; chunk != NULL; chunk = chunk->next) {
+        if (chunk->size - chunk->used >= size) {
+            break;
+        }
+    }
+
+    if (chunk == NULL) {
+        chunk_size = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+        chunk = (struct ArenaChunk *)NoFailMalloc(ARENA_HEADER + chunk_size);
+        chunk->next = NULL;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        if (arena_last != NULL) {
+            arena_last->next = chunk;
+        } else {
+            arena_first = chunk;
+        }
+        arena_last = chunk;
+    }
+
+    result = (uint8_t *)chunk + ARENA_HEADER + chunk->used;
+    chunk->used += size;
+    arena_current = chunk;
+
+    return result;
+}
+
+static uint64_t PoolClassSize(uint32_t size_class)
+{
+    uint64_t base = (uint64_t)POOL_MIN_SIZE << (size_class / 4);
+
+    return base + (base / 4) * (size_class % 4);
+}
+
+static uint32_t PoolClass(uint64_t size)
+{
+    uint32_t size_class = 0;
+
+    while ((size_class < POOL_CLASSES) && (PoolClassSize(size_class) < size)) {
+        size_class++;
+    }
+    if ((size_class == POOL_CLASSES) || (PoolClassSize(size_class) > (uint64_t)SIZE_MAX - POOL_HEADER)) {
+        fprintf(fp, "Can't allocate memory: length 0x%" PRIX64 "\n", size);
+        exit(1);
+    }
+
+    return size_class;
+}
+
+void PoolSetBudget(uint64_t size)
+{
+    pool_budget = size;
+}
+
+/* A new buffer mapped from a deleted temporary file, filled with zeros; NULL if it can't be */
+static struct PoolBlock *SpillAlloc(uint32_t size_class)
+{
+#if !defined(_WIN32)
+    const char *directory = getenv("TMPDIR");
+    char name[MAX_FILE_NAME_SIZE];
+    uint64_t length = POOL_HEADER + PoolClassSize(size_class);
+    struct PoolBlock *block;
+    void *map;
+    int fd;
+
+    if ((directory == NULL) || (directory[0] == '\0')) {
+        directory = "/tmp";
+    }
+    if (snprintf(name, sizeof(name), "%s/hex2bin-XXXXXX", directory) >= (int)sizeof(name)) {
+        return NULL;
+    }
+    fd = mkstemp(name);
+    if (fd < 0) {
+        return NULL;
+    }
+    unlink(name);
+    if ((length > (uint64_t)SIZE_MAX) || (ftruncate(fd, (off_t)length) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, (size_t)length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    block = (struct PoolBlock *)map;
+    block->capacity = PoolClassSize(size_class);
+    block->size_class = size_class;
+    block->spilled = true;
+    STATS_ADD(spilled_bytes, block->capacity);
+    fprintf(fp, "Buffer of %" PRIu64 " bytes in a temporary file of %s\n", block->capacity, directory);
+    return block;
+#else
+    (void)size_class;
+    return NULL;
+#endif
+}
+
+/*
+ * A buffer of at least size bytes. zeroed (if not NULL) tells if it is
+ * new from calloc(), filled with zeros, or recycled.
+ */
+uint8_t *PoolAlloc(uint64_t size, bool *zeroed)
+{
+    uint32_t size_class = PoolClass(size);
+    struct PoolBlock *block = NULL;
+    bool recycled = false;
+
+    /* Beyond the budget, a recycled buffer is kept for a smaller one */
+    if ((pool_budget != 0) && (pool_in_use + PoolClassSize(size_class) > pool_budget)) {
+        block = SpillAlloc(size_class);
+    }
+
+    if ((block == NULL) && (pool_free[size_class] != NULL)) {
+        block = pool_free[size_class];
+        pool_free[size_class] = block->next;
+        pool_free_count[size_class]--;
+        pool_kept -= block->capacity;
+        recycled = true;
+        STATS_ADD(recycled, 1);
+    } else if (block == NULL) {
+        block = (struct PoolBlock *)calloc(1, (size_t)(POOL_HEADER + PoolClassSize(size_class)));
+        if (block == NULL) {
+            block = SpillAlloc(size_class);
+        } else {
+            STATS_ADD(allocations, 1);
+            STATS_ADD(allocated_bytes, PoolClassSize(size_class));
+            block->capacity = PoolClassSize(size_class);
+            block->size_class = size_class;
+        }
+    }
+    if (block == NULL) {
+        fprintf(fp, "Can't allocate memory.\n");
+        exit(1);
+    }
+    if (!block->spilled) {
+        pool_in_use += block->capacity;
+    }
+    if (zeroed != NULL) {
+        *zeroed = !recycled;
+    }
+
+    return (uint8_t *)block + POOL_HEADER;
+}
+
+/* Like realloc(): the content is kept, the bytes added aren't set */
+uint8_t *PoolRealloc(uint8_t *buffer, uint64_t size)
+{
+    struct PoolBlock *block;
+    uint32_t size_class;
+
+    if (buffer == NULL) {
+        return PoolAlloc(size, NULL);
+    }
+    block = (struct PoolBlock *)(buffer - POOL_HEADER);
+    if (size <= block->capacity) {
+        return buffer;
+    }
+
+    size_class = PoolClass(size);
+
+    /* A new buffer, in memory or spilled, when the budget is reached */
+    if (block->spilled ||
+        ((pool_budget != 0) && (pool_in_use - block->capacity + PoolClassSize(size_class) > pool_budget))) {
+        uint8_t *result = PoolAlloc(size, NULL);
+
+        memcpy(result, buffer, (size_t)block->capacity);
+        PoolRelease(buffer);
+        return result;
+    }
+
+    pool_in_use -= block->capacity;
+    block = (struct PoolBlock *)NoFailRealloc(block, (size_t)(POOL_HEADER + PoolClassSize(size_class)));
+    block->capacity = PoolClassSize(size_class);
+    block->size_class = size_class;
+    pool_in_use += block->capacity;
+
+    return (uint8_t *)block + POOL_HEADER;
+}
+
+void PoolRelease(uint8_t *buffer)
+{
+    struct PoolBlock *block;
+    uint32_t size_class;
+
+    if (buffer == NULL) {
+        return;
+    }
+    block = (struct PoolBlock *)(buffer - POOL_HEADER);
+    size_class = block->size_class;
+
+    if (block->spilled) {
+#if !defined(_WIN32)
+        munmap(block, (size_t)(POOL_HEADER + block->capacity));
+#endif
+        return;
+    }
+    pool_in_use -= block->capacity;
+
+    if ((pool_free_count[size_class] < POOL_KEEP) && (pool_kept + block->capacity <= POOL_MAX_KEPT)) {
+        block->next = pool_free[size_class];
+        pool_free[size_class] = block;
+        pool_free_count[size_class]++;
+        pool_kept += block->capacity;
+    } else {
+        free(block);
+    }
+}
+
+/* Frees the buffers kept for the next conversions */
+void PoolTrim(void)
+{
+    struct PoolBlock *block;
+    uint32_t size_class;
+
+    for (size_class = 0; size_class < POOL_CLASSES; size_class++) {
+        while ((block = pool_free[size_class]) != NULL) {
+            pool_free[size_class] = block->next;
+            free(block);
+        }
+        pool_free_count[size_class] = 0;
+    }
+    pool_kept = 0;
+}
+
+/*
+ * Start of a conversion: the arena of the previous one is reused. Its
+ * buffers from the pool are released by their owners (ScannerEnd(),
+ * WriteOutFile()...).
+ */
+void MemoryReset(void)
+{
+    struct ArenaChunk *chunk;
+
+    for (chunk = arena_first; chunk != NULL; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena_current = arena_first;
+}
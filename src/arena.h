@@ -0,0 +1,23 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Memory of a conversion. The small buffers (CRC tables, file buffers)
+ * come from an arena that is reset, not freed, between conversions. The
+ * images and other large buffers come from a pool of recycled buffers,
+ * by size class.
+ */
+extern void *ArenaAlloc(size_t size);
+extern void MemoryReset(void);
+
+extern uint8_t *PoolAlloc(uint64_t size, bool *zeroed);
+extern uint8_t *PoolRealloc(uint8_t *block, uint64_t size);
+extern void PoolRelease(uint8_t *block);
+extern void PoolTrim(void);
+extern void PoolSetBudget(uint64_t size);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
@@ -8,6 +9,14 @@
 #include "binary.h"
 #include "libcrc.h"
 #include "common.h"
+#include "stats.h"
+#include "arena.h"
+#include "digest.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 enum Crc {
     CHK8_SUM = 0,
@@ -17,14 +26,17 @@ enum Crc {
     CRC8,
     CRC16,
     CRC32,
+    SHA256,
+    BLAKE3,
+    XXH3,
 };
 
-#define LAST_CHECK_METHOD CRC32
+#define LAST_CHECK_METHOD XXH3
 
 static enum Crc Cks_Type = CHK8_SUM;
-static uint32_t Cks_Start = 0;
-static uint32_t Cks_End = 0;
-static uint32_t Cks_Addr = 0;
+static uint64_t Cks_Start = 0;
+static uint64_t Cks_End = 0;
+static uint64_t Cks_Addr = 0;
 static uint32_t Cks_Value = 0;
 static bool Cks_range_set = false;
 static bool Cks_Addr_set = false;
@@ -38,10 +50,31 @@ static bool Crc_RefOut = false;
 
 static int Endian = 0;
 
-typedef void (*checksumHandler)(uint8_t *memory_block);
-struct ChecksumProcess {
-    uint8_t type;
-    checksumHandler handler;
+/* --pages: the check value of each page of Page_Size bytes, in a table written at Page_Table_Addr with --pages-at */
+static uint64_t Page_Size = 0;
+static uint64_t Page_Table_Addr = 0;
+static bool Page_Table_Set = false;
+
+#define MAX_PAGE_THREADS 8
+
+/* --verify: the value is compared with the bytes at Cks_Addr instead of written */
+static bool Verify_Mode = false;
+static bool Verify_Compared;
+static bool Verify_Matched;
+static uint8_t Verify_Stored[SHA256_SIZE];
+
+/* --watch: the value at Cks_Addr updated from the bytes that change */
+static bool Change_Enabled = false;
+static uint64_t Change_Value;
+static uint64_t Change_Length; /* of the range */
+static void *Change_Table;
+static uint32_t Change_Zeros[64][32]; /* register of each bit after 2^k zero bytes */
+static uint32_t Change_Zeros_Count;
+
+/* Size and name of the value of each check method */
+static const uint8_t Check_Size[LAST_CHECK_METHOD + 1] = { 1, 2, 2, 4, 1, 2, 4, SHA256_SIZE, BLAKE3_SIZE, 8 };
+static const char *const Check_Name[LAST_CHECK_METHOD + 1] = {
+    "checksum8", "checksum16", "checksum 16_8", "checksum32", "crc8", "crc16", "crc32", "sha256", "blake3", "xxh3",
 };
 
 void *NoFailMalloc(size_t size)
@@ -52,6 +85,22 @@ void *NoFailMalloc(size_t size)
         fprintf(fp, "Can't allocate memory.\n");
         exit(1);
     }
+    STATS_ADD(allocations, 1);
+    STATS_ADD(allocated_bytes, size);
+
+    return (result);
+}
+
+void *NoFailRealloc(void *ptr, size_t size)
+{
+    void *result;
+
+    if ((result = realloc(ptr, size)) == NULL) {
+        fprintf(fp, "Can't allocate memory.\n");
+        exit(1);
+    }
+    STATS_ADD(allocations, 1);
+    STATS_ADD(allocated_bytes, size);
 
     return (result);
 }
@@ -71,6 +120,21 @@ int GetHex(const char *str)
     }
 }
 
+uint64_t GetHex64(const char *str)
+{
+    int result;
+    uint64_t value;
+
+    result = sscanf(str, "%" SCNx64, &value);
+
+    if (result == 1) {
+        return value;
+    } else {
+        fprintf(fp, "GetHex64: some error occurred when parsing options.\n");
+        exit(1);
+    }
+}
+
 // 0 or 1
 static int GetBin(const char *str)
 {
@@ -87,201 +151,211 @@ static int GetBin(const char *str)
     }
 }
 
-static void WriteMemBlock16(uint8_t *memory_block, uint16_t Value)
+static void LogBytes(const uint8_t *bytes, int size)
 {
-    if (Endian == 1) {
-        memory_block[Cks_Addr - g_lowest_address] = u16_hi(Value);
-        memory_block[Cks_Addr - g_lowest_address + 1] = u16_lo(Value);
-    } else {
-        memory_block[Cks_Addr - g_lowest_address + 1] = u16_hi(Value);
-        memory_block[Cks_Addr - g_lowest_address] = u16_lo(Value);
-    }
-}
+    int i;
 
-static void WriteMemBlock32(uint8_t *memory_block, uint32_t Value)
-{
-    if (Endian == 1) {
-        memory_block[Cks_Addr - g_lowest_address] = u32_b3(Value);
-        memory_block[Cks_Addr - g_lowest_address + 1] = u32_b2(Value);
-        memory_block[Cks_Addr - g_lowest_address + 2] = u32_b1(Value);
-        memory_block[Cks_Addr - g_lowest_address + 3] = u32_b0(Value);
-    } else {
-        memory_block[Cks_Addr - g_lowest_address + 3] = u32_b3(Value);
-        memory_block[Cks_Addr - g_lowest_address + 2] = u32_b2(Value);
-        memory_block[Cks_Addr - g_lowest_address + 1] = u32_b1(Value);
-        memory_block[Cks_Addr - g_lowest_address] = u32_b0(Value);
+    for (i = 0; i < size; i++) {
+        fprintf(fp, "%02X", bytes[i]);
     }
 }
 
-static void Checksum8(uint8_t *memory_block)
+/* The value, in the order of the image, written at Cks_Addr or compared with the stored bytes */
+static void StoreValue(uint8_t *memory_block, const uint8_t *bytes, int size)
 {
-    uint8_t wCKS = 0;
-
-    for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-        wCKS += memory_block[i - g_lowest_address];
+    if (!Verify_Mode) {
+        memcpy(memory_block + (Cks_Addr - g_lowest_address), bytes, size);
+        return;
     }
 
-    fprintf(fp, "8-bit checksum = 0x%02X\n", wCKS & 0xff);
-    memory_block[Cks_Addr - g_lowest_address] = wCKS;
-    fprintf(fp, "checksum8 Addr 0x%08X set to 0x%02X\n", Cks_Addr, wCKS);
+    Verify_Compared = true;
+    Verify_Matched = (memcmp(Verify_Stored, bytes, size) == 0);
+    if (!Verify_Matched) {
+        fprintf(fp, "Addr 0x%08" PRIX64 " stores ", Cks_Addr);
+        LogBytes(Verify_Stored, size);
+        fprintf(fp, ", computed ");
+        LogBytes(bytes, size);
+        fprintf(fp, "\n");
+    }
 }
 
-static void Checksum16(uint8_t *memory_block)
+/* "set to" the value, or "computed" by --verify, in the messages */
+static const char *ValueAction(void)
 {
-    uint16_t wCKS = 0;
-    uint16_t w;
-
-    if (Endian == 1) {
-        for (uint32_t i = Cks_Start; i <= Cks_End; i += 2) {
-            w = memory_block[i - g_lowest_address + 1] | ((uint16_t)memory_block[i - g_lowest_address] << 8);
-            wCKS += w;
-        }
-    } else {
-        for (uint32_t i = Cks_Start; i <= Cks_End; i += 2) {
-            w = memory_block[i - g_lowest_address] | ((uint16_t)memory_block[i - g_lowest_address + 1] << 8);
-            wCKS += w;
-        }
-    }
-    fprintf(fp, "16-bit checksum = 0x%04X\n", wCKS);
-    WriteMemBlock16(memory_block, wCKS);
-    fprintf(fp, "checksum16 Addr 0x%08X set to 0x%04X\n", Cks_Addr, wCKS);
+    return Verify_Mode ? "computed" : "set to";
 }
 
-static void Checksum16_8(uint8_t *memory_block)
+/* The value in size bytes of the image: big endian with -E 1, else little endian */
+static void ValueBytes(uint8_t *bytes, uint64_t value, int size)
 {
-    uint16_t wCKS = 0;
+    int i;
 
-    for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-        wCKS += memory_block[i - g_lowest_address];
+    for (i = 0; i < size; i++) {
+        if (Endian == 1) {
+            bytes[size - 1 - i] = (uint8_t)(value >> (8 * i));
+        } else {
+            bytes[i] = (uint8_t)(value >> (8 * i));
+        }
     }
-
-    fprintf(fp, "16-bit checksum = 0x%04X\n", wCKS);
-    WriteMemBlock16(memory_block, wCKS);
-    fprintf(fp, "checksum 16_8 Addr 0x%08X set to 0x%04X\n", Cks_Addr, wCKS);
 }
 
-static void Checksum32(uint8_t *memory_block)
+static uint64_t DigestLength(void)
 {
-    uint32_t wCKS = 0;
-
-    for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-        wCKS += memory_block[i - g_lowest_address];
-    }
-
-    fprintf(fp, "32-bit checksum = 0x%08X\n", wCKS);
-    WriteMemBlock32(memory_block, wCKS);
-    fprintf(fp, "checksum 16_8 Addr 0x%08X set to 0x%04X\n", Cks_Addr, wCKS);
+    return (Cks_End >= Cks_Start) ? Cks_End - Cks_Start + 1 : 0;
 }
 
-static void Crc8(uint8_t *memory_block)
+/* The table of the CRC methods (-k 4 to 6), NULL for the others */
+static void *CrcTable(enum Crc type)
 {
-    uint8_t crc8;
-    void *crc_table;
-
-    crc_table = NoFailMalloc(256);
-    if (Crc_RefIn) {
-        init_crc8_reflected_tab(crc_table, Reflect8[Crc_Poly]);
-        crc8 = Reflect8[Crc_Init];
-    } else {
-        init_crc8_normal_tab(crc_table, Crc_Poly);
-        crc8 = Crc_Init;
-    }
+    void *crc_table = NULL;
 
-    for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-        crc8 = update_crc8(crc_table, crc8, memory_block[i - g_lowest_address]);
-    }
-
-    crc8 = (crc8 ^ Crc_XorOut) & 0xff;
-    memory_block[Cks_Addr - g_lowest_address] = crc8;
-    fprintf(fp, "crc8 Addr 0x%08X set to 0x%02X\n", Cks_Addr, crc8);
-
-    if (crc_table != NULL) {
-        free(crc_table);
+    switch (type) {
+        case CRC8:
+            crc_table = ArenaAlloc(256);
+            if (Crc_RefIn) {
+                init_crc8_reflected_tab(crc_table, Reflect8[Crc_Poly]);
+            } else {
+                init_crc8_normal_tab(crc_table, Crc_Poly);
+            }
+            break;
+        case CRC16:
+            crc_table = ArenaAlloc(256 * 2);
+            if (Crc_RefIn) {
+                init_crc16_reflected_tab(crc_table, Reflect16(Crc_Poly));
+            } else {
+                init_crc16_normal_tab(crc_table, Crc_Poly);
+            }
+            break;
+        case CRC32:
+            crc_table = ArenaAlloc(256 * 4);
+            if (Crc_RefIn) {
+                init_crc32_reflected_tab(crc_table, Reflect32(Crc_Poly));
+            } else {
+                init_crc32_normal_tab(crc_table, Crc_Poly);
+            }
+            break;
+        default:
+            break;
     }
+    return crc_table;
 }
 
-static void Crc16(uint8_t *memory_block)
+/*
+ * The check value of length bytes, in the order of the image (-E; the
+ * 32-byte digests are in the order of sha256sum and b3sum). Returns its
+ * size. Only reads the parameters: the pages are computed by several
+ * threads.
+ */
+static int CheckCompute(enum Crc type, void *crc_table, const uint8_t *data, uint64_t length, uint8_t *bytes)
 {
+    uint64_t value = 0;
+    uint64_t i;
+    uint8_t next;
+    uint8_t crc8;
     uint16_t crc16;
-    void *crc_table;
-
-    crc_table = NoFailMalloc(256 * 2);
-    if (Crc_RefIn) {
-        init_crc16_reflected_tab(crc_table, Reflect16(Crc_Poly));
-        crc16 = Reflect16(Crc_Init);
-
-        for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-            crc16 = update_crc16_reflected(crc_table, crc16, memory_block[i - g_lowest_address]);
-        }
-    } else {
-        init_crc16_normal_tab(crc_table, Crc_Poly);
-        crc16 = Crc_Init;
-
-        for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-            crc16 = update_crc16_normal(crc_table, crc16, memory_block[i - g_lowest_address]);
-        }
-    }
-
-    crc16 = (crc16 ^ Crc_XorOut) & 0xffff;
-    WriteMemBlock16(memory_block, crc16);
-    fprintf(fp, "crc16 Addr 0x%08X set to 0x%04X\n", Cks_Addr, crc16);
+    uint32_t crc32;
 
-    if (crc_table != NULL) {
-        free(crc_table);
+    switch (type) {
+        case CHK8_SUM:
+        case CHK16_8:
+        case CHK32:
+            for (i = 0; i < length; i++) {
+                value += data[i];
+            }
+            break;
+        case CHK16:
+            for (i = 0; i < length; i += 2) {
+                /* An odd length ends with a byte: 0 after it */
+                next = (i + 1 < length) ? data[i + 1] : 0;
+                if (Endian == 1) {
+                    value += next | ((uint16_t)data[i] << 8);
+                } else {
+                    value += data[i] | ((uint16_t)next << 8);
+                }
+            }
+            break;
+        case CRC8:
+            crc8 = Crc_RefIn ? Reflect8[Crc_Init] : (uint8_t)Crc_Init;
+            for (i = 0; i < length; i++) {
+                crc8 = update_crc8(crc_table, crc8, data[i]);
+            }
+            value = (crc8 ^ Crc_XorOut) & 0xff;
+            break;
+        case CRC16:
+            if (Crc_RefIn) {
+                crc16 = Reflect16(Crc_Init);
+                for (i = 0; i < length; i++) {
+                    crc16 = update_crc16_reflected(crc_table, crc16, data[i]);
+                }
+            } else {
+                crc16 = Crc_Init;
+                for (i = 0; i < length; i++) {
+                    crc16 = update_crc16_normal(crc_table, crc16, data[i]);
+                }
+            }
+            value = (crc16 ^ Crc_XorOut) & 0xffff;
+            break;
+        case CRC32:
+            if (Crc_RefIn) {
+                crc32 = Reflect32(Crc_Init);
+                for (i = 0; i < length; i++) {
+                    crc32 = update_crc32_reflected(crc_table, crc32, data[i]);
+                }
+            } else {
+                crc32 = Crc_Init;
+                for (i = 0; i < length; i++) {
+                    crc32 = update_crc32_normal(crc_table, crc32, data[i]);
+                }
+            }
+            value = crc32 ^ Crc_XorOut;
+            break;
+        case SHA256:
+            Sha256(data, length, bytes);
+            return SHA256_SIZE;
+        case BLAKE3:
+            Blake3(data, length, bytes);
+            return BLAKE3_SIZE;
+        case XXH3:
+            value = Xxh3(data, length);
+            break;
     }
+    ValueBytes(bytes, value, Check_Size[type]);
+    return Check_Size[type];
 }
 
-static void Crc32(uint8_t *memory_block)
+/* Bytes of the range in the value of type */
+static uint64_t CheckLength(uint8_t type)
 {
-    uint32_t crc32;
-    void *crc_table;
-
-    crc_table = NoFailMalloc(256 * 4);
-    if (Crc_RefIn) {
-        init_crc32_reflected_tab(crc_table, Reflect32(Crc_Poly));
-        crc32 = Reflect32(Crc_Init);
+    uint64_t length = DigestLength();
 
-        for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-            crc32 = update_crc32_reflected(crc_table, crc32, memory_block[i - g_lowest_address]);
-        }
-    } else {
-        init_crc32_normal_tab(crc_table, Crc_Poly);
-        crc32 = Crc_Init;
-
-        for (uint32_t i = Cks_Start; i <= Cks_End; i++) {
-            crc32 = update_crc32_normal(crc_table, crc32, memory_block[i - g_lowest_address]);
-        }
-    }
-
-    crc32 ^= Crc_XorOut;
-    WriteMemBlock32(memory_block, crc32);
-    fprintf(fp, "crc32 Addr 0x%08X set to 0x%08X\n", Cks_Addr, crc32);
-
-    if (crc_table != NULL) {
-        free(crc_table);
+    /* The 16-bit words of -k 1 start at Cks_Start: the last one can end after Cks_End */
+    if ((type == CHK16) && (length % 2) && (Cks_End < g_highest_address)) {
+        length++;
     }
+    return length;
 }
 
-static struct ChecksumProcess ChecksumProcessTable[] = {
-    { CHK8_SUM, Checksum8 },
-    { CHK16, Checksum16 },
-    { CHK16_8, Checksum16_8 },
-    { CHK32, Checksum32 },
-    { CRC8, Crc8 },
-    { CRC16, Crc16 },
-    { CRC32, Crc32 },
-};
-
 void ChecksumLoop(uint8_t *memory_block, uint8_t type)
 {
-    uint8_t i;
+    uint8_t bytes[SHA256_SIZE];
+    uint64_t length;
+    int size;
 
-    for (i = 0; i < sizeof(ChecksumProcessTable) / sizeof(ChecksumProcessTable[0]); i++) {
-        if (type == ChecksumProcessTable[i].type) {
-            ChecksumProcessTable[i].handler(memory_block);
-            break;
-        }
+    if (type > LAST_CHECK_METHOD) {
+        return;
+    }
+    /* The value must fit between Cks_Addr and the end of the image */
+    if (Cks_Addr + Check_Size[type] - 1 > g_highest_address) {
+        fprintf(fp, "%s Addr 0x%08" PRIX64 ": no room for %d bytes\n", Check_Name[type], Cks_Addr, Check_Size[type]);
+        return;
     }
+    length = CheckLength(type);
+
+    size = CheckCompute(type, CrcTable(type), memory_block + (Cks_Start - g_lowest_address), length, bytes);
+    StoreValue(memory_block, bytes, size);
+    fprintf(fp, "%s Addr 0x%08" PRIX64 " %s ", Check_Name[type], Cks_Addr, ValueAction());
+    LogBytes(bytes, size);
+    fprintf(fp, "\n");
 }
 
 void CrcParamsCheck(void)
@@ -305,50 +379,454 @@ void CrcParamsCheck(void)
     }
 }
 
+/* Default range of the check value: the whole image, else -r cut to the image */
+static void SetCheckRange(void)
+{
+    if (!Cks_range_set) {
+        Cks_Start = g_lowest_address;
+        Cks_End = g_highest_address;
+    }
+    /* checksum range MUST BE in the array bounds */
+
+    if (Cks_Start < g_lowest_address) {
+        fprintf(fp, "Modifying range start from %" PRIX64 " to %" PRIX64 "\n", Cks_Start, g_lowest_address);
+        Cks_Start = g_lowest_address;
+    }
+    if (Cks_End > g_highest_address) {
+        fprintf(fp, "Modifying range end from %" PRIX64 " to %" PRIX64 "\n", Cks_End, g_highest_address);
+        Cks_End = g_highest_address;
+    }
+}
+
 void WriteMemory(uint8_t *memory_block)
 {
+    uint8_t bytes[4];
+
     if ((Cks_Addr >= g_lowest_address) && (Cks_Addr < g_highest_address)) {
         if (Force_Value) {
             switch (Cks_Type) {
                 case 0:
-                    memory_block[Cks_Addr - g_lowest_address] = Cks_Value;
-                    fprintf(fp, "Addr 0x%08X set to 0x%02X\n", Cks_Addr, Cks_Value);
+                    ValueBytes(bytes, Cks_Value, 1);
+                    StoreValue(memory_block, bytes, 1);
+                    fprintf(fp, "Addr 0x%08" PRIX64 " %s 0x%02X\n", Cks_Addr, ValueAction(), Cks_Value);
                     break;
                 case 1:
-                    WriteMemBlock16(memory_block, Cks_Value);
-                    fprintf(fp, "Addr 0x%08X set to 0x%04X\n", Cks_Addr, Cks_Value);
+                    ValueBytes(bytes, Cks_Value, 2);
+                    StoreValue(memory_block, bytes, 2);
+                    fprintf(fp, "Addr 0x%08" PRIX64 " %s 0x%04X\n", Cks_Addr, ValueAction(), Cks_Value);
                     break;
                 case 2:
-                    WriteMemBlock32(memory_block, Cks_Value);
-                    fprintf(fp, "Addr 0x%08X set to 0x%08X\n", Cks_Addr, Cks_Value);
+                    ValueBytes(bytes, Cks_Value, 4);
+                    StoreValue(memory_block, bytes, 4);
+                    fprintf(fp, "Addr 0x%08" PRIX64 " %s 0x%08X\n", Cks_Addr, ValueAction(), Cks_Value);
                     break;
                 default:
                     break;
             }
         } else if (Cks_Addr_set) {
             /* Add a checksum to the binary file */
-            if (!Cks_range_set) {
-                Cks_Start = g_lowest_address;
-                Cks_End = g_highest_address;
+            SetCheckRange();
+            ChecksumLoop(memory_block, Cks_Type);
+        }
+    } else {
+        if (Force_Value || Cks_Addr_set) {
+            fprintf(fp, "Force/Check address outside of memory range\n");
+        }
+    }
+}
+
+/* Bytes of the value at Cks_Addr: -F writes 1, 2 or 4 bytes (-k 0 to 2) */
+static uint64_t ValueSize(void)
+{
+    if (Force_Value) {
+        return (Cks_Type <= CHK16_8) ? (1U << Cks_Type) : 0;
+    }
+    return Check_Size[Cks_Type];
+}
+
+/*
+ * --verify: the value of -f or -F is computed as by WriteMemory() and
+ * compared with the bytes stored at its address, the image is unchanged.
+ * A check value inside its own range was computed over the bytes it
+ * replaced, pad or data, which aren't in the file anymore: it isn't
+ * verified. Returns true when the stored value is the computed one.
+ */
+bool VerifyMemory(uint8_t *memory_block)
+{
+    uint64_t size = ValueSize();
+    uint8_t *stored;
+
+    Verify_Compared = false;
+    Verify_Matched = false;
+    if (!Force_Value && !Cks_Addr_set) {
+        fprintf(fp, "--verify needs the address of the value (-f or -F)\n");
+        return false;
+    }
+    if ((size == 0) || (Cks_Addr < g_lowest_address) || (Cks_Addr + size - 1 > g_highest_address)) {
+        fprintf(fp, "Force/Check address outside of memory range\n");
+        return false;
+    }
+
+    if (!Force_Value) {
+        SetCheckRange();
+        if ((Cks_Addr + size > Cks_Start) && (Cks_Addr < Cks_Start + CheckLength(Cks_Type))) {
+            fprintf(fp, "Check value at 0x%08" PRIX64 " inside its range 0x%08" PRIX64 "-0x%08" PRIX64
+                ": the bytes it replaced are unknown, give a range without it (-r)\n", Cks_Addr, Cks_Start, Cks_End);
+            return false;
+        }
+    }
+
+    stored = memory_block + (Cks_Addr - g_lowest_address);
+    memcpy(Verify_Stored, stored, (size_t)size);
+
+    Verify_Mode = true;
+    WriteMemory(memory_block);
+    Verify_Mode = false;
+
+    fprintf(fp, "Value at Addr 0x%08" PRIX64 " %s\n", Cks_Addr,
+        (Verify_Compared && Verify_Matched) ? "verified" : "NOT verified");
+    return Verify_Compared && Verify_Matched;
+}
+
+/*
+ * --watch: address and size of the value written by WriteMemory() (-f or
+ * -F), false without one. The bytes it replaced are put back in a patched
+ * image before the value is written again.
+ */
+bool GetCheckValueRange(uint64_t *address, uint64_t *size)
+{
+    *address = Cks_Addr;
+    *size = ValueSize();
+    return (Force_Value || Cks_Addr_set) && (*size != 0);
+}
+
+static uint32_t CrcUpdate(void *crc_table, uint32_t crc, uint8_t c)
+{
+    switch (Cks_Type) {
+        case CRC8:
+            return update_crc8(crc_table, (uint8_t)crc, c);
+        case CRC16:
+            return Crc_RefIn ? update_crc16_reflected(crc_table, (uint16_t)crc, (char)c) :
+                               update_crc16_normal(crc_table, (uint16_t)crc, (char)c);
+        default:
+            return Crc_RefIn ? update_crc32_reflected(crc_table, crc, (char)c) :
+                               update_crc32_normal(crc_table, crc, (char)c);
+    }
+}
+
+/* The register times the matrix of the registers of each bit */
+static uint32_t CrcTimes(const uint32_t *matrix, uint32_t crc)
+{
+    uint32_t result = 0;
+    int i;
+
+    for (i = 0; crc != 0; i++, crc >>= 1) {
+        if (crc & 1) {
+            result ^= matrix[i];
+        }
+    }
+    return result;
+}
+
+/*
+ * The register after count zero bytes. Without its initial and final
+ * values, a CRC is linear: the register of each bit after 2^k zero bytes
+ * is computed once, and count is done by the powers of 2 in it.
+ */
+static uint32_t CrcZeros(uint32_t crc, uint64_t count)
+{
+    int width = 8 * Check_Size[Cks_Type];
+    uint32_t k;
+    int i;
+
+    for (k = 0; count != 0; k++, count >>= 1) {
+        if (k == Change_Zeros_Count) {
+            for (i = 0; i < width; i++) {
+                Change_Zeros[k][i] = (k == 0) ? CrcUpdate(Change_Table, 1U << i, 0) :
+                                                CrcTimes(Change_Zeros[k - 1], Change_Zeros[k - 1][i]);
             }
-            /* checksum range MUST BE in the array bounds */
+            Change_Zeros_Count++;
+        }
+        if (count & 1) {
+            crc = CrcTimes(Change_Zeros[k], crc);
+        }
+    }
+    return crc;
+}
+
+/*
+ * --watch: true when the value at Cks_Addr, written by the conversion of
+ * the image, can be updated from the bytes that change instead of being
+ * computed again: the sums and the CRCs, outside their range. The value
+ * is read now, before the bytes change.
+ */
+bool ChecksumChangeBegin(const uint8_t *memory_block)
+{
+    const uint8_t *stored;
+    int size;
+    int i;
+
+    Change_Enabled = false;
+    if (!Cks_Addr_set || Force_Value || (Cks_Type > CRC32) || (Cks_Addr < g_lowest_address) ||
+        (Cks_Addr >= g_highest_address)) {
+        return false;
+    }
+    size = Check_Size[Cks_Type];
+    if (Cks_Addr + size - 1 > g_highest_address) {
+        return false;
+    }
+    SetCheckRange();
+    Change_Length = CheckLength(Cks_Type);
+    if ((Cks_Addr + size - 1 >= Cks_Start) && (Cks_Addr < Cks_Start + Change_Length)) {
+        return false;
+    }
 
-            if (Cks_Start < g_lowest_address) {
-                fprintf(fp, "Modifying range start from %X to %X\n", Cks_Start, g_lowest_address);
-                Cks_Start = g_lowest_address;
+    stored = memory_block + (Cks_Addr - g_lowest_address);
+    Change_Value = 0;
+    for (i = 0; i < size; i++) {
+        Change_Value |= (uint64_t)stored[(Endian == 1) ? size - 1 - i : i] << (8 * i);
+    }
+    Change_Table = CrcTable(Cks_Type);
+    Change_Zeros_Count = 0;
+    Change_Enabled = true;
+    return true;
+}
+
+/*
+ * The length bytes at address change from previous to data: the sums get
+ * the differences, a CRC the CRC of the changed bits followed by the zero
+ * bytes up to the end of the range.
+ */
+void ChecksumChange(uint64_t address, const uint8_t *previous, const uint8_t *data, uint64_t length)
+{
+    uint64_t first = (address > Cks_Start) ? address : Cks_Start;
+    uint64_t end = address + length;
+    uint64_t offset;
+    uint64_t weight;
+    uint64_t i;
+    uint32_t crc = 0;
+
+    if (!Change_Enabled) {
+        return;
+    }
+    if (end > Cks_Start + Change_Length) {
+        end = Cks_Start + Change_Length;
+    }
+    if (first >= end) {
+        return;
+    }
+    previous += first - address;
+    data += first - address;
+    offset = first - Cks_Start;
+    length = end - first;
+
+    switch (Cks_Type) {
+        case CHK16:
+            for (i = 0; i < length; i++) {
+                /* The first byte of a word is the low one, the high one with -E 1 */
+                weight = ((((offset + i) % 2) == 0) == (Endian == 1)) ? 0x100 : 1;
+                Change_Value += data[i] * weight - previous[i] * weight;
+            }
+            break;
+        case CRC8:
+        case CRC16:
+        case CRC32:
+            for (i = 0; i < length; i++) {
+                crc = CrcUpdate(Change_Table, crc, previous[i] ^ data[i]);
             }
-            if (Cks_End > g_highest_address) {
-                fprintf(fp, "Modifying range end from %X to %X\n", Cks_End, g_highest_address);
-                Cks_End = g_highest_address;
+            Change_Value ^= CrcZeros(crc, Change_Length - offset - length);
+            break;
+        default:
+            for (i = 0; i < length; i++) {
+                Change_Value += (uint64_t)data[i] - previous[i];
             }
+            break;
+    }
+}
 
-            ChecksumLoop(memory_block, Cks_Type);
+/* The value updated by the changes, written at Cks_Addr */
+void ChecksumChangeEnd(uint8_t *memory_block)
+{
+    uint8_t bytes[4] = { 0 };
+    int size = Check_Size[Cks_Type];
+
+    ValueBytes(bytes, Change_Value, size);
+    StoreValue(memory_block, bytes, size);
+    fprintf(fp, "%s Addr 0x%08" PRIX64 " %s ", Check_Name[Cks_Type], Cks_Addr, ValueAction());
+    LogBytes(bytes, size);
+    fprintf(fp, " (updated)\n");
+    Change_Enabled = false;
+}
+
+void PagesSetSize(uint64_t size)
+{
+    Page_Size = size;
+}
+
+void PagesSetTable(uint64_t address)
+{
+    Page_Table_Addr = address;
+    Page_Table_Set = true;
+}
+
+bool PagesEnabled(void)
+{
+    return Page_Size != 0;
+}
+
+bool PagesTableSet(void)
+{
+    return Page_Table_Set;
+}
+
+struct PageJob {
+    const uint8_t *image;
+    uint64_t length;
+    void *crc_table;
+    uint8_t *table;
+    uint64_t first; /* the pages first, first + step... */
+    uint64_t step;
+    uint64_t count;
+};
+
+static void *PageThread(void *arg)
+{
+    struct PageJob *job = (struct PageJob *)arg;
+    uint64_t offset;
+    uint64_t size;
+
+    for (uint64_t page = job->first; page < job->count; page += job->step) {
+        offset = page * Page_Size;
+        size = (job->length - offset < Page_Size) ? job->length - offset : Page_Size;
+        CheckCompute(Cks_Type, job->crc_table, job->image + offset, size, job->table + page * Check_Size[Cks_Type]);
+    }
+    return NULL;
+}
+
+static void NoFailWritePages(FILE *out, const void *data, size_t length, const char *name)
+{
+    if (fwrite(data, 1, length, out) != length) {
+        fprintf(fp, "Page file %s cannot be written.\n", name);
+        exit(1);
+    }
+}
+
+/*
+ * --pages: the check value of -k (with -C and -E) over each page of the
+ * image, from its lowest address; the last page ends with the image. The
+ * values are written one after the other in file.pages, and with their
+ * address and length in file.pages.txt. With --pages-at, the table is also
+ * written in the image. Called before WriteMemory(): the pages holding the
+ * check value or the table are computed over the bytes they replace.
+ */
+void PagesWrite(const char *file_name, uint8_t *memory_block)
+{
+    char name[MAX_FILE_NAME_SIZE];
+    int size = Check_Size[Cks_Type];
+    uint64_t length = g_highest_address - g_lowest_address + 1;
+    uint64_t count = (length + Page_Size - 1) / Page_Size;
+    uint8_t *table = (uint8_t *)NoFailMalloc((size_t)(count * size));
+    void *crc_table = CrcTable(Cks_Type);
+    struct PageJob jobs[MAX_PAGE_THREADS];
+    long nb_threads = 1;
+    long i;
+    FILE *out;
+
+#if !defined(_WIN32)
+    pthread_t threads[MAX_PAGE_THREADS];
+    bool started[MAX_PAGE_THREADS];
+
+    nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_threads < 1) {
+        nb_threads = 1;
+    } else if (nb_threads > MAX_PAGE_THREADS) {
+        nb_threads = MAX_PAGE_THREADS;
+    }
+    if ((uint64_t)nb_threads > count) {
+        nb_threads = (long)count;
+    }
+#endif
+
+    for (i = 0; i < nb_threads; i++) {
+        jobs[i].image = memory_block;
+        jobs[i].length = length;
+        jobs[i].crc_table = crc_table;
+        jobs[i].table = table;
+        jobs[i].first = i;
+        jobs[i].step = nb_threads;
+        jobs[i].count = count;
+    }
+
+#if !defined(_WIN32)
+    /* If a thread can't be started, this one does its pages */
+    for (i = 1; i < nb_threads; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, PageThread, &jobs[i]) == 0);
+    }
+    PageThread(&jobs[0]);
+    for (i = 1; i < nb_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            PageThread(&jobs[i]);
         }
-    } else {
-        if (Force_Value || Cks_Addr_set) {
-            fprintf(fp, "Force/Check address outside of memory range\n");
+    }
+#else
+    PageThread(&jobs[0]);
+#endif
+    fprintf(fp, "Pages: %" PRIu64 " pages of %" PRIu64 " bytes, %s of %d bytes each\n", count, Page_Size,
+        Check_Name[Cks_Type], size);
+
+    if (Page_Table_Set) {
+        if ((Page_Table_Addr < g_lowest_address) || (Page_Table_Addr + count * size - 1 > g_highest_address)) {
+            fprintf(fp, "Page table Addr 0x%08" PRIX64 ": no room for %" PRIu64 " bytes\n", Page_Table_Addr,
+                count * size);
+            exit(1);
+        }
+        memcpy(memory_block + (Page_Table_Addr - g_lowest_address), table, (size_t)(count * size));
+        fprintf(fp, "Page table Addr 0x%08" PRIX64 " set to %" PRIu64 " bytes\n", Page_Table_Addr, count * size);
+    }
+
+    /* The files are named after the binary file */
+    if (GetOutputStdout()) {
+        fprintf(fp, "Page table and manifest not written: the binary file is written to stdout\n");
+        free(table);
+        return;
+    }
+    GetFilename(name, (char *)file_name);
+    PutExtension(name, "pages");
+    out = fopen(name, "wb");
+    if (out == NULL) {
+        fprintf(fp, "Page file %s cannot be opened.\n", name);
+        exit(1);
+    }
+    NoFailWritePages(out, table, (size_t)(count * size), name);
+    if (fclose(out) != 0) {
+        fprintf(fp, "Page file %s cannot be written.\n", name);
+        exit(1);
+    }
+
+    PutExtension(name, "pages.txt");
+    out = fopen(name, "w");
+    if (out == NULL) {
+        fprintf(fp, "Page file %s cannot be opened.\n", name);
+        exit(1);
+    }
+    fprintf(out, "# %s of %" PRIu64 "-byte pages: address length value\n", Check_Name[Cks_Type], Page_Size);
+    for (uint64_t page = 0; page < count; page++) {
+        uint64_t offset = page * Page_Size;
+
+        fprintf(out, "0x%08" PRIX64 " %" PRIu64 " ", g_lowest_address + offset,
+            (length - offset < Page_Size) ? length - offset : Page_Size);
+        for (i = 0; i < size; i++) {
+            fprintf(out, "%02X", table[page * size + i]);
         }
+        fprintf(out, "\n");
+    }
+    if (fclose(out) != 0) {
+        fprintf(fp, "Page file %s cannot be written.\n", name);
+        exit(1);
     }
+    free(table);
 }
 
 void Para_E(const char *str)
@@ -358,13 +836,13 @@ void Para_E(const char *str)
 
 void Para_f(const char *str)
 {
-    Cks_Addr = GetHex(str);
+    Cks_Addr = GetHex64(str);
     Cks_Addr_set = true;
 }
 
 void Para_F(const char *str1, const char *str2)
 {
-    Cks_Addr = GetHex(str1);
+    Cks_Addr = GetHex64(str1);
     Cks_Value = GetHex(str2);
     Force_Value = true;
 }
@@ -379,8 +857,8 @@ void Para_k(const char *str)
 
 void Para_r(const char *str1, const char *str2)
 {
-    Cks_Start = GetHex(str1);
-    Cks_End = GetHex(str2);
+    Cks_Start = GetHex64(str1);
+    Cks_End = GetHex64(str2);
     Cks_range_set = true;
 }
 
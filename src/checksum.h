@@ -2,15 +2,30 @@
 #define CHECKSUM_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 //extern uint8_t *memory_block;
 
 extern void *NoFailMalloc(size_t size);
+extern void *NoFailRealloc(void *ptr, size_t size);
 extern int GetHex(const char *str);
+extern uint64_t GetHex64(const char *str);
 
 extern void ChecksumLoop(uint8_t type);
 extern void CrcParamsCheck(void);
 extern void WriteMemory(uint8_t *memory_block);
+extern bool VerifyMemory(uint8_t *memory_block);
+extern bool GetCheckValueRange(uint64_t *address, uint64_t *size);
+extern bool ChecksumChangeBegin(const uint8_t *memory_block);
+extern void ChecksumChange(uint64_t address, const uint8_t *previous, const uint8_t *data, uint64_t length);
+extern void ChecksumChangeEnd(uint8_t *memory_block);
+
+/* --pages=size, --pages-at=address: the check value of each page of the image */
+extern void PagesSetSize(uint64_t size);
+extern void PagesSetTable(uint64_t address);
+extern bool PagesEnabled(void);
+extern bool PagesTableSet(void);
+extern void PagesWrite(const char *file_name, uint8_t *memory_block);
 
 extern void Para_E(const char *str);
 extern void Para_f(const char *str);
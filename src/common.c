@@ -25,9 +25,15 @@
   20170304 JP: added the 16-bit checksum 8-bit wide
 */
 
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include "common.h"
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,12 +42,39 @@
 #include "binary.h"
 #include "libcrc.h"
 #include "checksum.h"
+#include "stats.h"
+#include "aio.h"
+#include "arena.h"
+#include "scanner.h"
+#include "delta.h"
+#include "extract.h"
+#include "compress.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 /* We use buffer to speed disk access. */
 #ifdef USE_FILE_BUFFERS
 #define BUFFSZ 4096
 #endif
 
+/* Size of the block of pad bytes written after the image */
+#define PAD_CHUNK_SIZE (64 * 1024)
+
+/* Output file patched in place: the blocks compared and written */
+#define PATCH_BLOCK_SIZE 0x1000
+
 /* option character */
 #if defined(MSDOS) || defined(__DOS__) || defined(__MSDOS__) || defined(_MSDOS)
 #define _IS_OPTION_(x) (((x) == '-') || ((x) == '/'))
@@ -56,6 +89,29 @@
 static FILE *file_in;  /* input files */
 static FILE *file_out; /* output files */
 
+/* "-" as file name: stdin and stdout */
+#define STANDARD_STREAM_NAME "-"
+static bool input_stdin = false;
+
+#if !defined(_WIN32)
+/* Process decompressing the input file into file_in, 0 without */
+static pid_t decompressor = 0;
+static const char *decompressor_program;
+static char decompressed_name[MAX_FILE_NAME_SIZE];
+
+/* Thread inflating a gzip input file into file_in */
+#define INFLATE_BLOCK_SIZE (64 * 1024)
+static pthread_t inflater;
+static bool inflater_started = false;
+static FILE *inflate_in;
+static int inflate_out;
+static const char *inflate_error;
+#endif
+static bool output_stdout = false;
+
+/* Name of the output file opened last, for the cache of the daemon */
+static char output_file_name[MAX_FILE_NAME_SIZE];
+
 #ifdef USE_FILE_BUFFERS
 char *FilinBuf;  /* text buffer for file input */
 char *FiloutBuf; /* text buffer for file output */
@@ -63,19 +119,99 @@ char *FiloutBuf; /* text buffer for file output */
 
 static int pad_byte = 0xFF;
 
-static uint32_t starting_address;
-static uint32_t max_length = 0;
-static uint32_t minimum_block_size = 0x1000; // 4096 byte
-static uint32_t floor_address = 0x00;
-static uint32_t ceiling_address = 0xFFFFFFFF;
+static uint64_t starting_address;
+static uint64_t max_length = 0;
+static uint64_t minimum_block_size = 0x1000; // 4096 byte
+static uint64_t floor_address = 0x00;
+static uint64_t ceiling_address = 0xFFFFFFFF;
 static bool minimum_block_size_setted = false;
 static bool starting_address_setted = false;
 static bool floor_address_setted = false;
 static bool ceiling_address_setted = false;
 static bool max_length_setted = false;
-static bool swap_wordwise = false;
+static uint32_t swap_width = 0; /* -w and --swap: bytes of the swapped words, 0 without swap */
 static bool address_alignment_word = false;
 static bool batch_mode = false;
+static bool verify_only = false; /* --verify: the check value is compared, no file is written */
+
+/* --watch: the options parsed by the watching process, the output file patched in place */
+static int options_first_file = 0;
+static bool output_patched = false;
+static bool output_patching = false; /* the output file is open for reading and writing */
+static uint64_t written_address;
+static uint64_t written_length;
+static bool image_written = false;
+
+/* --mmap: the output file is mapped and used as the image */
+static bool output_mapped = false;
+static uint8_t *output_map = NULL;
+static uint64_t output_map_length;
+
+/* Below this size one memset() is faster than starting threads */
+#define PARALLEL_FILL_SIZE 0x1000000
+#define MAX_FILL_THREADS 8
+
+/* Memory regions, each one written to its own output file (-R option) */
+#define MAX_REGIONS 16
+#define MAX_REGION_NAME_SIZE 32
+
+struct Region {
+    char name[MAX_REGION_NAME_SIZE];
+    uint64_t floor;
+    uint64_t ceiling;
+    int pad_byte;
+    uint64_t minimum_block_size;
+    uint8_t *memory_block; /* grows with the records falling in the region */
+    uint64_t allocated;
+    uint64_t length;       /* highest offset written + 1 */
+};
+
+static struct Region regions[MAX_REGIONS];
+static uint32_t region_count = 0;
+static struct Region *current_region = NULL;
+
+/*
+ * Single pass: the image grows with the records, at both ends, and is cut
+ * to the lowest and highest addresses at the end (ImageEnd).
+ */
+static bool image_growing = false;
+static uint8_t *image_block = NULL;
+static uint64_t image_base;      /* address of image_block[0] */
+static uint64_t image_allocated;
+static uint64_t image_lowest;    /* lowest and highest addresses written */
+static uint64_t image_highest;
+static uint64_t image_record_count; /* capacity hint */
+static uint64_t image_max_size;
+
+/*
+ * Overlapped bytes of each record: they are reported at the end, when the
+ * bounds of the image are known, as with two passes only in the image.
+ */
+struct ImageOverlap {
+    uint64_t first;
+    uint64_t last;
+    uint64_t count;
+};
+static struct ImageOverlap *image_overlaps = NULL;
+static uint32_t image_overlap_count;
+static uint32_t image_overlap_allocated;
+static bool image_overlap_record = false; /* the current record has overlaps */
+
+/*
+ * Several input files in the image: the addresses written by each file,
+ * to report the conflicts between files at the end.
+ */
+struct ImageExtent {
+    uint64_t first;
+    uint64_t last;
+    uint32_t file;
+};
+static struct ImageExtent *image_extents = NULL;
+static uint64_t image_extent_count = 0;
+static uint64_t image_extent_allocated = 0;
+static char **image_file_names = NULL;
+static uint32_t image_file_count = 0; /* 0 or 1: no conflict to report */
+static uint32_t image_file = 0;       /* file being decoded */
 
 static bool enable_checksum_error = false;
 static bool status_checksum_error = false;
@@ -83,9 +219,9 @@ static bool status_checksum_error = false;
 bool verbose_flag = false;
 
 /* This will hold binary codes translated from hex file. */
-uint32_t g_lowest_address;
-uint32_t g_highest_address;
-uint32_t g_phys_addr;
+uint64_t g_lowest_address;
+uint64_t g_highest_address;
+uint64_t g_phys_addr;
 FILE *fp = NULL;
 
 /* procedure USAGE */
@@ -93,7 +229,9 @@ void usage(const char *func, uint32_t line)
 {
     fprintf(fp,
         "\n"
-        "usage: %s [OPTIONS] filename\n"
+        "usage: %s [OPTIONS] filename...\n"
+        "       filename - reads stdin and writes the binary file to stdout\n"
+        "       several files are merged into one binary file named after the first one\n"
         "func: %s\n"
         "line: %d\n"
         "Options:\n"
@@ -105,7 +243,7 @@ void usage(const char *func, uint32_t line)
         "  -E [0|1]      Endian for checksum/CRC, 0: little, 1: big\n"
         "  -f [address]  address of check result to write\n"
         "  -F [address] [value]\n                address and value to force\n"
-        "  -k [0-6]      Select check method (checksum or CRC) and size\n"
+        "  -k [0-9]      Select check method (checksum, CRC or digest) and size\n"
         "  -d            display list of check methods/value size\n"
         "  -l [length]   Maximal Length (Starting address + Length -1 is Max address)\n"
         "                File will be filled with Pattern until Max address is reached\n"
@@ -117,6 +255,9 @@ void usage(const char *func, uint32_t line)
         "  -p [value]    Pad-byte value in hex (default: %x)\n"
         "  -r [start] [end]\n"
         "                Range to compute checksum over (default is min and max addresses)\n"
+        "  -R [name] [floor] [ceiling] [pad] [size]\n"
+        "                Region written to file_name.bin, may be repeated\n"
+        "                size is the Minimum Block Size of the region (0: none)\n"
         "  -s [address]  Starting address in hex for binary file (default: 0)\n"
         "                ex.: if the first record is :nn010000ddddd...\n"
         "                the data supposed to be stored at 0100 will start at 0000\n"
@@ -124,10 +265,40 @@ void usage(const char *func, uint32_t line)
         "                Specifying this starting address will put pad bytes in the\n"
         "                binary file so that the data supposed to be stored at 0100\n"
         "                will start at the same address in the binary file.\n"
-        "  -t [address]  Floor address in hex (hex2bin only)\n"
-        "  -T [address]  Ceiling address in hex (hex2bin only)\n"
+        "  -t [address]  Floor address in hex (hex2bin and elf2bin)\n"
+        "  -T [address]  Ceiling address in hex (hex2bin and elf2bin)\n"
         "  -v            Verbose messages for debugging purposes\n"
-        "  -w            Swap wordwise (low <-> high)\n\n",
+        "  -w            Swap wordwise (low <-> high)\n"
+        "  --delta=[base]\n"
+        "                Also write the changed blocks against the base image (.bin,\n"
+        "                or records) in a .delta file\n"
+        "  --compress=gzip|zstd\n"
+        "                Compress the binary file into file.bin.gz or file.bin.zst\n"
+        "  --extract=[address],[length]\n"
+        "                Only the bytes of the range, from the records that cover it,\n"
+        "                found with the index file.idx made at the first use\n"
+        "  --pages=[size]\n"
+        "                Check value of -k for each page of size bytes (hex, or K, M) in\n"
+        "                file.pages and file.pages.txt\n"
+        "  --pages-at=[address]\n"
+        "                Also write the table of the page values in the image at address\n"
+        "  --max-memory=[size]\n"
+        "                Buffers beyond size bytes (or K, M, G) are in temporary files\n"
+        "  --verify      Compare the value of -f or -F with the stored bytes, write nothing;\n"
+        "                a .bin input file is checked as it is\n"
+        "  --io=uring|thread|stdio\n"
+        "                Read ahead with io_uring (default) or a thread, or use stdio\n"
+        "  --mmap        Map the output file and decode the records into it\n"
+        "  --swap=16|32|64\n"
+        "                Reverse the bytes of each 16, 32 or 64-bit word (-w is 16)\n"
+        "  --stats[=json]\n"
+        "                Time, records and memory of each phase on stdout\n"
+        "  --daemon=[socket]\n"
+        "                First argument: convert the files of the clients of the socket\n"
+        "  --connect=[socket]\n"
+        "                First argument: convert with the daemon of the socket\n"
+        "  --watch       First argument: convert again on each change of the files (Linux),\n"
+        "                patching the binary file\n\n",
         program_name, func, line, pad_byte);
     exit(1);
 }
@@ -137,16 +308,225 @@ static void DisplayCheckMethods(void)
     fprintf(fp, "Check methods/value size:\n"
         "0:  checksum  8-bit\n"
         "1:  checksum 16-bit (adds 16-bit words into a 16-bit sum, data and result BE or LE)\n"
-        "2:  CRC8\n"
-        "3:  CRC16\n"
-        "4:  CRC32\n"
-        "5:  checksum 16-bit (adds bytes into a 16-bit sum, result BE or LE)\n");
+        "2:  checksum 16-bit (adds bytes into a 16-bit sum, result BE or LE)\n"
+        "3:  checksum 32-bit (adds bytes into a 32-bit sum, result BE or LE)\n"
+        "4:  CRC8\n"
+        "5:  CRC16\n"
+        "6:  CRC32\n"
+        "7:  SHA-256, 32 bytes\n"
+        "8:  BLAKE3, 32 bytes\n"
+        "9:  XXH3, 64-bit (result BE or LE)\n");
     exit(1);
 }
 
+#if !defined(_WIN32)
+/* Decompressor of a compressed file, from its magic bytes; NULL for a file of records */
+static const char *CompressedInput(FILE *in)
+{
+    uint8_t magic[6];
+    size_t length = fread(magic, 1, sizeof(magic), in);
+
+    rewind(in);
+    if ((length >= 2) && (magic[0] == 0x1F) && (magic[1] == 0x8B)) {
+        return "gzip";
+    }
+    if ((length >= 4) && (memcmp(magic, "\x28\xB5\x2F\xFD", 4) == 0)) {
+        return "zstd";
+    }
+    if ((length >= 6) && (memcmp(magic, "\xFD" "7zXZ", 6) == 0)) {
+        return "xz";
+    }
+    return NULL;
+}
+
+/* Writes all the bytes to the pipe; false when the reader has closed it */
+static bool InflateWrite(const uint8_t *data, size_t length)
+{
+    ssize_t nb;
+
+    while (length != 0) {
+        nb = write(inflate_out, data, length);
+        if (nb < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += nb;
+        length -= (size_t)nb;
+    }
+    return true;
+}
+
+/*
+ * Inflates the gzip members of inflate_in one after the other, as gzip -d
+ * does, into the pipe of file_in. SIGPIPE is blocked here: when the
+ * records don't need the rest of the file, the write fails and the thread
+ * ends.
+ */
+static void *InflateThread(void *arg)
+{
+    static uint8_t in[INFLATE_BLOCK_SIZE];
+    static uint8_t out[INFLATE_BLOCK_SIZE];
+    z_stream stream;
+    sigset_t pipe_signal;
+    bool member_end = false;
+    bool closed = false;
+    int result = Z_OK;
+
+    (void)arg;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        inflate_error = "zlib can't be initialized";
+        close(inflate_out);
+        return NULL;
+    }
+
+    for (;;) {
+        if (stream.avail_in == 0) {
+            stream.avail_in = (uInt)fread(in, 1, sizeof(in), inflate_in);
+            stream.next_in = in;
+            if (stream.avail_in == 0) {
+                break;
+            }
+        }
+        /* Another member after the end of one */
+        if (member_end) {
+            inflateReset(&stream);
+            member_end = false;
+        }
+
+        stream.next_out = out;
+        stream.avail_out = sizeof(out);
+        result = inflate(&stream, Z_NO_FLUSH);
+        if ((result != Z_OK) && (result != Z_STREAM_END) && (result != Z_BUF_ERROR)) {
+            inflate_error = (stream.msg != NULL) ? stream.msg : "corrupted data";
+            break;
+        }
+        if (!InflateWrite(out, sizeof(out) - stream.avail_out)) {
+            closed = true;
+            break;
+        }
+        member_end = (result == Z_STREAM_END);
+    }
+
+    if ((inflate_error == NULL) && !closed) {
+        if (ferror(inflate_in)) {
+            inflate_error = "read error";
+        } else if (!member_end) {
+            inflate_error = "unexpected end of file";
+        }
+    }
+
+    inflateEnd(&stream);
+    close(inflate_out);
+    return NULL;
+}
+
+/*
+ * A gzip file is inflated with zlib by a thread, a zstd or xz file is
+ * decompressed by zstd or xz in its own process, while the records are
+ * decoded from the pipe. The pipe can't be rewound: the file is read
+ * once, as stdin.
+ */
+static FILE *OpenDecompressor(FILE *in, const char *program, const char *file_name)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        fprintf(fp, "Input file %s: no pipe for %s.\n", file_name, program);
+        exit(1);
+    }
+    strncpy(decompressed_name, file_name, sizeof(decompressed_name) - 1);
+    decompressed_name[sizeof(decompressed_name) - 1] = '\0';
+
+    if (strcmp(program, "gzip") == 0) {
+        inflate_in = in;
+        inflate_out = fds[1];
+        inflate_error = NULL;
+        if (pthread_create(&inflater, NULL, InflateThread, NULL) != 0) {
+            fprintf(fp, "Input file %s: no thread to inflate it.\n", file_name);
+            exit(1);
+        }
+        inflater_started = true;
+        fprintf(fp, "Input file %s: inflated with zlib\n", file_name);
+        return fdopen(fds[0], "r");
+    }
+
+    fflush(fp);
+    decompressor = fork();
+    if (decompressor < 0) {
+        fprintf(fp, "Input file %s: %s can't be started.\n", file_name, program);
+        exit(1);
+    }
+    if (decompressor == 0) {
+        /* The stream of in has read ahead: the decompressor reads the file from the start */
+        lseek(fileno(in), 0, SEEK_SET);
+        dup2(fileno(in), STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp(program, program, "-dc", (char *)NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    fclose(in);
+    decompressor_program = program;
+    fprintf(fp, "Input file %s: decompressed by %s\n", file_name, program);
+    return fdopen(fds[0], "r");
+}
+
+/* End of a decompressed input, file_in closed: the decompressor must have succeeded */
+static void CloseDecompressor(void)
+{
+    int status;
+
+    if (inflater_started) {
+        pthread_join(inflater, NULL);
+        inflater_started = false;
+        fclose(inflate_in);
+        if (inflate_error != NULL) {
+            fprintf(fp, "Input file %s: gzip data can't be inflated (%s).\n", decompressed_name, inflate_error);
+            exit(1);
+        }
+        return;
+    }
+
+    while (waitpid(decompressor, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = 0;
+            break;
+        }
+    }
+    decompressor = 0;
+
+    if (WIFEXITED(status) && (WEXITSTATUS(status) == 127)) {
+        fprintf(fp, "Input file %s: %s can't be run, it decompresses this file.\n", decompressed_name,
+            decompressor_program);
+        exit(1);
+    }
+    /* SIGPIPE: the rest of the file wasn't needed */
+    if ((WIFEXITED(status) && (WEXITSTATUS(status) != 0)) || (WIFSIGNALED(status) && (WTERMSIG(status) != SIGPIPE))) {
+        fprintf(fp, "Input file %s: %s -dc failed.\n", decompressed_name, decompressor_program);
+        exit(1);
+    }
+}
+#endif
+
 /* Open the input file, with error checking */
 bool NoFailOpenInputFile(char *file_name)
 {
+    if (strcmp(file_name, STANDARD_STREAM_NAME) == 0) {
+        file_in = stdin;
+        input_stdin = true;
+        return true;
+    }
+
     file_in = fopen(file_name, "r");
     if (file_in == NULL) {
         if (batch_mode) {
@@ -161,8 +541,18 @@ bool NoFailOpenInputFile(char *file_name)
         return false;
     }
 
+#if !defined(_WIN32)
+    {
+        const char *program = CompressedInput(file_in);
+
+        if (program != NULL) {
+            file_in = OpenDecompressor(file_in, program, file_name);
+        }
+    }
+#endif
+
 #ifdef USE_FILE_BUFFERS
-    FilinBuf = (char *)NoFailMalloc(BUFFSZ);
+    FilinBuf = (char *)ArenaAlloc(BUFFSZ);
     setvbuf(file_in, FilinBuf, _IOFBF, BUFFSZ);
 #endif
 
@@ -171,13 +561,55 @@ bool NoFailOpenInputFile(char *file_name)
 
 void NoFailCloseInputFile(char *file_name)
 {
-    fclose(file_in);
+    if ((file_in != NULL) && (file_in != stdin)) {
+        fclose(file_in);
+    }
+    file_in = NULL;
+#if !defined(_WIN32)
+    if ((decompressor > 0) || inflater_started) {
+        CloseDecompressor();
+    }
+#endif
 }
 
 /* Open the output file, with error checking */
 void NoFailOpenOutputFile(char *file_name)
 {
-    while ((file_out = fopen(file_name, "wb")) == NULL) {
+    char compressed_name[MAX_FILE_NAME_SIZE];
+
+    /* --verify: nothing is written */
+    if (verify_only) {
+        return;
+    }
+
+    if (strcmp(file_name, STANDARD_STREAM_NAME) == 0) {
+        file_out = stdout;
+        output_stdout = true;
+#if defined(_WIN32)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        return;
+    }
+
+    /* --compress: file.bin.gz or file.bin.zst */
+    if (CompressEnabled()) {
+        if (snprintf(compressed_name, sizeof(compressed_name), "%s.%s", file_name, CompressExtension()) >=
+            (int)sizeof(compressed_name)) {
+            fprintf(fp, "filename length exceeds %d characters.\n", MAX_FILE_NAME_SIZE);
+            exit(1);
+        }
+        file_name = compressed_name;
+    }
+
+    /* --watch: the binary file of the previous conversion is compared with the image, not truncated */
+    output_patching = false;
+    if (output_patched && (region_count == 0) && !CompressEnabled()) {
+        file_out = fopen(file_name, "rb+");
+        output_patching = (file_out != NULL);
+    }
+
+    /* A shared mapping needs the file open for reading too */
+    while (!output_patching && (file_out = fopen(file_name, output_mapped ? "wb+" : "wb")) == NULL) {
         if (batch_mode) {
             fprintf(fp, "Output file %s cannot be opened.\n", file_name);
             exit(1);
@@ -191,25 +623,45 @@ void NoFailOpenOutputFile(char *file_name)
         }
     }
 
+    snprintf(output_file_name, sizeof(output_file_name), "%s", file_name);
+
 #ifdef USE_FILE_BUFFERS
-    FiloutBuf = (char *)NoFailMalloc(BUFFSZ);
+    FiloutBuf = (char *)ArenaAlloc(BUFFSZ);
     setvbuf(file_out, FiloutBuf, _IOFBF, BUFFSZ);
 #endif
 } /* procedure OPENFILOUT */
 
 void NoFailCloseOutputFile(char *file_name)
 {
-    //fclose(fileOut);
+    if ((file_out != NULL) && !output_stdout) {
+        fclose(file_out);
+    }
+    file_out = NULL;
 }
 
-void GetLine(char *str, FILE *in)
+/* Reads digits hex digits at str; false if one of them isn't a hex digit */
+bool GetHexDigits(const char *str, uint32_t digits, uint32_t *value)
 {
-    char *result;
-
-    result = fgets(str, MAX_LINE_SIZE, in);
-    if ((result == NULL) && !feof(in)) {
-        fprintf(fp, "Error occurred while reading from file\n");
+    uint32_t result = 0;
+    uint32_t digit;
+    char c;
+
+    while (digits-- != 0) {
+        c = *str++;
+        if ((c >= '0') && (c <= '9')) {
+            digit = c - '0';
+        } else if ((c >= 'A') && (c <= 'F')) {
+            digit = c - 'A' + 10;
+        } else if ((c >= 'a') && (c <= 'f')) {
+            digit = c - 'a' + 10;
+        } else {
+            return false;
+        }
+        result = (result << 4) | digit;
     }
+
+    *value = result;
+    return true;
 }
 
 #if 0
@@ -253,10 +705,20 @@ void PutExtension(char *file_name, char *extension)
 {
     char *period; /* location of period in file name */
 
+    /* stdin is converted to stdout */
+    if (strcmp(file_name, STANDARD_STREAM_NAME) == 0) {
+        return;
+    }
+
     /* This assumes DOS like file names */
     /* Don't use strchr(): consider the following filename:
      ../my.dir/file.hex
     */
+    /* The extension of a compressed file is removed first: file.hex.gz gives file.bin */
+    if (((period = strrchr(file_name, '.')) != NULL) &&
+        ((strcmp(period, ".gz") == 0) || (strcmp(period, ".zst") == 0) || (strcmp(period, ".xz") == 0))) {
+        *period = '\0';
+    }
     if ((period = strrchr(file_name, '.')) != NULL) {
         *(period) = '\0';
         if (strcmp(extension, period + 1) == 0) {
@@ -272,12 +734,256 @@ void PutExtension(char *file_name, char *extension)
 void VerifyRangeFloorCeil(void)
 {
     if (floor_address_setted && ceiling_address_setted && (floor_address >= ceiling_address)) {
-        fprintf(fp, "Floor address %08X higher than Ceiling address %08X\n", floor_address, ceiling_address);
+        fprintf(fp, "Floor address %08" PRIX64 " higher than Ceiling address %08" PRIX64 "\n", floor_address,
+            ceiling_address);
         exit(1);
     }
 }
 
-void Allocate_Memory_And_Rewind(uint8_t **memory_block)
+#if !defined(_WIN32)
+struct FillJob {
+    uint8_t *block;
+    size_t length;
+    int pad;
+};
+
+static void *FillThread(void *arg)
+{
+    struct FillJob *job = (struct FillJob *)arg;
+
+    memset(job->block, job->pad, job->length);
+    return NULL;
+}
+#endif
+
+/*
+ * Fill a large block with the pad byte, each thread filling a part: the
+ * time goes in the page faults more than in the stores.
+ */
+static void FillPad(uint8_t *block, uint64_t length, int pad)
+{
+#if !defined(_WIN32)
+    pthread_t threads[MAX_FILL_THREADS];
+    struct FillJob jobs[MAX_FILL_THREADS];
+    bool started[MAX_FILL_THREADS];
+    long nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t part;
+    uint64_t offset = 0;
+    long i;
+
+    if ((length >= PARALLEL_FILL_SIZE) && (nb_threads > 1)) {
+        if (nb_threads > MAX_FILL_THREADS) {
+            nb_threads = MAX_FILL_THREADS;
+        }
+        /* Parts of whole pages */
+        part = ((length / nb_threads) + 0xFFF) & ~(uint64_t)0xFFF;
+
+        for (i = 0; i < nb_threads; i++) {
+            jobs[i].block = block + offset;
+            jobs[i].length = (size_t)((length - offset < part) ? length - offset : part);
+            jobs[i].pad = pad;
+            offset += jobs[i].length;
+
+            /* If the thread can't be started, this one does the work */
+            started[i] = (pthread_create(&threads[i], NULL, FillThread, &jobs[i]) == 0);
+            if (started[i] == false) {
+                FillThread(&jobs[i]);
+            }
+        }
+        for (i = 0; i < nb_threads; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+        return;
+    }
+#endif
+    memset(block, pad, (size_t)length);
+}
+
+/*
+ * Allocate a buffer filled with the pad byte, from the pool. A new large
+ * block from calloc() comes straight from the OS: its pages are only
+ * mapped when a record writes in them, so a sparse image of a few hundreds
+ * MB doesn't cost more than its data. A recycled one is filled.
+ */
+uint8_t *AllocateImage(uint64_t length, int pad)
+{
+    uint8_t *block;
+    bool zeroed;
+
+    if ((length == 0) || (length > (uint64_t)SIZE_MAX)) {
+        fprintf(fp, "Can't allocate memory: length 0x%" PRIX64 "\n", length);
+        exit(1);
+    }
+
+    block = PoolAlloc(length, &zeroed);
+    /* For EPROM or FLASH memory types, fill unused bytes with FF or the value specified by the p option */
+    if ((pad != 0) || !zeroed) {
+        FillPad(block, length, pad);
+    }
+
+    return block;
+}
+
+/* Padding up to the Minimum Block Size, written from a chunk of the arena */
+static void WritePad(FILE *out, uint64_t length, int pad)
+{
+    size_t chunk = (length < PAD_CHUNK_SIZE) ? (size_t)length : PAD_CHUNK_SIZE;
+    uint8_t *block = (uint8_t *)ArenaAlloc(chunk);
+    size_t nb;
+
+    memset(block, pad, chunk);
+    while (length != 0) {
+        nb = (length < chunk) ? (size_t)length : chunk;
+        fwrite(block, nb, 1, out);
+        length -= nb;
+    }
+}
+
+#if !defined(_WIN32)
+/* Compares a block of the output file at offset with data, writes it if it differs; true if written */
+static bool PatchBlock(int fd, uint64_t offset, const uint8_t *data, size_t length)
+{
+    uint8_t block[PATCH_BLOCK_SIZE];
+    ssize_t nb = pread(fd, block, length, (off_t)offset);
+
+    if ((nb == (ssize_t)length) && (memcmp(block, data, length) == 0)) {
+        return false;
+    }
+    if (pwrite(fd, data, length, (off_t)offset) != (ssize_t)length) {
+        fprintf(fp, "Can't write the output file\n");
+        exit(1);
+    }
+    return true;
+}
+
+/*
+ * --watch: the output file of the previous conversion is compared block by
+ * block with the image and its padding, and only the blocks that changed
+ * are written: a change of a few records writes a few pages. The file is
+ * cut or extended to its new length.
+ */
+static void PatchOutputFile(FILE *out, const uint8_t *data, uint64_t length, uint64_t pad_length, int pad)
+{
+    uint8_t block[PATCH_BLOCK_SIZE];
+    uint64_t total = length + pad_length;
+    uint64_t offset;
+    uint64_t written = 0;
+    uint64_t blocks = 0;
+    size_t nb;
+    size_t part;
+    struct stat st;
+    int fd;
+
+    fflush(out);
+    fd = fileno(out);
+    for (offset = 0; offset < total; offset += nb) {
+        nb = (total - offset < PATCH_BLOCK_SIZE) ? (size_t)(total - offset) : PATCH_BLOCK_SIZE;
+        if (offset + nb <= length) {
+            written += PatchBlock(fd, offset, data + offset, nb);
+        } else {
+            /* Block with the padding */
+            part = (offset < length) ? (size_t)(length - offset) : 0;
+            if (part != 0) {
+                memcpy(block, data + offset, part);
+            }
+            memset(block + part, pad, nb - part);
+            written += PatchBlock(fd, offset, block, nb);
+        }
+        blocks++;
+    }
+    if ((fstat(fd, &st) != 0) || (((uint64_t)st.st_size != total) && (ftruncate(fd, (off_t)total) != 0))) {
+        fprintf(fp, "Can't set the length of the output file\n");
+        exit(1);
+    }
+    /* Newer than the input file, even when no block changed */
+    futimens(fd, NULL);
+    fprintf(fp, "Output file patched: %" PRIu64 " of %" PRIu64 " blocks written\n", written, blocks);
+}
+#endif
+
+/* The image and its padding up to the Minimum Block Size, compressed with --compress */
+static void WriteImage(FILE *out, const uint8_t *data, uint64_t length, uint64_t pad_length, int pad)
+{
+    if (CompressEnabled()) {
+        CompressWrite(out, data, length, pad_length, pad);
+        return;
+    }
+    AioWrite(out, data, length);
+    if (pad_length != 0) {
+        WritePad(out, pad_length, pad);
+    }
+}
+
+/*
+ * --mmap: the output file is set to its final size, with the Minimum Block
+ * Size padding, and mapped. The records are decoded straight into the page
+ * cache and WriteOutFile() has nothing to copy. A new file reads as zeros,
+ * so it isn't filled when the pad byte is 00. Returns NULL if the file
+ * can't be mapped.
+ */
+static uint8_t *MapOutputFile(uint64_t length)
+{
+#if defined(_WIN32)
+    return NULL;
+#else
+    uint64_t total = length;
+    uint64_t module;
+    void *block;
+    int fd;
+
+    if (minimum_block_size_setted) {
+        module = length % minimum_block_size;
+        if (module) {
+            total += minimum_block_size - module;
+        }
+    }
+    if (total > (uint64_t)SIZE_MAX) {
+        return NULL;
+    }
+
+    fflush(file_out);
+    fd = fileno(file_out);
+    if (ftruncate(fd, (off_t)total) != 0) {
+        return NULL;
+    }
+    block = mmap(NULL, (size_t)total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (block == MAP_FAILED) {
+        if (ftruncate(fd, 0) != 0) {
+            fprintf(fp, "Can't truncate the output file\n");
+        }
+        return NULL;
+    }
+
+    if (pad_byte != 0) {
+        FillPad((uint8_t *)block, total, pad_byte);
+    }
+
+    output_map = (uint8_t *)block;
+    output_map_length = total;
+    return output_map;
+#endif
+}
+
+/* Buffer of the binary file, in the mapped output file with --mmap */
+static uint8_t *AllocateOutputImage(uint64_t length)
+{
+    uint8_t *block;
+
+    if (output_mapped && !output_patching && !verify_only && !CompressEnabled() && (length != 0)) {
+        block = MapOutputFile(length);
+        if (block != NULL) {
+            return block;
+        }
+        fprintf(fp, "Can't map the output file, it will be written\n");
+    }
+
+    return AllocateImage(length, pad_byte);
+}
+
+/* Address range and length of the binary file from the records, -s and -l */
+static void SetImageBounds(void)
 {
     if (starting_address_setted == true) {
         g_lowest_address = starting_address;
@@ -286,108 +992,1019 @@ void Allocate_Memory_And_Rewind(uint8_t **memory_block)
     }
 
     if (max_length_setted == false) {
+        if (g_highest_address < g_lowest_address) {
+            fprintf(fp, "No data from address 0x%08" PRIX64 "\n", g_lowest_address);
+            exit(1);
+        }
         max_length = g_highest_address - g_lowest_address + 1;
     } else {
         g_highest_address = g_lowest_address + max_length - 1;
     }
 
     fprintf(fp, "Allocate_Memory_and_Rewind:\n");
-    fprintf(fp, "Lowest address:   = 0x%08X\n", g_lowest_address);
-    fprintf(fp, "Highest address:  = 0x%08X\n", g_highest_address);
-    fprintf(fp, "Starting address: = 0x%08X\n", starting_address);
-    fprintf(fp, "Max Length:       = 0x%u\n\n", max_length);
+    fprintf(fp, "Lowest address:   = 0x%08" PRIX64 "\n", g_lowest_address);
+    fprintf(fp, "Highest address:  = 0x%08" PRIX64 "\n", g_highest_address);
+    fprintf(fp, "Starting address: = 0x%08" PRIX64 "\n", starting_address);
+    fprintf(fp, "Max Length:       = 0x%" PRIX64 "\n\n", max_length);
+}
 
-    /* Now that we know the buffer size, we can allocate it. */
-    /* allocate a buffer */
-    *memory_block = (uint8_t *)NoFailMalloc(max_length);
+void Allocate_Memory_And_Rewind(uint8_t **memory_block)
+{
+    SetImageBounds();
 
-    /* For EPROM or FLASH memory types, fill unused bytes with FF or the value specified by the p option */
-    memset(*memory_block, pad_byte, max_length);
+    /* Now that we know the buffer size, we can allocate it. */
+    *memory_block = AllocateOutputImage(max_length);
 
     rewind(file_in);
 }
 
-char *ReadDataBytes(char *p, uint8_t *memory_block, uint8_t *cs, uint16_t record_nb, uint32_t nb_bytes)
+static void ParseRegion(const char *name, const char *floor_str, const char *ceiling_str, const char *pad_str,
+    const char *size_str)
 {
-    uint32_t i, temp2;
-    int result;
+    struct Region *region;
+    uint32_t i;
 
-    /* Read the Data bytes. */
-    /* Bytes are written in the Memory block even if checksum is wrong. */
-    i = nb_bytes;
+    if (region_count == MAX_REGIONS) {
+        fprintf(fp, "Too many regions (max %d)\n", MAX_REGIONS);
+        exit(1);
+    }
+    if (strlen(name) >= MAX_REGION_NAME_SIZE) {
+        fprintf(fp, "Region name %s exceeds %d characters\n", name, MAX_REGION_NAME_SIZE - 1);
+        exit(1);
+    }
 
-    do {
-        result = sscanf(p, "%2x", &temp2);
-        if (result != 1) {
-            fprintf(fp, "ReadDataBytes: error in line %d of hex file\n", record_nb);
-        }
-        p += 2;
-
-        /* Check that the physical address stays in the buffer's range. */
-        if (g_phys_addr < max_length) {
-            /* Overlapping record will erase the pad bytes */
-            if (swap_wordwise) {
-                if (memory_block[g_phys_addr ^ 1] != pad_byte)
-                    fprintf(fp, "Overlapped record detected\n");
-                memory_block[g_phys_addr++ ^ 1] = temp2;
-            } else {
-                if (memory_block[g_phys_addr] != pad_byte)
-                    fprintf(fp, "Overlapped record detected\n");
-                memory_block[g_phys_addr++] = temp2;
-            }
+    region = &regions[region_count];
+    strcpy(region->name, name);
+    region->floor = GetHex64(floor_str);
+    region->ceiling = GetHex64(ceiling_str);
+    region->pad_byte = GetHex(pad_str) & 0xFF;
+    region->minimum_block_size = GetHex64(size_str);
+
+    if (region->floor > region->ceiling) {
+        fprintf(fp, "Region %s: floor address %08" PRIX64 " higher than ceiling address %08" PRIX64 "\n", name,
+            region->floor, region->ceiling);
+        exit(1);
+    }
 
-            *cs = (*cs + temp2) & 0xFF;
+    for (i = 0; i < region_count; i++) {
+        if ((region->floor <= regions[i].ceiling) && (region->ceiling >= regions[i].floor)) {
+            fprintf(fp, "Region %s overlaps region %s\n", name, regions[i].name);
+            exit(1);
         }
-    } while (--i != 0);
+    }
 
-    return p;
+    region_count++;
 }
 
-void WriteOutFile(uint8_t **memory_block)
+bool RegionsDefined(void)
 {
-    int module;
-    uint8_t *memory_block_new = NULL;
+    return region_count != 0;
+}
 
-    /* write binary file */
-    fwrite(*memory_block, max_length, 1, file_out);
-    free(*memory_block);
+static struct Region *FindRegion(uint64_t address)
+{
+    uint32_t i;
 
-    // minimum_block_size is set; the memory buffer is multiple of this?
-    if (minimum_block_size_setted == false) {
-        return;
+    /* Consecutive bytes are usually in the same region */
+    if ((current_region != NULL) && (address >= current_region->floor) && (address <= current_region->ceiling)) {
+        return current_region;
     }
 
-    module = max_length % minimum_block_size;
-    if (module) {
-        module = minimum_block_size - module;
-        memory_block_new = (uint8_t *)NoFailMalloc(module);
-        memset(memory_block_new, pad_byte, module);
-        fwrite(memory_block_new, module, 1, file_out);
-        free(memory_block_new);
-        if (max_length_setted == true) {
-            fprintf(fp, "Attention Max Length changed by Minimum Block Size\n");
+    for (i = 0; i < region_count; i++) {
+        if ((address >= regions[i].floor) && (address <= regions[i].ceiling)) {
+            current_region = &regions[i];
+            return current_region;
         }
-        // extended
-        max_length += module;
-        g_highest_address += module;
-        fprintf(fp, "Extended\nHighest address: %08X\n", g_highest_address);
-        fprintf(fp, "Max Length: %u\n\n", max_length);
     }
+
+    return NULL;
 }
 
-/*
- * Parse options on the command line
- * variables:
- * use p for parsing arguments
- * use i for number of parameters to skip
- * use c for the current option
- */
-void ParseOptions(int argc, char *argv[])
+/* Returns false if the address isn't in a region */
+static bool RegionWriteByte(uint64_t address, uint8_t value, bool *overlap)
 {
-    int param;
-    char *p;
-
-    starting_address = 0;
+    struct Region *region = FindRegion(address);
+    uint64_t region_size;
+    uint64_t size;
+    uint64_t offset;
+
+    if (region == NULL) {
+        return false;
+    }
+
+    offset = address - region->floor;
+
+    region_size = region->ceiling - region->floor + 1;
+    if ((offset >= region_size) || (offset >= (uint64_t)SIZE_MAX)) {
+        return false;
+    }
+
+    /* Extend the region buffer, filled with its pad byte */
+    if (offset >= region->allocated) {
+        size = region->allocated * 2;
+        if (size <= offset) {
+            size = (offset + 0x1000) & ~(uint64_t)0xFFF;
+        }
+        if ((size > region_size) || (size > (uint64_t)SIZE_MAX)) {
+            size = (region_size < (uint64_t)SIZE_MAX) ? region_size : (uint64_t)SIZE_MAX;
+        }
+        region->memory_block = PoolRealloc(region->memory_block, size);
+        memset(region->memory_block + region->allocated, region->pad_byte, (size_t)(size - region->allocated));
+        region->allocated = size;
+    }
+
+    if (offset < region->length) {
+        if (region->memory_block[offset] != region->pad_byte) {
+            STATS_ADD(overlaps, 1);
+            *overlap = true;
+        }
+    } else {
+        region->length = offset + 1;
+    }
+    region->memory_block[offset] = value;
+
+    return true;
+}
+
+/* Region mode: g_lowest_address is 0 so g_phys_addr is the absolute address */
+static void RegionWriteBytes(const uint8_t *data, uint64_t nb_bytes)
+{
+    uint64_t i;
+    bool overlap = false;
+    bool skipped = false;
+
+    for (i = 0; i < nb_bytes; i++) {
+        if (RegionWriteByte(g_phys_addr++, data[i], &overlap) == false) {
+            STATS_ADD(skipped, 1);
+            skipped = true;
+        }
+    }
+
+    if (overlap) {
+        fprintf(fp, "Overlapped record detected\n");
+    }
+    if (skipped) {
+        fprintf(fp, "Data outside of regions skipped at %08" PRIX64 "\n", g_phys_addr - nb_bytes);
+    }
+}
+
+/* Reverses the bytes of each word of width bytes in the 64-bit lanes of x */
+static inline uint64_t SwapLane(uint64_t x, uint32_t width)
+{
+    x = ((x >> 8) & UINT64_C(0x00FF00FF00FF00FF)) | ((x & UINT64_C(0x00FF00FF00FF00FF)) << 8);
+    if (width >= 4) {
+        x = ((x >> 16) & UINT64_C(0x0000FFFF0000FFFF)) | ((x & UINT64_C(0x0000FFFF0000FFFF)) << 16);
+    }
+    if (width == 8) {
+        x = (x >> 32) | (x << 32);
+    }
+    return x;
+}
+
+/* Called with a constant width, so that each loop is vectorized on its own */
+static inline void SwapLanes(uint8_t *block, uint64_t length, uint32_t width)
+{
+    uint64_t x;
+    uint64_t i;
+
+    for (i = 0; i < length; i += 8) {
+        memcpy(&x, block + i, sizeof(x));
+        x = SwapLane(x, width);
+        memcpy(block + i, &x, sizeof(x));
+    }
+}
+
+/*
+ * -w and --swap: the bytes of each word are reversed once the image is
+ * decoded, instead of storing each byte at its swapped address. A last
+ * partial word is completed with pad bytes, which are then cut.
+ */
+static void SwapImage(uint8_t *block, uint64_t length, int pad)
+{
+    uint64_t lanes = length & ~(uint64_t)7;
+    uint8_t tail[16];
+    uint8_t temp;
+    uint64_t i;
+    uint32_t j;
+
+    switch (swap_width) {
+        case 2:
+            SwapLanes(block, lanes, 2);
+            break;
+        case 4:
+            SwapLanes(block, lanes, 4);
+            break;
+        case 8:
+            SwapLanes(block, lanes, 8);
+            break;
+        default:
+            return;
+    }
+
+    /* The words after the last lane, then the partial word */
+    memset(tail, pad, sizeof(tail));
+    memcpy(tail, block + lanes, (size_t)(length - lanes));
+    for (i = 0; i < length - lanes; i += swap_width) {
+        for (j = 0; j < swap_width / 2; j++) {
+            temp = tail[i + j];
+            tail[i + j] = tail[i + swap_width - 1 - j];
+            tail[i + swap_width - 1 - j] = temp;
+        }
+    }
+    memcpy(block + lanes, tail, (size_t)(length - lanes));
+}
+
+void SwapWords(uint8_t *memory_block)
+{
+    SwapImage(memory_block, max_length, pad_byte);
+}
+
+/* Write each region in file_name_regionname.extension */
+void RegionsWriteOutFiles(const char *file_name, const char *extension)
+{
+    char region_file_name[MAX_FILE_NAME_SIZE];
+    const char *period;
+    size_t base_length;
+    struct Region *region;
+    uint64_t module;
+    uint32_t i;
+
+    /* The regions of stdin go to stdin_<region>.<ext> */
+    if (strcmp(file_name, STANDARD_STREAM_NAME) == 0) {
+        file_name = "stdin";
+    }
+
+    /* Don't use strchr(), see PutExtension() */
+    period = strrchr(file_name, '.');
+    base_length = (period != NULL) ? (size_t)(period - file_name) : strlen(file_name);
+
+    for (i = 0; i < region_count; i++) {
+        region = &regions[i];
+
+        if (region->length == 0) {
+            fprintf(fp, "Region %s: no data, no file written\n\n", region->name);
+            continue;
+        }
+
+        if (base_length + strlen(region->name) + strlen(extension) + 3 > MAX_FILE_NAME_SIZE) {
+            fprintf(fp, "filename length exceeds %d characters.\n", MAX_FILE_NAME_SIZE);
+            exit(1);
+        }
+        memcpy(region_file_name, file_name, base_length);
+        sprintf(region_file_name + base_length, "_%s.%s", region->name, extension);
+
+        /* The last word is completed, or dropped if it ends after the region */
+        if (swap_width != 0) {
+            region->length = (region->length + swap_width - 1) / swap_width * swap_width;
+            if (region->length > region->allocated) {
+                region->length -= swap_width;
+            }
+            SwapImage(region->memory_block, region->length, region->pad_byte);
+        }
+
+        /* The check value is written only in the region containing its address */
+        g_lowest_address = region->floor;
+        g_highest_address = region->floor + region->length - 1;
+
+        fprintf(fp, "Region %s: %s\n", region->name, region_file_name);
+        fprintf(fp, "Lowest address:   = 0x%08" PRIX64 "\n", g_lowest_address);
+        fprintf(fp, "Highest address:  = 0x%08" PRIX64 "\n", g_highest_address);
+        fprintf(fp, "Pad Byte          = 0x%X\n", region->pad_byte);
+
+        WriteMemory(region->memory_block);
+
+        module = 0;
+        if (region->minimum_block_size != 0) {
+            module = region->length % region->minimum_block_size;
+            if (module) {
+                module = region->minimum_block_size - module;
+            }
+        }
+
+        NoFailOpenOutputFile(region_file_name);
+        WriteImage(file_out, region->memory_block, region->length, module, region->pad_byte);
+        STATS_ADD_PHASE(data_bytes, region->length + module);
+        if (module) {
+            fprintf(fp, "Extended by %" PRIu64 " bytes\n", module);
+        }
+        fprintf(fp, "\n");
+
+        NoFailCloseOutputFile(NULL);
+        PoolRelease(region->memory_block);
+        region->memory_block = NULL;
+    }
+}
+
+/*
+ * Start of a single pass. record_count is the number of data records given
+ * by the file (0 if unknown): with the size of the first record, it gives
+ * the size to allocate, up to max_size.
+ */
+void ImageBegin(uint64_t record_count, uint64_t max_size)
+{
+    image_growing = true;
+    image_record_count = record_count;
+    image_max_size = max_size;
+    image_allocated = 0;
+    image_overlap_count = 0;
+
+    /* g_phys_addr is the absolute address */
+    g_lowest_address = 0;
+    g_highest_address = (uint64_t)-1;
+}
+
+static void ImageGrow(uint64_t address, uint64_t nb_bytes)
+{
+    uint64_t size;
+    uint64_t extra;
+
+    if (image_allocated == 0) {
+        size = image_record_count * nb_bytes;
+        if (size > image_max_size) {
+            size = image_max_size;
+        }
+        if (size < nb_bytes) {
+            size = nb_bytes;
+        }
+        if (size > (uint64_t)SIZE_MAX) {
+            fprintf(fp, "Can't allocate memory: length 0x%" PRIX64 "\n", size);
+            exit(1);
+        }
+        image_block = PoolAlloc(size, NULL);
+        memset(image_block, pad_byte, (size_t)size);
+        image_base = address;
+        image_allocated = size;
+        image_lowest = address;
+        image_highest = address;
+        return;
+    }
+
+    /* Below the image: move it up by at least its size */
+    if (address < image_base) {
+        extra = image_base - address;
+        if (extra < image_allocated) {
+            extra = (image_allocated < image_base) ? image_allocated : image_base;
+        }
+        size = image_allocated + extra;
+        if ((size < image_allocated) || (size > (uint64_t)SIZE_MAX)) {
+            fprintf(fp, "Can't allocate memory: length 0x%" PRIX64 "\n", size);
+            exit(1);
+        }
+        image_block = PoolRealloc(image_block, size);
+        memmove(image_block + extra, image_block, (size_t)image_allocated);
+        memset(image_block, pad_byte, (size_t)extra);
+        image_base -= extra;
+        image_allocated = size;
+    }
+
+    /* Above the image: double its size */
+    if (address + nb_bytes - image_base > image_allocated) {
+        size = image_allocated * 2;
+        if (size < address + nb_bytes - image_base) {
+            size = address + nb_bytes - image_base;
+        }
+        if (size > (uint64_t)SIZE_MAX) {
+            fprintf(fp, "Can't allocate memory: length 0x%" PRIX64 "\n", size);
+            exit(1);
+        }
+        image_block = PoolRealloc(image_block, size);
+        memset(image_block + image_allocated, pad_byte, (size_t)(size - image_allocated));
+        image_allocated = size;
+    }
+}
+
+/* Adds an overlapped byte to the overlaps of the current record */
+static void ImageAddOverlap(uint64_t address)
+{
+    struct ImageOverlap *overlap;
+
+    if (!image_overlap_record) {
+        if (image_overlap_count == image_overlap_allocated) {
+            image_overlap_allocated = (image_overlap_allocated == 0) ? 64 : image_overlap_allocated * 2;
+            image_overlaps = (struct ImageOverlap *)NoFailRealloc(image_overlaps,
+                image_overlap_allocated * sizeof(struct ImageOverlap));
+        }
+        overlap = &image_overlaps[image_overlap_count++];
+        overlap->first = address;
+        overlap->count = 0;
+        image_overlap_record = true;
+    }
+    overlap = &image_overlaps[image_overlap_count - 1];
+    overlap->last = address;
+    overlap->count++;
+}
+
+/* Addresses written by the current file, the contiguous records in one extent */
+static void ImageAddExtent(uint64_t first, uint64_t last)
+{
+    struct ImageExtent *extent;
+
+    if (image_extent_count != 0) {
+        extent = &image_extents[image_extent_count - 1];
+        if ((extent->file == image_file) && (extent->last + 1 == first)) {
+            extent->last = last;
+            return;
+        }
+    }
+    if (image_extent_count == image_extent_allocated) {
+        image_extent_allocated = (image_extent_allocated == 0) ? 256 : image_extent_allocated * 2;
+        image_extents = (struct ImageExtent *)NoFailRealloc(image_extents,
+            (size_t)image_extent_allocated * sizeof(struct ImageExtent));
+    }
+    extent = &image_extents[image_extent_count++];
+    extent->first = first;
+    extent->last = last;
+    extent->file = image_file;
+}
+
+/* Single pass: g_phys_addr is the absolute address */
+static void ImageWriteBytes(const uint8_t *data, uint64_t nb_bytes)
+{
+    uint64_t address = g_phys_addr;
+    uint8_t *block;
+    uint64_t i;
+
+    /* As with two passes, a record beginning below the starting address is skipped */
+    if ((starting_address_setted && (address < starting_address)) || (address + nb_bytes < address)) {
+        STATS_ADD(skipped, nb_bytes);
+        return;
+    }
+
+    ImageGrow(address, nb_bytes);
+    if (address < image_lowest) {
+        image_lowest = address;
+    }
+    if (address + nb_bytes - 1 > image_highest) {
+        image_highest = address + nb_bytes - 1;
+    }
+
+    if (image_file_count > 1) {
+        ImageAddExtent(address, address + nb_bytes - 1);
+    }
+
+    /* Overlapping record will erase the pad bytes */
+    block = image_block + (address - image_base);
+    for (i = 0; i < nb_bytes; i++) {
+        if (block[i] != pad_byte) {
+            ImageAddOverlap(address + i);
+        }
+        block[i] = data[i];
+    }
+    g_phys_addr += nb_bytes;
+    image_overlap_record = false;
+}
+
+/* Overlapped records between g_lowest_address and g_highest_address */
+static void ImageReportOverlaps(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < image_overlap_count; i++) {
+        if ((image_overlaps[i].first <= g_highest_address) && (image_overlaps[i].last >= g_lowest_address)) {
+            STATS_ADD(overlaps, image_overlaps[i].count);
+            fprintf(fp, "Overlapped record detected\n");
+        }
+    }
+    free(image_overlaps);
+    image_overlaps = NULL;
+    image_overlap_count = 0;
+    image_overlap_allocated = 0;
+}
+
+static int CompareExtents(const void *a, const void *b)
+{
+    const struct ImageExtent *extent_a = (const struct ImageExtent *)a;
+    const struct ImageExtent *extent_b = (const struct ImageExtent *)b;
+
+    if (extent_a->first != extent_b->first) {
+        return (extent_a->first < extent_b->first) ? -1 : 1;
+    }
+    return (extent_a->file < extent_b->file) ? -1 : (extent_a->file > extent_b->file);
+}
+
+static void ReportConflict(uint32_t file_a, uint32_t file_b, uint64_t first, uint64_t last)
+{
+    uint32_t kept = (file_a > file_b) ? file_a : file_b;
+
+    STATS_ADD(conflicts, 1);
+    fprintf(fp, "Files %s and %s overlap at 0x%08" PRIX64 "-0x%08" PRIX64 ", %s kept\n",
+        image_file_names[(file_a < file_b) ? file_a : file_b], image_file_names[kept], first, last,
+        image_file_names[kept]);
+}
+
+/*
+ * Addresses written by two files, between g_lowest_address and
+ * g_highest_address. The files are read in order: the last one is kept.
+ * The extents are sorted by address; reach is the highest address of the
+ * extents before, and other_reach the highest one of another file.
+ */
+static void ImageReportConflicts(void)
+{
+    const uint32_t none = (uint32_t)-1;
+    uint64_t reach = 0;
+    uint64_t other_reach = 0;
+    uint32_t reach_file = none;
+    uint32_t other_file = none;
+    uint64_t conflict_first = 0;
+    uint64_t conflict_last = 0;
+    uint32_t conflict_a = none;
+    uint32_t conflict_b = none;
+    uint64_t first;
+    uint64_t last;
+    uint64_t before;
+    uint32_t before_file;
+    uint64_t i;
+
+    qsort(image_extents, (size_t)image_extent_count, sizeof(struct ImageExtent), CompareExtents);
+
+    for (i = 0; i < image_extent_count; i++) {
+        struct ImageExtent *extent = &image_extents[i];
+
+        /* Highest address written by another file before this extent */
+        before = (reach_file != extent->file) ? reach : other_reach;
+        before_file = (reach_file != extent->file) ? reach_file : other_file;
+
+        if ((before_file != none) && (before >= extent->first)) {
+            first = (extent->first > g_lowest_address) ? extent->first : g_lowest_address;
+            last = (extent->last < before) ? extent->last : before;
+            if (last > g_highest_address) {
+                last = g_highest_address;
+            }
+            if (first <= last) {
+                /* The conflicts of the same two files, one after the other, are reported once */
+                if ((conflict_a == before_file) && (conflict_b == extent->file) && (first <= conflict_last + 1)) {
+                    if (last > conflict_last) {
+                        conflict_last = last;
+                    }
+                } else {
+                    if (conflict_a != none) {
+                        ReportConflict(conflict_a, conflict_b, conflict_first, conflict_last);
+                    }
+                    conflict_a = before_file;
+                    conflict_b = extent->file;
+                    conflict_first = first;
+                    conflict_last = last;
+                }
+            }
+        }
+
+        if (extent->file == reach_file) {
+            if (extent->last > reach) {
+                reach = extent->last;
+            }
+        } else if ((reach_file == none) || (extent->last > reach)) {
+            other_reach = reach;
+            other_file = reach_file;
+            reach = extent->last;
+            reach_file = extent->file;
+        } else if ((other_file == none) || (extent->last > other_reach)) {
+            other_reach = extent->last;
+            other_file = extent->file;
+        }
+    }
+    if (conflict_a != none) {
+        ReportConflict(conflict_a, conflict_b, conflict_first, conflict_last);
+    }
+
+    free(image_extents);
+    image_extents = NULL;
+    image_extent_count = 0;
+    image_extent_allocated = 0;
+    image_file_count = 0;
+}
+
+/* Releases the image of a single pass left by an exit() before ImageEnd(), for the fuzz target */
+void ImageAbort(void)
+{
+    if (!image_growing) {
+        return;
+    }
+    image_growing = false;
+    if (image_allocated != 0) {
+        PoolRelease(image_block);
+        image_block = NULL;
+        image_allocated = 0;
+    }
+    free(image_extents);
+    image_extents = NULL;
+    image_extent_count = 0;
+    image_extent_allocated = 0;
+    image_file_count = 0;
+}
+
+/*
+ * End of a single pass: the image is cut like the buffer of
+ * Allocate_Memory_And_Rewind(), the addresses are those of the records.
+ * Returns the lowest address of the records.
+ */
+uint64_t ImageEnd(uint8_t **memory_block)
+{
+    uint64_t records_start;
+    uint64_t first;
+    uint64_t last;
+
+    image_growing = false;
+
+    if (image_allocated != 0) {
+        g_lowest_address = image_lowest;
+        g_highest_address = image_highest;
+    } else {
+        g_lowest_address = (uint64_t)-1;
+        g_highest_address = 0;
+    }
+    records_start = g_lowest_address;
+    SetImageBounds();
+    ImageReportOverlaps();
+    if (image_file_count > 1) {
+        ImageReportConflicts();
+    }
+
+    if ((image_allocated != 0) && (g_lowest_address == image_base) && (max_length <= image_allocated)) {
+        /* Already in place */
+        *memory_block = image_block;
+    } else if ((image_allocated != 0) && (g_lowest_address > image_base) &&
+               (g_lowest_address - image_base + max_length <= image_allocated)) {
+        memmove(image_block, image_block + (g_lowest_address - image_base), (size_t)max_length);
+        *memory_block = image_block;
+    } else {
+        *memory_block = AllocateOutputImage(max_length);
+
+        /* Part of the image between g_lowest_address and g_highest_address */
+        if (image_allocated != 0) {
+            first = (g_lowest_address > image_base) ? g_lowest_address : image_base;
+            last = image_base + image_allocated - 1;
+            if (last > g_highest_address) {
+                last = g_highest_address;
+            }
+            if (first <= last) {
+                memcpy(*memory_block + (first - g_lowest_address), image_block + (first - image_base),
+                    (size_t)(last - first + 1));
+            }
+        }
+        PoolRelease(image_block);
+    }
+    image_block = NULL;
+    image_allocated = 0;
+
+    return records_start;
+}
+
+/* Value of a hex digit or'ed with 0x10, 0 for other characters */
+static const uint8_t hex_digits[256] = {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14, ['5'] = 0x15, ['6'] = 0x16,
+    ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19, ['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D,
+    ['E'] = 0x1E, ['F'] = 0x1F, ['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E,
+    ['f'] = 0x1F
+};
+
+/*
+ * Decodes nb_bytes pairs of hex digits at p; returns the number of bytes
+ * decoded before the first character that isn't a hex digit. Called with a
+ * constant checksum, so that the loop of each variant has no option test.
+ */
+static inline uint32_t DecodeHexBytes(const char *p, uint8_t *data, uint32_t nb_bytes, uint8_t *cs, bool checksum)
+{
+    uint8_t high;
+    uint8_t low;
+    uint8_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < nb_bytes; i++) {
+        high = hex_digits[(uint8_t)p[2 * i]];
+        if (high == 0) {
+            break;
+        }
+        low = hex_digits[(uint8_t)p[2 * i + 1]];
+        if (low == 0) {
+            break;
+        }
+        data[i] = (uint8_t)((high << 4) | (low & 0x0F));
+        if (checksum) {
+            sum += data[i];
+        }
+    }
+
+    if (checksum) {
+        *cs = (uint8_t)(*cs + sum);
+    }
+    return i;
+}
+
+/* The data bytes are added to the record checksum only if it is verified (-c) */
+static uint32_t DecodeHexChecksum(const char *p, uint8_t *data, uint32_t nb_bytes, uint8_t *cs)
+{
+    return DecodeHexBytes(p, data, nb_bytes, cs, true);
+}
+
+static uint32_t DecodeHexNoChecksum(const char *p, uint8_t *data, uint32_t nb_bytes, uint8_t *cs)
+{
+    return DecodeHexBytes(p, data, nb_bytes, cs, false);
+}
+
+/* Selected after the options are parsed */
+static uint32_t (*DecodeHex)(const char *p, uint8_t *data, uint32_t nb_bytes, uint8_t *cs) = DecodeHexNoChecksum;
+
+/* Two passes: the record is written in the buffer, up to its end */
+static void BufferWriteBytes(const uint8_t *data, uint8_t *memory_block, uint8_t *cs, uint32_t nb_bytes)
+{
+    uint8_t *block;
+    uint32_t overlapped = 0;
+    uint32_t nb;
+    uint32_t i;
+
+    if (g_phys_addr >= max_length) {
+        nb = 0;
+    } else {
+        nb = (nb_bytes < max_length - g_phys_addr) ? nb_bytes : (uint32_t)(max_length - g_phys_addr);
+    }
+
+    /* Overlapping record will erase the pad bytes */
+    block = memory_block + g_phys_addr;
+    for (i = 0; i < nb; i++) {
+        overlapped += (block[i] != pad_byte);
+    }
+    memcpy(block, data, nb);
+    g_phys_addr += nb;
+
+    if (overlapped != 0) {
+        STATS_ADD(overlaps, overlapped);
+        fprintf(fp, "Overlapped record detected\n");
+    }
+
+    /* The bytes after the buffer aren't in the checksum */
+    if (nb < nb_bytes) {
+        STATS_ADD(skipped, nb_bytes - nb);
+        if (enable_checksum_error) {
+            for (i = nb; i < nb_bytes; i++) {
+                *cs = (uint8_t)(*cs - data[i]);
+            }
+        }
+    }
+}
+
+/* Decodes nb_bytes pairs of hex digits at p, for --extract; returns the number of bytes decoded */
+uint32_t DecodeHexData(const char *p, uint8_t *data, uint32_t nb_bytes)
+{
+    uint8_t cs = 0;
+
+    return DecodeHexBytes(p, data, nb_bytes, &cs, false);
+}
+
+char *ReadDataBytes(char *p, uint8_t *memory_block, uint8_t *cs, uint16_t record_nb, uint32_t nb_bytes)
+{
+    uint8_t data[MAX_LINE_SIZE / 2];
+    uint32_t nb;
+
+    STATS_ADD_PHASE(data_bytes, nb_bytes);
+
+    if (nb_bytes > sizeof(data)) {
+        fprintf(fp, "ReadDataBytes: error in line %d of hex file\n", record_nb);
+        return p;
+    }
+
+    /* Read the Data bytes. */
+    /* Bytes are written in the Memory block even if checksum is wrong. */
+    /* The line ends with '\0': the rest of a short record isn't read */
+    nb = DecodeHex(p, data, nb_bytes, cs);
+    if (nb < nb_bytes) {
+        fprintf(fp, "ReadDataBytes: error in line %d of hex file\n", record_nb);
+    }
+
+    if (region_count != 0) {
+        RegionWriteBytes(data, nb);
+    } else if (image_growing) {
+        ImageWriteBytes(data, nb);
+    } else {
+        BufferWriteBytes(data, memory_block, cs, nb);
+    }
+
+    return p + 2 * nb;
+}
+
+/* Same as ReadDataBytes() for data that is already binary (ELF segments, --extract) */
+void WriteDataBytes(const uint8_t *data, uint8_t *memory_block, uint64_t nb_bytes)
+{
+    uint8_t *block;
+    uint64_t overlapped = 0;
+    uint64_t nb;
+    uint64_t i;
+
+    STATS_ADD_PHASE(data_bytes, nb_bytes);
+
+    if (region_count != 0) {
+        RegionWriteBytes(data, nb_bytes);
+        return;
+    }
+    if (image_growing) {
+        ImageWriteBytes(data, nb_bytes);
+        return;
+    }
+
+    /* Check that the physical address stays in the buffer's range. */
+    if (g_phys_addr >= max_length) {
+        nb = 0;
+    } else {
+        nb = (nb_bytes < max_length - g_phys_addr) ? nb_bytes : max_length - g_phys_addr;
+    }
+    STATS_ADD(skipped, nb_bytes - nb);
+
+    /* Overlapping data will erase the pad bytes */
+    block = memory_block + g_phys_addr;
+    for (i = 0; i < nb; i++) {
+        overlapped += (block[i] != pad_byte);
+    }
+    memcpy(block, data, (size_t)nb);
+    g_phys_addr += nb;
+
+    STATS_ADD(overlaps, overlapped);
+    if (overlapped != 0) {
+        fprintf(fp, "Overlapped record detected\n");
+    }
+}
+
+void WriteOutFile(uint8_t **memory_block)
+{
+    uint64_t module;
+    bool mapped = (output_map != NULL) && (*memory_block == output_map);
+
+    /* --verify: the check value is compared by VerifyMemory() instead */
+    if (verify_only) {
+        PoolRelease(*memory_block);
+        *memory_block = NULL;
+        return;
+    }
+
+    // minimum_block_size is set; the memory buffer is multiple of this?
+    module = 0;
+    if (minimum_block_size_setted == true) {
+        module = max_length % minimum_block_size;
+        if (module) {
+            module = minimum_block_size - module;
+        }
+    }
+
+    /* write binary file */
+    if (mapped) {
+        /* Already in the file, with the padding */
+#if !defined(_WIN32)
+        munmap(output_map, (size_t)output_map_length);
+#endif
+        output_map = NULL;
+        STATS_ADD_PHASE(data_bytes, output_map_length);
+    } else {
+#if !defined(_WIN32)
+        if (output_patching) {
+            PatchOutputFile(file_out, *memory_block, max_length, module, pad_byte);
+        } else
+#endif
+        {
+            WriteImage(file_out, *memory_block, max_length, module, pad_byte);
+        }
+        STATS_ADD_PHASE(data_bytes, max_length + module);
+        PoolRelease(*memory_block);
+    }
+    *memory_block = NULL;
+
+    written_address = g_lowest_address;
+    written_length = max_length;
+    image_written = true;
+
+    if (module) {
+        if (max_length_setted == true) {
+            fprintf(fp, "Attention Max Length changed by Minimum Block Size\n");
+        }
+        // extended
+        max_length += module;
+        g_highest_address += module;
+        fprintf(fp, "Extended\nHighest address: %08" PRIX64 "\n", g_highest_address);
+        fprintf(fp, "Max Length: %" PRIu64 "\n\n", max_length);
+    }
+}
+
+/* A size in bytes, with K, M or G for KB, MB or GB */
+static uint64_t GetSize(const char *str)
+{
+    char *end;
+    uint64_t size = strtoull(str, &end, 10);
+
+    if (end == str) {
+        usage(__func__, __LINE__);
+    }
+    switch (toupper((unsigned char)*end)) {
+        case 'G':
+            size <<= 10;
+            /* fall through */
+        case 'M':
+            size <<= 10;
+            /* fall through */
+        case 'K':
+            size <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    if ((*end != '\0') || (size == 0)) {
+        usage(__func__, __LINE__);
+    }
+    return size;
+}
+
+/* --pages=size: in hex, as -l and -m, or in KB or MB with K or M (4K, 128K) */
+static uint64_t GetPageSize(const char *str)
+{
+    size_t length = strlen(str);
+    char *end;
+    uint64_t size;
+
+    if ((length != 0) && ((toupper((unsigned char)str[length - 1]) == 'K') ||
+                             (toupper((unsigned char)str[length - 1]) == 'M'))) {
+        return GetSize(str);
+    }
+    size = strtoull(str, &end, 16);
+    if ((end == str) || (*end != '\0') || (size == 0)) {
+        usage(__func__, __LINE__);
+    }
+    return size;
+}
+
+/* --extract=address,length in hex, as -s and -l */
+static void ParseExtract(const char *str)
+{
+    char *end;
+    uint64_t address = strtoull(str, &end, 16);
+    uint64_t length;
+
+    if ((end == str) || (*end != ',')) {
+        usage(__func__, __LINE__);
+    }
+    str = end + 1;
+    length = strtoull(str, &end, 16);
+    if ((end == str) || (*end != '\0') || (length == 0) || (address + length - 1 < address)) {
+        usage(__func__, __LINE__);
+    }
+    ExtractSetRange(address, length);
+}
+
+/* Options without a single-letter form: --name or --name=value */
+static void ParseLongOption(const char *name)
+{
+    if (strcmp(name, "stats") == 0) {
+        StatsEnable(false);
+    } else if (strcmp(name, "stats=json") == 0) {
+        StatsEnable(true);
+    } else if (strcmp(name, "mmap") == 0) {
+        output_mapped = true;
+    } else if (strcmp(name, "swap=16") == 0) {
+        swap_width = 2;
+    } else if (strcmp(name, "swap=32") == 0) {
+        swap_width = 4;
+    } else if (strcmp(name, "swap=64") == 0) {
+        swap_width = 8;
+    } else if (strcmp(name, "io=uring") == 0) {
+        AioSetMode(AIO_URING);
+    } else if (strcmp(name, "io=thread") == 0) {
+        AioSetMode(AIO_THREAD);
+    } else if (strcmp(name, "io=stdio") == 0) {
+        AioSetMode(AIO_STDIO);
+    } else if ((strncmp(name, "compress=", 9) == 0) && CompressSetMode(name + 9)) {
+        /* Set by CompressSetMode() */
+    } else if (strncmp(name, "max-memory=", 11) == 0) {
+        PoolSetBudget(GetSize(name + 11));
+    } else if (strcmp(name, "verify") == 0) {
+        verify_only = true;
+    } else if ((strncmp(name, "delta=", 6) == 0) && (name[6] != '\0')) {
+        DeltaSetBase(name + 6);
+    } else if (strncmp(name, "extract=", 8) == 0) {
+        ParseExtract(name + 8);
+    } else if (strncmp(name, "pages=", 6) == 0) {
+        PagesSetSize(GetPageSize(name + 6));
+    } else if ((strncmp(name, "pages-at=", 9) == 0) && (name[9] != '\0')) {
+        PagesSetTable(GetHex64(name + 9));
+    } else {
+        usage(__func__, __LINE__);
+    }
+}
+
+/*
+ * Parse options on the command line
+ * variables:
+ * use p for parsing arguments
+ * use i for number of parameters to skip
+ * use c for the current option
+ */
+/* Returns the index of the first file name */
+int ParseOptions(int argc, char *argv[])
+{
+    int param;
+    char *p;
+
+    /* --watch: parsed once by the watching process, each conversion keeps them */
+    if (options_first_file != 0) {
+        return options_first_file;
+    }
+
+    starting_address = 0;
 
     for (param = 1; param < argc; param++) {
         int i = 0;
@@ -396,9 +2013,10 @@ void ParseOptions(int argc, char *argv[])
         p = argv[param];
         c = *(p + 1); /* Get option character */
 
-        if (_IS_OPTION_(*p)) {
+        /* "-" alone is stdin, not an option */
+        if (_IS_OPTION_(*p) && (*(p + 1) != '\0')) {
             // test for no space between option and parameter
-            if (strlen(p) != 2) {
+            if ((c != '-') && (strlen(p) != 2)) {
                 usage(__func__, __LINE__);
             }
 
@@ -438,16 +2056,19 @@ void ParseOptions(int argc, char *argv[])
                     i = 1; /* add 1 to param */
                     break;
                 case 'l':
-                    max_length = GetHex(argv[param + 1]);
-                    if (max_length > 0x800000) {
-                        fprintf(fp, "max_length = %u\n", max_length);
+                    max_length = GetHex64(argv[param + 1]);
+                    if (max_length == 0) {
+                        fprintf(fp, "max_length = 0\n");
                         exit(1);
                     }
                     max_length_setted = true;
                     i = 1; /* add 1 to param */
                     break;
                 case 'm':
-                    minimum_block_size = GetHex(argv[param + 1]);
+                    minimum_block_size = GetHex64(argv[param + 1]);
+                    if (minimum_block_size == 0) {
+                        usage(__func__, __LINE__);
+                    }
                     minimum_block_size_setted = true;
                     i = 1; /* add 1 to param */
                     break;
@@ -459,8 +2080,12 @@ void ParseOptions(int argc, char *argv[])
                     Para_r(argv[param + 1], argv[param + 2]);
                     i = 2; /* add 2 to param */
                     break;
+                case 'R':
+                    ParseRegion(argv[param + 1], argv[param + 2], argv[param + 3], argv[param + 4], argv[param + 5]);
+                    i = 5; /* add 5 to param */
+                    break;
                 case 's':
-                    starting_address = GetHex(argv[param + 1]);
+                    starting_address = GetHex64(argv[param + 1]);
                     starting_address_setted = true;
                     i = 1; /* add 1 to param */
                     break;
@@ -469,23 +2094,27 @@ void ParseOptions(int argc, char *argv[])
                     i = 0;
                     break;
                 case 't':
-                    floor_address = GetHex(argv[param + 1]);
+                    floor_address = GetHex64(argv[param + 1]);
                     floor_address_setted = true;
                     i = 1; /* add 1 to param */
                     break;
                 case 'T':
-                    ceiling_address = GetHex(argv[param + 1]);
+                    ceiling_address = GetHex64(argv[param + 1]);
                     ceiling_address_setted = true;
                     i = 1; /* add 1 to param */
                     break;
                 case 'w':
-                    swap_wordwise = true;
+                    swap_width = 2;
                     i = 0;
                     break;
                 case 'C':
                     Para_C(argv[param + 1], argv[param + 2], argv[param + 3], argv[param + 4], argv[param + 5]);
                     i = 5; /* add 5 to param */
                     break;
+                case '-':
+                    ParseLongOption(p + 2);
+                    i = 0;
+                    break;
 
                 case '?':
                 case 'h':
@@ -513,6 +2142,119 @@ void ParseOptions(int argc, char *argv[])
         }
         /* if option */
     } /* for param */
+
+    DecodeHex = enable_checksum_error ? DecodeHexChecksum : DecodeHexNoChecksum;
+
+    if (verify_only && ((region_count != 0) || DeltaEnabled() || PagesEnabled())) {
+        fprintf(fp, "--verify writes no file and can't be used with -R, --delta or --pages\n");
+        exit(1);
+    }
+    /* --extract gives the starting address and the length of the binary file */
+    if (ExtractEnabled()) {
+        if (starting_address_setted || max_length_setted || (region_count != 0) || address_alignment_word ||
+            (argc - param != 1)) {
+            fprintf(fp, "--extract reads one file and can't be used with -s, -l, -R or -a\n");
+            exit(1);
+        }
+        ExtractGetRange(&starting_address, &max_length);
+        starting_address_setted = true;
+        max_length_setted = true;
+    }
+    if ((PagesTableSet() && !PagesEnabled()) || (PagesEnabled() && (region_count != 0))) {
+        fprintf(fp, "--pages-at needs --pages, --pages can't be used with -R\n");
+        exit(1);
+    }
+
+    return param;
+}
+
+/* First character of the records: ':' for Intel HEX, 'S' for S-records */
+int FirstRecordCharacter(FILE *in)
+{
+    int c;
+
+    do {
+        c = getc(in);
+    } while ((c != EOF) && isspace(c));
+    if (c != EOF) {
+        ungetc(c, in);
+    }
+    return c;
+}
+
+/*
+ * Several input files, read one after the other into the same single pass
+ * image (or into the regions): a file written later is kept where the
+ * files overlap. Each file is decoded by read_hex or read_srec, from its
+ * first character; mot2bin has no read_hex.
+ */
+void ReadInputFiles(int count, char *names[], void (*read_hex)(void), void (*read_srec)(void))
+{
+    int i;
+    int c;
+
+    image_file_names = names;
+    image_file_count = (uint32_t)count;
+    image_extent_count = 0;
+
+    for (i = 0; i < count; i++) {
+        if (NoFailOpenInputFile(names[i]) == false) {
+            exit(1);
+        }
+        image_file = (uint32_t)i;
+
+        c = FirstRecordCharacter(file_in);
+        if ((c == ':') && (read_hex != NULL)) {
+            fprintf(fp, "Input file %s: Intel HEX\n", names[i]);
+            read_hex();
+        } else if (c == 'S') {
+            fprintf(fp, "Input file %s: S-records\n", names[i]);
+            read_srec();
+        } else if (c == ':') {
+            fprintf(fp, "Input file %s: Intel HEX is converted by hex2bin\n", names[i]);
+            exit(1);
+        } else if (c == EOF) {
+            fprintf(fp, "Input file %s is empty\n", names[i]);
+        } else {
+            fprintf(fp, "Input file %s: unknown format\n", names[i]);
+            exit(1);
+        }
+
+        ScannerEnd();
+        NoFailCloseInputFile(NULL);
+    }
+}
+
+/*
+ * A file decoded alone into a single pass image, as the base of --delta.
+ * Returns the buffer of the records from *address, of *length bytes (NULL
+ * without records), to release with PoolRelease().
+ */
+uint8_t *ImageDecodeFile(char *name, void (*read_hex)(void), void (*read_srec)(void), uint64_t *address,
+    uint64_t *length)
+{
+    char *names[1];
+    uint8_t *block;
+
+    names[0] = name;
+    ImageBegin(0, 0);
+    ReadInputFiles(1, names, read_hex, read_srec);
+    image_growing = false;
+    image_file_count = 0;
+
+    if (image_allocated == 0) {
+        *address = 0;
+        *length = 0;
+        return NULL;
+    }
+    *address = image_lowest;
+    *length = image_highest - image_lowest + 1;
+    block = image_block;
+    memmove(block, block + (image_lowest - image_base), (size_t)*length);
+
+    image_block = NULL;
+    image_allocated = 0;
+    return block;
 }
 
 FILE *GetInFile(void)
@@ -520,6 +2262,138 @@ FILE *GetInFile(void)
     return file_in;
 }
 
+bool GetInputStdin(void)
+{
+    return input_stdin;
+}
+
+/* The input is read once: stdin or a compressed file */
+bool GetInputStream(void)
+{
+#if !defined(_WIN32)
+    if ((decompressor > 0) || inflater_started) {
+        return true;
+    }
+#endif
+    return input_stdin;
+}
+
+/* A file name ending with .bin is a binary file, not records */
+bool IsBinaryFileName(const char *name)
+{
+    const char *period = strrchr(name, '.');
+
+    return (period != NULL) && (tolower((unsigned char)period[1]) == 'b') &&
+           (tolower((unsigned char)period[2]) == 'i') && (tolower((unsigned char)period[3]) == 'n') &&
+           (period[4] == '\0');
+}
+
+/*
+ * --verify of a binary file: it's checked as it is, from the starting
+ * address (-s, else 0). Returns true when its value is the computed one.
+ */
+bool VerifyBinaryFile(const char *file_name)
+{
+    FILE *in = fopen(file_name, "rb");
+    uint8_t *block;
+    long length;
+    bool verified;
+
+    if ((in == NULL) || (fseek(in, 0, SEEK_END) != 0) || ((length = ftell(in)) < 0)) {
+        fprintf(fp, "Input file %s cannot be read.\n", file_name);
+        exit(1);
+    }
+    rewind(in);
+    if (length == 0) {
+        fprintf(fp, "Input file %s is empty\n", file_name);
+        fclose(in);
+        return false;
+    }
+
+    StatsBegin(STATS_DECODE);
+    block = PoolAlloc((uint64_t)length, NULL);
+    if (fread(block, 1, (size_t)length, in) != (size_t)length) {
+        fprintf(fp, "Input file %s cannot be read.\n", file_name);
+        exit(1);
+    }
+    fclose(in);
+    STATS_ADD_PHASE(input_bytes, (uint64_t)length);
+    StatsEnd();
+
+    g_lowest_address = starting_address_setted ? starting_address : 0;
+    g_highest_address = g_lowest_address + (uint64_t)length - 1;
+    max_length = (uint64_t)length;
+    fprintf(fp, "Binary file %s: 0x%08" PRIX64 "-0x%08" PRIX64 "\n", file_name, g_lowest_address, g_highest_address);
+
+    StatsBegin(STATS_CHECK);
+    verified = VerifyMemory(block);
+    StatsEnd();
+    StatsReport();
+
+    PoolRelease(block);
+    return verified;
+}
+
+bool GetVerifyOnly(void)
+{
+    return verify_only;
+}
+
+bool GetOutputStdout(void)
+{
+    return output_stdout;
+}
+
+/* NULL for stdout or before the output file is opened */
+const char *GetOutputFileName(void)
+{
+    return (output_stdout || (output_file_name[0] == '\0')) ? NULL : output_file_name;
+}
+
+/* --watch: the options aren't parsed again by the conversions */
+void SetOptionsParsed(int first_file)
+{
+    options_first_file = first_file;
+}
+
+void SetOutputPatched(bool value)
+{
+    output_patched = value;
+}
+
+/*
+ * True when the binary file is the image byte for byte, from its lowest
+ * address: a record can be patched into it at the offset of its address.
+ */
+bool OutputPatchable(void)
+{
+    return !verify_only && (swap_width == 0) && !address_alignment_word && (region_count == 0) &&
+        !floor_address_setted && !ceiling_address_setted && !CompressEnabled() && !DeltaEnabled() &&
+        !PagesEnabled() && !ExtractEnabled();
+}
+
+/*
+ * True when the options change the image after its records are decoded:
+ * its bounds (-s, -l, -m), the swapped words, the check value or the page
+ * table written in it.
+ */
+bool ImageChangedAfterDecode(void)
+{
+    uint64_t address;
+    uint64_t size;
+
+    return starting_address_setted || max_length_setted || minimum_block_size_setted || (swap_width != 0) ||
+        GetCheckValueRange(&address, &size) || PagesTableSet();
+}
+
+/* Address and length of the image written by WriteOutFile(), without the padding; false if none */
+bool GetImageWritten(uint64_t *address, uint64_t *length)
+{
+    *address = written_address;
+    *length = written_length;
+    return image_written;
+}
+
 bool GetAddressAlignmentWord(void)
 {
     return address_alignment_word;
@@ -553,7 +2427,7 @@ bool check_floor_address(void)
         /* Discard if lower than floor_address */
         if (g_phys_addr < (floor_address - starting_address)) {
             if (verbose_flag) {
-                fprintf(fp, "Discard physical address less than %08X\n",
+                fprintf(fp, "Discard physical address less than %08" PRIX64 "\n",
                     floor_address - starting_address);
             }
             flag = false;
@@ -563,7 +2437,7 @@ bool check_floor_address(void)
     return flag;
 }
 
-bool check_ceiling_address(uint32_t temp)
+bool check_ceiling_address(uint64_t temp)
 {
     bool flag = true;
 
@@ -571,7 +2445,7 @@ bool check_ceiling_address(uint32_t temp)
         /* Discard if higher than ceiling_address */
         if (temp > (ceiling_address + starting_address)) {
             if (verbose_flag) {
-                fprintf(fp, "Discard physical address more than %08X\n",
+                fprintf(fp, "Discard physical address more than %08" PRIX64 "\n",
                     ceiling_address + starting_address);
             }
             flag = false;
@@ -580,3 +2454,26 @@ bool check_ceiling_address(uint32_t temp)
 
     return flag;
 }
+
+/*
+ * Clips the bytes first..last to the floor and ceiling addresses; false if
+ * none is left. Unlike the checks above, it doesn't depend on the starting
+ * address, which the allocation sets between the two passes.
+ */
+bool ClipFloorCeiling(uint64_t *first, uint64_t *last)
+{
+    if (floor_address_setted && (*first < floor_address)) {
+        if (*last < floor_address) {
+            return false;
+        }
+        *first = floor_address;
+    }
+    if (ceiling_address_setted && (*last > ceiling_address)) {
+        if (*first > ceiling_address) {
+            return false;
+        }
+        *last = ceiling_address;
+    }
+
+    return true;
+}
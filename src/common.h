@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 
 /* FIXME how to get it from the system/OS? */
@@ -21,9 +22,9 @@ extern const char *program_name;
 extern FILE *fp;
 
 /* This will hold binary codes translated from hex file. */
-extern uint32_t g_lowest_address;
-extern uint32_t g_highest_address;
-extern uint32_t g_phys_addr;
+extern uint64_t g_lowest_address;
+extern uint64_t g_highest_address;
+extern uint64_t g_phys_addr;
 extern bool verbose_flag;
 
 extern void usage(const char *func, uint32_t line);
@@ -31,23 +32,50 @@ extern bool NoFailOpenInputFile(char *file_name);
 extern void NoFailCloseInputFile(char *file_name);
 extern void NoFailOpenOutputFile(char *file_name);
 extern void NoFailCloseOutputFile(char *file_name);
-extern void GetLine(char *str, FILE *in);
+extern bool GetHexDigits(const char *str, uint32_t digits, uint32_t *value);
 extern void GetFilename(char *dest, char *src);
 extern void PutExtension(char *file_name, char *extension);
 
 extern void VerifyRangeFloorCeil(void);
+extern uint8_t *AllocateImage(uint64_t length, int pad);
 extern void Allocate_Memory_And_Rewind(uint8_t **memory_block);
+extern void ImageBegin(uint64_t record_count, uint64_t max_size);
+extern uint64_t ImageEnd(uint8_t **memory_block);
+extern void ImageAbort(void);
+extern uint32_t DecodeHexData(const char *p, uint8_t *data, uint32_t nb_bytes);
 extern char *ReadDataBytes(char *p, uint8_t *memory_block, uint8_t *cs, uint16_t record_nb, uint32_t nb_bytes);
+extern void SwapWords(uint8_t *memory_block);
+extern void WriteDataBytes(const uint8_t *data, uint8_t *memory_block, uint64_t nb_bytes);
 extern void WriteOutFile(uint8_t **memory_block);
-extern void ParseOptions(int argc, char *argv[]);
+extern bool RegionsDefined(void);
+extern void RegionsWriteOutFiles(const char *file_name, const char *extension);
+extern int ParseOptions(int argc, char *argv[]);
+extern int FirstRecordCharacter(FILE *in);
+extern void ReadInputFiles(int count, char *names[], void (*read_hex)(void), void (*read_srec)(void));
+extern bool ImageChangedAfterDecode(void);
+extern uint8_t *ImageDecodeFile(char *name, void (*read_hex)(void), void (*read_srec)(void), uint64_t *address,
+    uint64_t *length);
+
+extern bool IsBinaryFileName(const char *name);
+extern bool VerifyBinaryFile(const char *file_name);
 
 extern FILE *GetInFile(void);
+extern bool GetInputStdin(void);
+extern bool GetInputStream(void);
+extern bool GetOutputStdout(void);
+extern bool GetVerifyOnly(void);
+extern const char *GetOutputFileName(void);
 extern bool GetAddressAlignmentWord(void);
 extern bool GetStatusChecksumError(void);
 extern void SetStatusChecksumError(bool value);
 extern bool GetEnableChecksumError(void);
 extern int GetPadByte(void);
+extern void SetOptionsParsed(int first_file);
+extern void SetOutputPatched(bool value);
+extern bool OutputPatchable(void);
+extern bool GetImageWritten(uint64_t *address, uint64_t *length);
 extern bool check_floor_address(void);
-extern bool check_ceiling_address(uint32_t temp);
+extern bool check_ceiling_address(uint64_t temp);
+extern bool ClipFloorCeiling(uint64_t *first, uint64_t *last);
 
 #endif
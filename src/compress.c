@@ -0,0 +1,310 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Compressed binary files (--compress=gzip or zstd).
+
+  gzip is written here with zlib: the image is cut in blocks of
+  COMPRESS_BLOCK_SIZE bytes compressed by several threads, each block in
+  its own gzip member. gzip -d reads the members one after the other, and
+  a reader can decompress a block from its member alone. A block of pad
+  bytes is compressed once, its member is written again for the others:
+  the padding of a sparse image costs a comparison.
+
+  zstd is written by the zstd program, with its threads (-T0), from a
+  pipe.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "stats.h"
+#include "arena.h"
+#include "compress.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#endif
+
+#define COMPRESS_BLOCK_SIZE (1024 * 1024)
+#define MAX_COMPRESS_THREADS 8
+
+static enum CompressMode compress_mode = COMPRESS_NONE;
+
+bool CompressSetMode(const char *name)
+{
+    if (strcmp(name, "gzip") == 0) {
+        compress_mode = COMPRESS_GZIP;
+    } else if (strcmp(name, "zstd") == 0) {
+        compress_mode = COMPRESS_ZSTD;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool CompressEnabled(void)
+{
+    return compress_mode != COMPRESS_NONE;
+}
+
+/* Extension added to the name of the binary file */
+const char *CompressExtension(void)
+{
+    return (compress_mode == COMPRESS_GZIP) ? "gz" : "zst";
+}
+
+static void NoFailWrite(FILE *out, const void *data, size_t length)
+{
+    if ((length != 0) && (fwrite(data, 1, length, out) != length)) {
+        fprintf(fp, "Output file cannot be written.\n");
+        exit(1);
+    }
+}
+
+#if !defined(_WIN32)
+struct CompressJob {
+    const uint8_t *data;
+    size_t length;
+    uint8_t *out;
+    size_t out_length; /* capacity, then length of the member */
+    bool failed;
+};
+
+/* One block in one gzip member */
+static void *CompressThread(void *arg)
+{
+    struct CompressJob *job = (struct CompressJob *)arg;
+    z_stream stream;
+
+    memset(&stream, 0, sizeof(stream));
+    job->failed = true;
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    stream.next_in = (Bytef *)job->data;
+    stream.avail_in = (uInt)job->length;
+    stream.next_out = job->out;
+    stream.avail_out = (uInt)job->out_length;
+    if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+        job->out_length = stream.total_out;
+        job->failed = false;
+    }
+    deflateEnd(&stream);
+    return NULL;
+}
+
+/*
+ * Block of the image followed by pad_length pad bytes, from offset: in the
+ * image, in the pad block, or copied in mixed when it has both.
+ */
+static const uint8_t *StreamBlock(const uint8_t *data, uint64_t length, const uint8_t *pad_block, uint8_t *mixed,
+    uint64_t offset, size_t size)
+{
+    size_t in_data;
+
+    if (offset + size <= length) {
+        return data + offset;
+    }
+    if (offset >= length) {
+        return pad_block;
+    }
+    in_data = (size_t)(length - offset);
+    memcpy(mixed, data + offset, in_data);
+    memcpy(mixed + in_data, pad_block, size - in_data);
+    return mixed;
+}
+
+static void WriteGzip(FILE *out, const uint8_t *data, uint64_t length, uint64_t pad_length, int pad)
+{
+    pthread_t threads[MAX_COMPRESS_THREADS];
+    struct CompressJob jobs[MAX_COMPRESS_THREADS];
+    bool started[MAX_COMPRESS_THREADS];
+    struct CompressJob pad_member;
+    uint8_t *pad_block = (uint8_t *)ArenaAlloc(COMPRESS_BLOCK_SIZE);
+    uint8_t *mixed = (uint8_t *)ArenaAlloc(COMPRESS_BLOCK_SIZE);
+    size_t bound = (size_t)compressBound(COMPRESS_BLOCK_SIZE) + 64;
+    uint64_t total = length + pad_length;
+    uint64_t offset = 0;
+    uint64_t pad_blocks = 0;
+    uint64_t written = 0;
+    long nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long nb_jobs;
+    long i;
+
+    if (nb_threads < 1) {
+        nb_threads = 1;
+    } else if (nb_threads > MAX_COMPRESS_THREADS) {
+        nb_threads = MAX_COMPRESS_THREADS;
+    }
+    memset(pad_block, pad, COMPRESS_BLOCK_SIZE);
+    for (i = 0; i < nb_threads; i++) {
+        jobs[i].out = (uint8_t *)ArenaAlloc(bound);
+    }
+
+    /* The member of a whole block of pad bytes */
+    pad_member.data = pad_block;
+    pad_member.length = COMPRESS_BLOCK_SIZE;
+    pad_member.out = (uint8_t *)ArenaAlloc(bound);
+    pad_member.out_length = bound;
+    CompressThread(&pad_member);
+
+    while (offset < total) {
+        /* The next blocks that aren't padding, one for each thread */
+        nb_jobs = 0;
+        while ((offset < total) && (nb_jobs < nb_threads)) {
+            size_t size = (total - offset < COMPRESS_BLOCK_SIZE) ? (size_t)(total - offset) : COMPRESS_BLOCK_SIZE;
+            const uint8_t *block = StreamBlock(data, length, pad_block, mixed, offset, size);
+
+            if ((size == COMPRESS_BLOCK_SIZE) && !pad_member.failed &&
+                ((block == pad_block) || (memcmp(block, pad_block, size) == 0))) {
+                /* Written in order, after the blocks before it */
+                if (nb_jobs != 0) {
+                    break;
+                }
+                NoFailWrite(out, pad_member.out, pad_member.out_length);
+                written += pad_member.out_length;
+                pad_blocks++;
+                offset += size;
+                continue;
+            }
+            /* The mixed buffer is used by one block at a time */
+            if ((block == mixed) && (nb_jobs != 0)) {
+                break;
+            }
+            jobs[nb_jobs].data = block;
+            jobs[nb_jobs].length = size;
+            jobs[nb_jobs].out_length = bound;
+            nb_jobs++;
+            offset += size;
+            if (block == mixed) {
+                break;
+            }
+        }
+
+        /* If a thread can't be started, this one does the work */
+        for (i = 0; i < nb_jobs; i++) {
+            started[i] = (nb_jobs > 1) && (pthread_create(&threads[i], NULL, CompressThread, &jobs[i]) == 0);
+            if (started[i] == false) {
+                CompressThread(&jobs[i]);
+            }
+        }
+        for (i = 0; i < nb_jobs; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+            if (jobs[i].failed) {
+                fprintf(fp, "Output file: gzip compression failed.\n");
+                exit(1);
+            }
+            NoFailWrite(out, jobs[i].out, jobs[i].out_length);
+            written += jobs[i].out_length;
+        }
+    }
+
+    fprintf(fp, "gzip: %" PRIu64 " bytes in %" PRIu64 " bytes, %" PRIu64 " blocks of padding\n", total, written,
+        pad_blocks);
+}
+
+/* The zstd program compresses the image from a pipe into the output file */
+static void WriteZstd(FILE *out, const uint8_t *data, uint64_t length, uint64_t pad_length, int pad)
+{
+    uint8_t *pad_block;
+    FILE *pipe_out;
+    int fds[2];
+    pid_t pid;
+    int status;
+    size_t size;
+
+    fflush(out);
+    fflush(fp);
+    if (pipe(fds) != 0) {
+        fprintf(fp, "Output file: no pipe for zstd.\n");
+        exit(1);
+    }
+    pid = fork();
+    if (pid < 0) {
+        fprintf(fp, "Output file: zstd can't be started.\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        dup2(fds[0], STDIN_FILENO);
+        dup2(fileno(out), STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp("zstd", "zstd", "-q", "-T0", "-c", (char *)NULL);
+        _exit(127);
+    }
+    close(fds[0]);
+
+    pipe_out = fdopen(fds[1], "w");
+    if (pipe_out == NULL) {
+        fprintf(fp, "Output file: no pipe for zstd.\n");
+        exit(1);
+    }
+    NoFailWrite(pipe_out, data, (size_t)length);
+    if (pad_length != 0) {
+        pad_block = (uint8_t *)ArenaAlloc(COMPRESS_BLOCK_SIZE);
+        memset(pad_block, pad, COMPRESS_BLOCK_SIZE);
+        while (pad_length != 0) {
+            size = (pad_length < COMPRESS_BLOCK_SIZE) ? (size_t)pad_length : COMPRESS_BLOCK_SIZE;
+            NoFailWrite(pipe_out, pad_block, size);
+            pad_length -= size;
+        }
+    }
+    fclose(pipe_out);
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = 1;
+            break;
+        }
+    }
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        fprintf(fp, "Output file: zstd failed.\n");
+        exit(1);
+    }
+    /* The output file was written by zstd, after the data already there */
+    fseek(out, 0, SEEK_END);
+}
+#endif
+
+/* The image, then pad_length pad bytes, compressed into out */
+void CompressWrite(FILE *out, const uint8_t *data, uint64_t length, uint64_t pad_length, int pad)
+{
+#if !defined(_WIN32)
+    if (compress_mode == COMPRESS_GZIP) {
+        WriteGzip(out, data, length, pad_length, pad);
+    } else {
+        WriteZstd(out, data, length, pad_length, pad);
+    }
+#else
+    fprintf(fp, "--compress isn't available on Windows.\n");
+    exit(1);
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Compression of the binary files, --compress=gzip|zstd */
+enum CompressMode {
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+};
+
+extern bool CompressSetMode(const char *name);
+extern bool CompressEnabled(void);
+extern const char *CompressExtension(void);
+extern void CompressWrite(FILE *out, const uint8_t *data, uint64_t length, uint64_t pad_length, int pad);
+
+#endif
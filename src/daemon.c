@@ -0,0 +1,636 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Resident converter, on a UNIX socket.
+
+  The client sends its arguments with 4 file descriptors: its current
+  directory, stdin, stdout and stderr. The server forks a process for the
+  conversion, which goes to that directory and converts with these files,
+  so log.txt and the output files are where the converter would write
+  them. The exit status of the conversion is sent back to the client.
+
+  The output and log.txt of the last conversions are kept, by options and
+  input file (device, inode, size and modification time): the same
+  conversion of the same file writes them again without converting.
+*/
+#if defined(__linux__)
+#define _GNU_SOURCE
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "stats.h"
+#include "delta.h"
+#include "daemon.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define DAEMON_MAGIC 0x44423248 /* "H2BD" */
+#define DAEMON_FDS 4            /* current directory, stdin, stdout, stderr */
+#define DAEMON_MAX_ARGS 256
+#define DAEMON_MAX_REQUEST 0x10000
+#define DAEMON_TIMEOUT 5 /* seconds, to receive a request */
+
+#define CACHE_ENTRIES 8
+#define CACHE_MAX_ENTRY (16 * 1024 * 1024) /* output and log.txt */
+
+struct DaemonRequest {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t length; /* of the arguments, each one ended by '\0' */
+};
+
+struct CacheEntry {
+    char *options; /* arguments after the program name */
+    uint32_t options_length;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    char *output_name;
+    uint8_t *output;
+    uint64_t output_length;
+    uint8_t *log;
+    uint64_t log_length;
+    uint64_t last_use; /* 0: free entry */
+};
+
+static struct CacheEntry cache[CACHE_ENTRIES];
+static uint64_t cache_clock = 0;
+static int listen_fd = -1;
+
+static bool WriteAll(int fd, const void *data, uint64_t length)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, p, (length > 0x40000000) ? 0x40000000 : (size_t)length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        length -= (uint64_t)written;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void *data, uint64_t length)
+{
+    uint8_t *p = (uint8_t *)data;
+    ssize_t got;
+
+    while (length > 0) {
+        got = read(fd, p, (length > 0x40000000) ? 0x40000000 : (size_t)length);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (got == 0) {
+            return false;
+        }
+        p += got;
+        length -= (uint64_t)got;
+    }
+    return true;
+}
+
+/* A file, in a buffer of NoFailMalloc(); NULL if it can't be read or is too long */
+static uint8_t *ReadWholeFile(const char *name, uint64_t *length)
+{
+    struct stat st;
+    uint8_t *data;
+    int fd = open(name, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || ((uint64_t)st.st_size > CACHE_MAX_ENTRY)) {
+        close(fd);
+        return NULL;
+    }
+    *length = (uint64_t)st.st_size;
+    data = (uint8_t *)NoFailMalloc((size_t)*length + 1);
+    if (!ReadAll(fd, data, *length)) {
+        free(data);
+        data = NULL;
+    }
+    close(fd);
+    return data;
+}
+
+static bool WriteBlob(int fd, const void *data, uint64_t length)
+{
+    return WriteAll(fd, &length, sizeof(length)) && WriteAll(fd, data, length);
+}
+
+/*
+ * In the conversion process, after a conversion without error: its output
+ * file and log.txt, for the cache of the server. Nothing is sent when the
+ * conversion doesn't give the same files each time.
+ */
+static void SendResult(int fd)
+{
+    const char *output_name = GetOutputFileName();
+    uint8_t *output;
+    uint8_t *log;
+    uint64_t output_length;
+    uint64_t log_length;
+
+    if (GetInputStdin() || GetOutputStdout() || RegionsDefined() || StatsEnabled() || DeltaEnabled() || PagesEnabled() ||
+        (output_name == NULL)) {
+        return;
+    }
+    output = ReadWholeFile(output_name, &output_length);
+    log = ReadWholeFile("log.txt", &log_length);
+    if ((output != NULL) && (log != NULL) && (output_length + log_length <= CACHE_MAX_ENTRY)) {
+        if (WriteBlob(fd, output_name, strlen(output_name) + 1)) {
+            if (WriteBlob(fd, output, output_length)) {
+                WriteBlob(fd, log, log_length);
+            }
+        }
+    }
+    free(output);
+    free(log);
+}
+
+/* A blob sent by SendResult(); false at the end of the data */
+static bool ReadBlob(int fd, uint8_t **data, uint64_t *length)
+{
+    if (!ReadAll(fd, length, sizeof(*length)) || (*length > CACHE_MAX_ENTRY)) {
+        return false;
+    }
+    *data = (uint8_t *)NoFailMalloc((size_t)*length + 1);
+    if (!ReadAll(fd, *data, *length)) {
+        free(*data);
+        *data = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void CacheFree(struct CacheEntry *entry)
+{
+    free(entry->options);
+    free(entry->output_name);
+    free(entry->output);
+    free(entry->log);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static struct CacheEntry *CacheFind(const char *options, uint32_t options_length, const struct stat *st)
+{
+    int i;
+
+    for (i = 0; i < CACHE_ENTRIES; i++) {
+        struct CacheEntry *entry = &cache[i];
+
+        if ((entry->last_use != 0) && (entry->options_length == options_length) && (entry->dev == st->st_dev) &&
+            (entry->ino == st->st_ino) && (entry->size == st->st_size) &&
+            (entry->mtime.tv_sec == st->st_mtim.tv_sec) && (entry->mtime.tv_nsec == st->st_mtim.tv_nsec) &&
+            (memcmp(entry->options, options, options_length) == 0)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Replaces the free or least recently used entry */
+static struct CacheEntry *CacheNew(void)
+{
+    struct CacheEntry *oldest = &cache[0];
+    int i;
+
+    for (i = 0; i < CACHE_ENTRIES; i++) {
+        if (cache[i].last_use < oldest->last_use) {
+            oldest = &cache[i];
+        }
+    }
+    CacheFree(oldest);
+    return oldest;
+}
+
+static bool WriteFileAt(int dir_fd, const char *name, const uint8_t *data, uint64_t length)
+{
+    int fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool result;
+
+    if (fd < 0) {
+        return false;
+    }
+    result = WriteAll(fd, data, length);
+    return (close(fd) == 0) && result;
+}
+
+/* Conversion in a child process; returns its exit status */
+static int RunConversion(int fds[DAEMON_FDS], int argc, char *argv[], int (*convert)(int argc, char *argv[]),
+    struct CacheEntry *entry)
+{
+    int result_pipe[2];
+    uint8_t *output_name;
+    uint64_t length;
+    pid_t pid;
+    int status;
+    int i;
+
+    if (pipe(result_pipe) != 0) {
+        return 1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        close(listen_fd);
+        close(result_pipe[0]);
+        signal(SIGPIPE, SIG_DFL);
+        if (fchdir(fds[0]) != 0) {
+            _exit(1);
+        }
+        for (i = 1; i < DAEMON_FDS; i++) {
+            dup2(fds[i], i - 1);
+        }
+        for (i = 0; i < DAEMON_FDS; i++) {
+            if (fds[i] > 2) {
+                close(fds[i]);
+            }
+        }
+        status = convert(argc, argv);
+        if ((status == 0) && (entry != NULL)) {
+            SendResult(result_pipe[1]);
+        }
+        exit(status);
+    }
+
+    close(result_pipe[1]);
+    if (entry != NULL) {
+        if (ReadBlob(result_pipe[0], &output_name, &length)) {
+            entry->output_name = (char *)output_name;
+            if (!ReadBlob(result_pipe[0], &entry->output, &entry->output_length) ||
+                !ReadBlob(result_pipe[0], &entry->log, &entry->log_length)) {
+                entry->log = NULL;
+            }
+        }
+    }
+    close(result_pipe[0]);
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/* The request of a client: its arguments and files */
+static void Serve(int connection, int (*convert)(int argc, char *argv[]))
+{
+    struct DaemonRequest request;
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(DAEMON_FDS * sizeof(int))];
+    } control;
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct timeval timeout;
+    struct CacheEntry *entry = NULL;
+    struct stat st;
+    char *arguments = NULL;
+    char *argv[DAEMON_MAX_ARGS + 1];
+    int fds[DAEMON_FDS];
+    int nb_fds = 0;
+    int32_t status = 1;
+    ssize_t received;
+    uint32_t argc = 0;
+    uint32_t i;
+    char *p;
+#if defined(SO_PEERCRED)
+    struct ucred credentials;
+    socklen_t credentials_length = sizeof(credentials);
+#endif
+
+    /*
+     * The jobs are served one at a time: a client that doesn't send its
+     * request doesn't keep the others waiting.
+     */
+    timeout.tv_sec = DAEMON_TIMEOUT;
+    timeout.tv_usec = 0;
+    if (setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+        return;
+    }
+
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    received = recvmsg(connection, &message, MSG_WAITALL);
+    if (received <= 0) {
+        return;
+    }
+    /* The files of a request cut by the timeout are closed too */
+    for (cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+            nb_fds = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds, CMSG_DATA(cmsg), (size_t)nb_fds * sizeof(int));
+        }
+    }
+    if (received != (ssize_t)sizeof(request)) {
+        goto done;
+    }
+
+#if defined(SO_PEERCRED)
+    /* The files are written by the user of the server, for this user only */
+    if ((getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) != 0) ||
+        (credentials.uid != getuid())) {
+        goto done;
+    }
+#endif
+    if ((nb_fds != DAEMON_FDS) || (request.magic != DAEMON_MAGIC) || (request.argc == 0) ||
+        (request.argc > DAEMON_MAX_ARGS) || (request.length > DAEMON_MAX_REQUEST)) {
+        goto done;
+    }
+
+    arguments = (char *)NoFailMalloc(request.length + 1);
+    if (!ReadAll(connection, arguments, request.length)) {
+        goto done;
+    }
+    arguments[request.length] = '\0';
+    for (p = arguments; (p < arguments + request.length) && (argc < request.argc); p += strlen(p) + 1) {
+        argv[argc++] = p;
+    }
+    if ((argc != request.argc) || (p != arguments + request.length)) {
+        goto done;
+    }
+    argv[argc] = NULL;
+
+    /*
+     * The options, after the program name, and the input file are the key of
+     * the cache. Several input files are converted without the cache.
+     */
+    if ((argc > 1) && (strcmp(argv[argc - 1], "-") != 0) &&
+        ((argc < 3) || (fstatat(fds[0], argv[argc - 2], &st, 0) != 0) || !S_ISREG(st.st_mode)) &&
+        (fstatat(fds[0], argv[argc - 1], &st, 0) == 0) && S_ISREG(st.st_mode)) {
+        p = argv[1];
+        entry = CacheFind(p, (uint32_t)(arguments + request.length - p), &st);
+        if ((entry != NULL) && WriteFileAt(fds[0], entry->output_name, entry->output, entry->output_length) &&
+            WriteFileAt(fds[0], "log.txt", entry->log, entry->log_length)) {
+            entry->last_use = ++cache_clock;
+            status = 0;
+            goto done;
+        }
+        if (entry != NULL) {
+            CacheFree(entry);
+        }
+
+        entry = CacheNew();
+        entry->options_length = (uint32_t)(arguments + request.length - p);
+        entry->options = (char *)NoFailMalloc(entry->options_length);
+        memcpy(entry->options, p, entry->options_length);
+        entry->dev = st.st_dev;
+        entry->ino = st.st_ino;
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtim;
+        entry->last_use = ++cache_clock;
+    }
+
+    status = RunConversion(fds, (int)argc, argv, convert, entry);
+    if ((entry != NULL) && ((status != 0) || (entry->log == NULL))) {
+        CacheFree(entry);
+    }
+
+done:
+    WriteAll(connection, &status, sizeof(status));
+    for (i = 0; i < (uint32_t)nb_fds; i++) {
+        close(fds[i]);
+    }
+    free(arguments);
+}
+
+static int DaemonServer(const char *path, int (*convert)(int argc, char *argv[]))
+{
+    struct sockaddr_un address;
+    struct stat st;
+    int connection;
+    mode_t mask;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket name too long: %s\n", path);
+        return 1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    /* The socket of a previous server */
+    if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    mask = umask(077);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror(path);
+        return 1;
+    }
+    umask(mask);
+    if (listen(listen_fd, 64) != 0) {
+        perror("listen");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "%s: serving conversions on %s\n", program_name, path);
+
+    for (;;) {
+        connection = accept(listen_fd, NULL, NULL);
+        if (connection < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED)) {
+                continue;
+            }
+            perror("accept");
+            return 1;
+        }
+        Serve(connection, convert);
+        close(connection);
+    }
+}
+
+/* The conversion by the server; -1 when no server answers */
+static int DaemonClient(const char *path, int argc, char *argv[])
+{
+    struct sockaddr_un address;
+    struct DaemonRequest request;
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(DAEMON_FDS * sizeof(int))];
+    } control;
+    struct msghdr message;
+    struct iovec iov[2];
+    struct cmsghdr *cmsg;
+    char *arguments;
+    uint32_t length = 0;
+    int32_t status;
+    int fds[DAEMON_FDS];
+    int connection;
+    int i;
+
+    if ((strlen(path) >= sizeof(address.sun_path)) || (argc > DAEMON_MAX_ARGS)) {
+        return -1;
+    }
+    for (i = 0; i < argc; i++) {
+        length += (uint32_t)strlen(argv[i]) + 1;
+    }
+    if (length > DAEMON_MAX_REQUEST) {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0) {
+        return -1;
+    }
+    if (connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(connection);
+        return -1;
+    }
+    fds[0] = open(".", O_RDONLY | O_DIRECTORY);
+    if (fds[0] < 0) {
+        close(connection);
+        return -1;
+    }
+    fds[1] = STDIN_FILENO;
+    fds[2] = STDOUT_FILENO;
+    fds[3] = STDERR_FILENO;
+
+    arguments = (char *)NoFailMalloc(length);
+    length = 0;
+    for (i = 0; i < argc; i++) {
+        strcpy(arguments + length, argv[i]);
+        length += (uint32_t)strlen(argv[i]) + 1;
+    }
+    request.magic = DAEMON_MAGIC;
+    request.argc = (uint32_t)argc;
+    request.length = length;
+
+    memset(&message, 0, sizeof(message));
+    memset(&control, 0, sizeof(control));
+    iov[0].iov_base = &request;
+    iov[0].iov_len = sizeof(request);
+    iov[1].iov_base = arguments;
+    iov[1].iov_len = length;
+    message.msg_iov = iov;
+    message.msg_iovlen = 2;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(DAEMON_FDS * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    signal(SIGPIPE, SIG_IGN);
+    if ((sendmsg(connection, &message, 0) != (ssize_t)(sizeof(request) + length)) ||
+        !ReadAll(connection, &status, sizeof(status))) {
+        /* The arguments may be taken by the server: the conversion isn't done again */
+        fprintf(stderr, "%s: no answer from %s\n", program_name, path);
+        status = 1;
+    }
+    free(arguments);
+    close(fds[0]);
+    close(connection);
+    return status;
+}
+#endif
+
+int DaemonMain(int argc, char *argv[], int (*convert)(int argc, char *argv[]))
+{
+    const char *path;
+    int status;
+
+    if ((argc >= 2) && (strncmp(argv[1], "--daemon=", 9) == 0)) {
+#if !defined(_WIN32)
+        if (argc == 2) {
+            return DaemonServer(argv[1] + 9, convert);
+        }
+        fprintf(stderr, "%s: --daemon takes no other argument\n", program_name);
+#else
+        fprintf(stderr, "%s: --daemon isn't supported on Windows\n", program_name);
+#endif
+        return 1;
+    }
+
+    if ((argc >= 2) && (strncmp(argv[1], "--connect=", 10) == 0)) {
+        path = argv[1] + 10;
+        argv[1] = argv[0];
+#if !defined(_WIN32)
+        status = DaemonClient(path, argc - 1, argv + 1);
+#else
+        (void)path;
+        status = -1;
+#endif
+        if (status >= 0) {
+            return status;
+        }
+        /* No server: the conversion is done here */
+        return convert(argc - 1, argv + 1);
+    }
+
+    return convert(argc, argv);
+}
@@ -0,0 +1,13 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/*
+ * Resident converter. main() of each converter calls DaemonMain() with the
+ * conversion: "--daemon=socket" serves conversions on a UNIX socket,
+ * "--connect=socket [options] file" sends the conversion to the server
+ * (or converts it here when no server answers), else the conversion runs
+ * as before.
+ */
+extern int DaemonMain(int argc, char *argv[], int (*convert)(int argc, char *argv[]));
+
+#endif
@@ -0,0 +1,270 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Delta of the binary image against the image of a previous version, for
+  a field update (--delta=base).
+
+  The base is a binary file, at the starting address of the new image, or
+  a file of records decoded alone, at its own addresses; the options that
+  change the image after its records are decoded can't be used with it.
+  The new image is cut in blocks of DELTA_BLOCK_SIZE bytes compared with
+  the base; the blocks that differ, or that the base doesn't cover, are
+  written, with the consecutive ones in one extent. All values are little
+  endian:
+
+  header    "H2DL", version, block size, number of extents (32 bits each),
+            address and length of the base, address and length of the
+            image (64 bits each), CRC-32 of the base and of the image
+  extent    address and length (64 bits each), then for each block its
+            CRC-32 and its bytes; the last block of the image may be short
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "libcrc.h"
+#include "stats.h"
+#include "arena.h"
+#include "delta.h"
+
+#define DELTA_MAGIC "H2DL"
+#define DELTA_VERSION 1
+#define DELTA_BLOCK_SIZE 4096
+#define DELTA_HEADER_SIZE 56
+#define DELTA_EXTENT_SIZE 16
+
+/* Standard CRC-32 of the blocks (IEEE 802.3, as zlib): reflected, initial value and final xor 0xFFFFFFFF */
+#define DELTA_CRC_POLY 0xEDB88320
+
+static const char *delta_base_name = NULL;
+static uint8_t *delta_base = NULL;
+static uint64_t delta_base_address;
+static uint64_t delta_base_length;
+static bool delta_base_placed; /* false for a binary file, placed at the address of the image */
+static uint32_t *crc_table = NULL;
+
+void DeltaSetBase(const char *name)
+{
+    delta_base_name = name;
+}
+
+bool DeltaEnabled(void)
+{
+    return delta_base_name != NULL;
+}
+
+static void ReadBinaryBase(void)
+{
+    FILE *base = fopen(delta_base_name, "rb");
+    long length;
+
+    if ((base == NULL) || (fseek(base, 0, SEEK_END) != 0) || ((length = ftell(base)) < 0)) {
+        fprintf(fp, "Base file %s cannot be read.\n", delta_base_name);
+        exit(1);
+    }
+    rewind(base);
+
+    delta_base_length = (uint64_t)length;
+    if (delta_base_length != 0) {
+        delta_base = PoolAlloc(delta_base_length, NULL);
+        if (fread(delta_base, 1, (size_t)delta_base_length, base) != delta_base_length) {
+            fprintf(fp, "Base file %s cannot be read.\n", delta_base_name);
+            exit(1);
+        }
+    }
+    fclose(base);
+    delta_base_placed = false;
+}
+
+/*
+ * Before the input file is opened: the base image, from a binary file or
+ * decoded by read_hex or read_srec (NULL in elf2bin).
+ */
+void DeltaReadBase(const char *file_name, void (*read_hex)(void), void (*read_srec)(void))
+{
+    char name[MAX_FILE_NAME_SIZE];
+
+    if (RegionsDefined() || (strcmp(file_name, "-") == 0)) {
+        fprintf(fp, "--delta can't be used with -R or stdin\n");
+        exit(1);
+    }
+
+    StatsBegin(STATS_SCAN);
+    if (IsBinaryFileName(delta_base_name)) {
+        ReadBinaryBase();
+    } else if ((read_hex == NULL) && (read_srec == NULL)) {
+        fprintf(fp, "Base file %s: the base of %s is a binary file\n", delta_base_name, program_name);
+        exit(1);
+    } else if (GetAddressAlignmentWord()) {
+        fprintf(fp, "-a needs two passes and can't be used with a base file of records\n");
+        exit(1);
+    } else if (ImageChangedAfterDecode()) {
+        /* The base would be compared before the changes made to the new image */
+        fprintf(fp, "Base file %s: a base of records can't be used with -s, -l, -m, -w, --swap, -f, -F or "
+            "--pages-at, give the binary file of the base\n", delta_base_name);
+        exit(1);
+    } else {
+        GetFilename(name, (char *)delta_base_name);
+        delta_base = ImageDecodeFile(name, read_hex, read_srec, &delta_base_address, &delta_base_length);
+        delta_base_placed = true;
+    }
+    StatsEnd();
+
+    fprintf(fp, "Base file %s: %" PRIu64 " bytes\n\n", delta_base_name, delta_base_length);
+}
+
+static void PutLittleEndian(uint8_t *p, uint64_t value, uint32_t nb_bytes)
+{
+    uint32_t i;
+
+    for (i = 0; i < nb_bytes; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t Crc32(const uint8_t *data, uint64_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint64_t i;
+
+    for (i = 0; i < length; i++) {
+        crc = update_crc32_reflected(crc_table, crc, (char)data[i]);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+/*
+ * The block of the image at address is the same in the base. memcmp() is
+ * vectorized by the C library: the unchanged blocks, padding or data, are
+ * compared at the speed of the memory.
+ */
+static bool BlockUnchanged(const uint8_t *block, uint64_t address, uint64_t length)
+{
+    if ((length > delta_base_length) || (address < delta_base_address) ||
+        (address - delta_base_address > delta_base_length - length)) {
+        return false;
+    }
+    return memcmp(block, delta_base + (address - delta_base_address), (size_t)length) == 0;
+}
+
+static void NoFailWrite(FILE *out, const void *data, uint64_t length, const char *name)
+{
+    if ((length != 0) && (fwrite(data, 1, (size_t)length, out) != length)) {
+        fprintf(fp, "Delta file %s cannot be written.\n", name);
+        exit(1);
+    }
+    STATS_ADD_PHASE(data_bytes, length);
+}
+
+/*
+ * After the check value: the delta of the image of max_length bytes from
+ * g_lowest_address, named after the binary file.
+ */
+void DeltaWrite(const char *file_name, const uint8_t *memory_block)
+{
+    char name[MAX_FILE_NAME_SIZE];
+    uint8_t header[DELTA_HEADER_SIZE];
+    uint8_t extent[DELTA_EXTENT_SIZE];
+    uint8_t crc[4];
+    uint64_t length = g_highest_address - g_lowest_address + 1;
+    uint64_t offset;
+    uint64_t first;
+    uint64_t size;
+    uint32_t extents = 0;
+    uint64_t blocks = 0;
+    uint64_t written = DELTA_HEADER_SIZE;
+    FILE *out;
+
+    if (!delta_base_placed) {
+        delta_base_address = g_lowest_address;
+    }
+    crc_table = ArenaAlloc(256 * 4);
+    init_crc32_reflected_tab(crc_table, DELTA_CRC_POLY);
+
+    GetFilename(name, (char *)file_name);
+    PutExtension(name, "delta");
+    out = fopen(name, "wb");
+    if (out == NULL) {
+        fprintf(fp, "Delta file %s cannot be opened.\n", name);
+        exit(1);
+    }
+
+    /* The header is written again at the end, with the number of extents */
+    memset(header, 0, sizeof(header));
+    NoFailWrite(out, header, sizeof(header), name);
+
+    for (offset = 0; offset < length; ) {
+        size = (length - offset < DELTA_BLOCK_SIZE) ? length - offset : DELTA_BLOCK_SIZE;
+        if (BlockUnchanged(memory_block + offset, g_lowest_address + offset, size)) {
+            offset += size;
+            continue;
+        }
+
+        /* The changed blocks that follow, in one extent */
+        first = offset;
+        do {
+            offset += size;
+            size = (length - offset < DELTA_BLOCK_SIZE) ? length - offset : DELTA_BLOCK_SIZE;
+        } while ((offset < length) && !BlockUnchanged(memory_block + offset, g_lowest_address + offset, size));
+
+        PutLittleEndian(extent, g_lowest_address + first, 8);
+        PutLittleEndian(extent + 8, offset - first, 8);
+        NoFailWrite(out, extent, sizeof(extent), name);
+        for (; first < offset; first += size) {
+            size = (offset - first < DELTA_BLOCK_SIZE) ? offset - first : DELTA_BLOCK_SIZE;
+            PutLittleEndian(crc, Crc32(memory_block + first, size), 4);
+            NoFailWrite(out, crc, sizeof(crc), name);
+            NoFailWrite(out, memory_block + first, size, name);
+            written += sizeof(crc) + size;
+            blocks++;
+        }
+        written += sizeof(extent);
+        extents++;
+    }
+
+    memcpy(header, DELTA_MAGIC, 4);
+    PutLittleEndian(header + 4, DELTA_VERSION, 4);
+    PutLittleEndian(header + 8, DELTA_BLOCK_SIZE, 4);
+    PutLittleEndian(header + 12, extents, 4);
+    PutLittleEndian(header + 16, delta_base_address, 8);
+    PutLittleEndian(header + 24, delta_base_length, 8);
+    PutLittleEndian(header + 32, g_lowest_address, 8);
+    PutLittleEndian(header + 40, length, 8);
+    PutLittleEndian(header + 48, Crc32(delta_base, delta_base_length), 4);
+    PutLittleEndian(header + 52, Crc32(memory_block, length), 4);
+    if ((fseek(out, 0, SEEK_SET) != 0) || (fwrite(header, 1, sizeof(header), out) != sizeof(header)) ||
+        (fclose(out) != 0)) {
+        fprintf(fp, "Delta file %s cannot be written.\n", name);
+        exit(1);
+    }
+
+    fprintf(fp, "Delta file %s: %" PRIu32 " extents, %" PRIu64 " changed blocks of %d bytes, %" PRIu64 " bytes\n\n",
+        name, extents, blocks, DELTA_BLOCK_SIZE, written);
+
+    if (delta_base != NULL) {
+        PoolRelease(delta_base);
+        delta_base = NULL;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Delta of the binary image against a base image (--delta=base): the
+ * blocks that changed, with a CRC-32 for each one, in a file named after
+ * the binary file with the extension "delta".
+ */
+extern void DeltaSetBase(const char *name);
+extern bool DeltaEnabled(void);
+extern void DeltaReadBase(const char *file_name, void (*read_hex)(void), void (*read_srec)(void));
+extern void DeltaWrite(const char *file_name, const uint8_t *memory_block);
+
+#endif
@@ -0,0 +1,932 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Digests of the check range: SHA-256, BLAKE3 (32 bytes) and XXH3 (64
+  bits, seed 0). Each one has a portable version; on x86 the SHA
+  extensions and AVX2 are used when cpuid reports them. BLAKE3 hashes 8
+  chunks at once, and the subtrees of a large range in several threads.
+*/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "digest.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIGEST_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define CPU_SHA 1
+#define CPU_AVX2 2
+
+/* Below this size, a subtree isn't given to another thread */
+#define BLAKE3_PARALLEL_SIZE 0x100000
+#define MAX_DIGEST_THREADS 8
+
+static int cpu_features = -1;
+
+static inline uint32_t Load32Le(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t Load64Le(const uint8_t *p)
+{
+    return (uint64_t)Load32Le(p) | ((uint64_t)Load32Le(p + 4) << 32);
+}
+
+static inline uint32_t Load32Be(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void Store32Le(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static inline void Store32Be(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static inline uint32_t Rotr32(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint64_t Rotl64(uint64_t x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+/* CPU_SHA and CPU_AVX2, read once */
+static int CpuFeatures(void)
+{
+#if defined(DIGEST_X86)
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int xcr0_low;
+    unsigned int xcr0_high;
+    bool os_avx;
+
+    if (cpu_features >= 0) {
+        return cpu_features;
+    }
+    cpu_features = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)) {
+        return cpu_features;
+    }
+    os_avx = false;
+    if (ecx & bit_OSXSAVE) {
+        /* The OS saves the AVX registers */
+        __asm__ volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+        os_avx = ((xcr0_low & 6) == 6);
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        if (ebx & bit_SHA) {
+            cpu_features |= CPU_SHA;
+        }
+        if ((ebx & bit_AVX2) && os_avx) {
+            cpu_features |= CPU_AVX2;
+        }
+    }
+#else
+    cpu_features = 0;
+#endif
+    return cpu_features;
+}
+
+static int DigestThreads(uint64_t length)
+{
+#if !defined(_WIN32)
+    long nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if ((length < 2 * BLAKE3_PARALLEL_SIZE) || (nb_threads <= 1)) {
+        return 1;
+    }
+    return (nb_threads > MAX_DIGEST_THREADS) ? MAX_DIGEST_THREADS : (int)nb_threads;
+#else
+    (void)length;
+    return 1;
+#endif
+}
+
+/* SHA-256 (FIPS 180-4) */
+
+static const uint32_t sha256_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static void Sha256BlocksPortable(uint32_t state[8], const uint8_t *data, uint64_t blocks)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+    uint32_t t1, t2;
+    int i;
+
+    while (blocks--) {
+        for (i = 0; i < 16; i++) {
+            w[i] = Load32Be(data + 4 * i);
+        }
+        for (i = 16; i < 64; i++) {
+            w[i] = (Rotr32(w[i - 2], 17) ^ Rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+                (Rotr32(w[i - 15], 7) ^ Rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+        for (i = 0; i < 64; i++) {
+            t1 = h + (Rotr32(e, 6) ^ Rotr32(e, 11) ^ Rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            t2 = (Rotr32(a, 2) ^ Rotr32(a, 13) ^ Rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += 64;
+    }
+}
+
+#if defined(DIGEST_X86)
+/* The SHA extensions do 2 rounds by instruction, the state is kept as ABEF and CDGH */
+__attribute__((target("sha,sse4.1"))) static void Sha256BlocksShaNi(uint32_t state[8], const uint8_t *data,
+    uint64_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    __m128i state0, state1, abef, cdgh;
+    __m128i msg[4];
+    __m128i rounds, tmp;
+    int i;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (blocks--) {
+        abef = state0;
+        cdgh = state1;
+
+        for (i = 0; i < 4; i++) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), mask);
+        }
+
+        /* 4 rounds by step: msg[i % 4] holds the words of the step */
+        for (i = 0; i < 16; i++) {
+            rounds = _mm_add_epi32(msg[i % 4], _mm_loadu_si128((const __m128i *)&sha256_k[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, rounds);
+            if ((i >= 3) && (i <= 14)) {
+                tmp = _mm_alignr_epi8(msg[i % 4], msg[(i + 3) % 4], 4);
+                msg[(i + 1) % 4] = _mm_add_epi32(msg[(i + 1) % 4], tmp);
+                msg[(i + 1) % 4] = _mm_sha256msg2_epu32(msg[(i + 1) % 4], msg[i % 4]);
+            }
+            rounds = _mm_shuffle_epi32(rounds, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, rounds);
+            if ((i >= 1) && (i <= 12)) {
+                msg[(i + 3) % 4] = _mm_sha256msg1_epu32(msg[(i + 3) % 4], msg[i % 4]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i *)&state[0], state0);
+    _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+#endif
+
+void Sha256(const uint8_t *data, uint64_t length, uint8_t digest[SHA256_SIZE])
+{
+    void (*blocks_function)(uint32_t state[8], const uint8_t *data, uint64_t blocks) = Sha256BlocksPortable;
+    uint32_t state[8];
+    uint8_t tail[128];
+    uint64_t blocks = length / 64;
+    uint64_t rest = length % 64;
+    uint64_t bits = length * 8;
+    uint64_t tail_blocks = (rest < 56) ? 1 : 2;
+    int i;
+
+#if defined(DIGEST_X86)
+    if (CpuFeatures() & CPU_SHA) {
+        blocks_function = Sha256BlocksShaNi;
+    }
+#endif
+
+    memcpy(state, sha256_iv, sizeof(state));
+    blocks_function(state, data, blocks);
+
+    /* Padding: 0x80, zeros and the length in bits */
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, data + 64 * blocks, (size_t)rest);
+    tail[rest] = 0x80;
+    Store32Be(tail + 64 * tail_blocks - 8, (uint32_t)(bits >> 32));
+    Store32Be(tail + 64 * tail_blocks - 4, (uint32_t)bits);
+    blocks_function(state, tail, tail_blocks);
+
+    for (i = 0; i < 8; i++) {
+        Store32Be(digest + 4 * i, state[i]);
+    }
+}
+
+/* BLAKE3: a tree of 1 KB chunks, left subtrees of a power of 2 chunks */
+
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_LANES 8
+#define BLAKE3_CHUNK_START 1
+#define BLAKE3_CHUNK_END 2
+#define BLAKE3_PARENT 4
+#define BLAKE3_ROOT 8
+
+static const uint8_t blake3_schedule[7][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 }
+};
+
+#define BLAKE3_ROUND(G, v, m, s)             \
+    do {                                     \
+        G(v, 0, 4, 8, 12, m, s[0], s[1]);   \
+        G(v, 1, 5, 9, 13, m, s[2], s[3]);   \
+        G(v, 2, 6, 10, 14, m, s[4], s[5]);  \
+        G(v, 3, 7, 11, 15, m, s[6], s[7]);  \
+        G(v, 0, 5, 10, 15, m, s[8], s[9]);  \
+        G(v, 1, 6, 11, 12, m, s[10], s[11]); \
+        G(v, 2, 7, 8, 13, m, s[12], s[13]);  \
+        G(v, 3, 4, 9, 14, m, s[14], s[15]);  \
+    } while (0)
+
+static inline void Blake3G(uint32_t v[16], int a, int b, int c, int d, const uint32_t m[16], int x, int y)
+{
+    v[a] = v[a] + v[b] + m[x];
+    v[d] = Rotr32(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = Rotr32(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + m[y];
+    v[d] = Rotr32(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = Rotr32(v[b] ^ v[c], 7);
+}
+
+static void Blake3Compress(uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN], uint32_t block_len,
+    uint64_t counter, uint32_t flags)
+{
+    uint32_t m[16];
+    uint32_t v[16];
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        m[i] = Load32Le(block + 4 * i);
+    }
+    memcpy(v, cv, 8 * sizeof(uint32_t));
+    memcpy(v + 8, sha256_iv, 4 * sizeof(uint32_t));
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+
+    for (i = 0; i < 7; i++) {
+        BLAKE3_ROUND(Blake3G, v, m, blake3_schedule[i]);
+    }
+    for (i = 0; i < 8; i++) {
+        cv[i] = v[i] ^ v[i + 8];
+    }
+}
+
+/* Chaining value of a chunk of up to 1 KB; flags is BLAKE3_ROOT for a single chunk */
+static void Blake3Chunk(const uint8_t *input, uint64_t length, uint64_t counter, uint32_t flags, uint32_t cv[8])
+{
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint32_t block_flags = BLAKE3_CHUNK_START;
+
+    memcpy(cv, sha256_iv, 8 * sizeof(uint32_t));
+    while (length > BLAKE3_BLOCK_LEN) {
+        Blake3Compress(cv, input, BLAKE3_BLOCK_LEN, counter, block_flags);
+        input += BLAKE3_BLOCK_LEN;
+        length -= BLAKE3_BLOCK_LEN;
+        block_flags = 0;
+    }
+    memset(block, 0, sizeof(block));
+    memcpy(block, input, (size_t)length);
+    Blake3Compress(cv, block, (uint32_t)length, counter, block_flags | BLAKE3_CHUNK_END | flags);
+}
+
+static void Blake3Parent(const uint32_t left[8], const uint32_t right[8], uint32_t flags, uint32_t cv[8])
+{
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        Store32Le(block + 4 * i, left[i]);
+        Store32Le(block + 32 + 4 * i, right[i]);
+    }
+    memcpy(cv, sha256_iv, 8 * sizeof(uint32_t));
+    Blake3Compress(cv, block, BLAKE3_BLOCK_LEN, 0, BLAKE3_PARENT | flags);
+}
+
+#if defined(__GNUC__)
+/* One lane by chunk: the same code is built for AVX2 and for the default target */
+typedef uint32_t Blake3Vector __attribute__((vector_size(4 * BLAKE3_LANES)));
+
+static inline __attribute__((always_inline)) void Blake3VectorG(Blake3Vector v[16], int a, int b, int c, int d,
+    const Blake3Vector m[16], int x, int y)
+{
+    v[a] = v[a] + v[b] + m[x];
+    v[d] = v[d] ^ v[a];
+    v[d] = (v[d] >> 16) | (v[d] << 16);
+    v[c] = v[c] + v[d];
+    v[b] = v[b] ^ v[c];
+    v[b] = (v[b] >> 12) | (v[b] << 20);
+    v[a] = v[a] + v[b] + m[y];
+    v[d] = v[d] ^ v[a];
+    v[d] = (v[d] >> 8) | (v[d] << 24);
+    v[c] = v[c] + v[d];
+    v[b] = v[b] ^ v[c];
+    v[b] = (v[b] >> 7) | (v[b] << 25);
+}
+
+static inline __attribute__((always_inline)) void Blake3ChunksBody(const uint8_t *input, uint64_t counter,
+    uint32_t cvs[BLAKE3_LANES][8])
+{
+    Blake3Vector h[8];
+    Blake3Vector v[16];
+    Blake3Vector m[16];
+    Blake3Vector counter_low;
+    Blake3Vector counter_high;
+    const Blake3Vector zero = { 0 };
+    uint32_t flags;
+    int block;
+    int lane;
+    int i;
+
+    for (lane = 0; lane < BLAKE3_LANES; lane++) {
+        counter_low[lane] = (uint32_t)(counter + lane);
+        counter_high[lane] = (uint32_t)((counter + lane) >> 32);
+    }
+    for (i = 0; i < 8; i++) {
+        h[i] = zero + sha256_iv[i];
+    }
+
+    for (block = 0; block < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; block++) {
+        for (i = 0; i < 16; i++) {
+            for (lane = 0; lane < BLAKE3_LANES; lane++) {
+                m[i][lane] = Load32Le(input + lane * BLAKE3_CHUNK_LEN + block * BLAKE3_BLOCK_LEN + 4 * i);
+            }
+        }
+        flags = (block == 0) ? BLAKE3_CHUNK_START : 0;
+        if (block == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1) {
+            flags |= BLAKE3_CHUNK_END;
+        }
+
+        for (i = 0; i < 8; i++) {
+            v[i] = h[i];
+        }
+        for (i = 0; i < 4; i++) {
+            v[8 + i] = zero + sha256_iv[i];
+        }
+        v[12] = counter_low;
+        v[13] = counter_high;
+        v[14] = zero + BLAKE3_BLOCK_LEN;
+        v[15] = zero + flags;
+
+        for (i = 0; i < 7; i++) {
+            BLAKE3_ROUND(Blake3VectorG, v, m, blake3_schedule[i]);
+        }
+        for (i = 0; i < 8; i++) {
+            h[i] = v[i] ^ v[i + 8];
+        }
+    }
+
+    for (lane = 0; lane < BLAKE3_LANES; lane++) {
+        for (i = 0; i < 8; i++) {
+            cvs[lane][i] = h[i][lane];
+        }
+    }
+}
+
+static void Blake3Chunks(const uint8_t *input, uint64_t counter, uint32_t cvs[BLAKE3_LANES][8])
+{
+    Blake3ChunksBody(input, counter, cvs);
+}
+
+#if defined(DIGEST_X86)
+__attribute__((target("avx2"))) static void Blake3ChunksAvx2(const uint8_t *input, uint64_t counter,
+    uint32_t cvs[BLAKE3_LANES][8])
+{
+    Blake3ChunksBody(input, counter, cvs);
+}
+#endif
+#else
+static void Blake3Chunks(const uint8_t *input, uint64_t counter, uint32_t cvs[BLAKE3_LANES][8])
+{
+    int lane;
+
+    for (lane = 0; lane < BLAKE3_LANES; lane++) {
+        Blake3Chunk(input + lane * BLAKE3_CHUNK_LEN, BLAKE3_CHUNK_LEN, counter + lane, 0, cvs[lane]);
+    }
+}
+#endif
+
+/* 8 full chunks, set by Blake3() */
+static void (*blake3_chunks)(const uint8_t *input, uint64_t counter, uint32_t cvs[BLAKE3_LANES][8]) = Blake3Chunks;
+
+/* Root or chaining value of the tree of n chunks */
+static void Blake3Merge(uint32_t cvs[][8], uint64_t n, uint32_t flags, uint32_t cv[8])
+{
+    uint32_t left[8];
+    uint32_t right[8];
+    uint64_t half = 1;
+
+    if (n == 1) {
+        memcpy(cv, cvs[0], 8 * sizeof(uint32_t));
+        return;
+    }
+    while (half * 2 < n) {
+        half *= 2;
+    }
+    Blake3Merge(cvs, half, 0, left);
+    Blake3Merge(cvs + half, n - half, 0, right);
+    Blake3Parent(left, right, flags, cv);
+}
+
+struct Blake3Job {
+    const uint8_t *input;
+    uint64_t length;
+    uint64_t counter;
+    int threads;
+    uint32_t cv[8];
+};
+
+static void Blake3Subtree(const uint8_t *input, uint64_t length, uint64_t counter, int threads, uint32_t flags,
+    uint32_t cv[8]);
+
+#if !defined(_WIN32)
+static void *Blake3Thread(void *arg)
+{
+    struct Blake3Job *job = (struct Blake3Job *)arg;
+
+    Blake3Subtree(job->input, job->length, job->counter, job->threads, 0, job->cv);
+    return NULL;
+}
+#endif
+
+/*
+ * Subtree of more than one chunk, from chunk counter. The left subtree is
+ * hashed by another thread when threads > 1.
+ */
+static void Blake3Subtree(const uint8_t *input, uint64_t length, uint64_t counter, int threads, uint32_t flags,
+    uint32_t cv[8])
+{
+    uint32_t cvs[BLAKE3_LANES][8];
+    uint32_t left[8];
+    uint32_t right[8];
+    uint64_t left_length = BLAKE3_CHUNK_LEN;
+    uint64_t n;
+    uint64_t i;
+#if !defined(_WIN32)
+    struct Blake3Job job;
+    pthread_t thread;
+#endif
+
+    if (length <= BLAKE3_LANES * BLAKE3_CHUNK_LEN) {
+        n = (length + BLAKE3_CHUNK_LEN - 1) / BLAKE3_CHUNK_LEN;
+        if (length == BLAKE3_LANES * BLAKE3_CHUNK_LEN) {
+            blake3_chunks(input, counter, cvs);
+        } else {
+            for (i = 0; i < n; i++) {
+                Blake3Chunk(input + i * BLAKE3_CHUNK_LEN,
+                    (length - i * BLAKE3_CHUNK_LEN < BLAKE3_CHUNK_LEN) ? length - i * BLAKE3_CHUNK_LEN :
+                                                                          BLAKE3_CHUNK_LEN,
+                    counter + i, 0, cvs[i]);
+            }
+        }
+        Blake3Merge(cvs, n, flags, cv);
+        return;
+    }
+
+    while (left_length * 2 < length) {
+        left_length *= 2;
+    }
+
+#if !defined(_WIN32)
+    if ((threads > 1) && (length >= BLAKE3_PARALLEL_SIZE)) {
+        job.input = input;
+        job.length = left_length;
+        job.counter = counter;
+        job.threads = threads / 2;
+        if (pthread_create(&thread, NULL, Blake3Thread, &job) == 0) {
+            Blake3Subtree(input + left_length, length - left_length, counter + left_length / BLAKE3_CHUNK_LEN,
+                threads - threads / 2, 0, right);
+            pthread_join(thread, NULL);
+            Blake3Parent(job.cv, right, flags, cv);
+            return;
+        }
+    }
+#endif
+    Blake3Subtree(input, left_length, counter, 1, 0, left);
+    Blake3Subtree(input + left_length, length - left_length, counter + left_length / BLAKE3_CHUNK_LEN, threads,
+        0, right);
+    Blake3Parent(left, right, flags, cv);
+}
+
+void Blake3(const uint8_t *data, uint64_t length, uint8_t digest[BLAKE3_SIZE])
+{
+    uint32_t cv[8];
+    int i;
+
+#if defined(DIGEST_X86) && defined(__GNUC__)
+    if (CpuFeatures() & CPU_AVX2) {
+        blake3_chunks = Blake3ChunksAvx2;
+    }
+#endif
+
+    if (length <= BLAKE3_CHUNK_LEN) {
+        Blake3Chunk(data, length, 0, BLAKE3_ROOT, cv);
+    } else {
+        Blake3Subtree(data, length, 0, DigestThreads(length), BLAKE3_ROOT, cv);
+    }
+
+    for (i = 0; i < 8; i++) {
+        Store32Le(digest + 4 * i, cv[i]);
+    }
+}
+
+/* XXH3, 64 bits, seed 0 and default secret */
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH3_SECRET_SIZE 192
+#define XXH3_STRIPE_LEN 64
+#define XXH3_STRIPES_PER_BLOCK ((XXH3_SECRET_SIZE - XXH3_STRIPE_LEN) / 8)
+
+static const uint8_t xxh3_secret[XXH3_SECRET_SIZE] = {
+    0xB8, 0xFE, 0x6C, 0x39, 0x23, 0xA4, 0x4B, 0xBE, 0x7C, 0x01, 0x81, 0x2C, 0xF7, 0x21, 0xAD, 0x1C,
+    0xDE, 0xD4, 0x6D, 0xE9, 0x83, 0x90, 0x97, 0xDB, 0x72, 0x40, 0xA4, 0xA4, 0xB7, 0xB3, 0x67, 0x1F,
+    0xCB, 0x79, 0xE6, 0x4E, 0xCC, 0xC0, 0xE5, 0x78, 0x82, 0x5A, 0xD0, 0x7D, 0xCC, 0xFF, 0x72, 0x21,
+    0xB8, 0x08, 0x46, 0x74, 0xF7, 0x43, 0x24, 0x8E, 0xE0, 0x35, 0x90, 0xE6, 0x81, 0x3A, 0x26, 0x4C,
+    0x3C, 0x28, 0x52, 0xBB, 0x91, 0xC3, 0x00, 0xCB, 0x88, 0xD0, 0x65, 0x8B, 0x1B, 0x53, 0x2E, 0xA3,
+    0x71, 0x64, 0x48, 0x97, 0xA2, 0x0D, 0xF9, 0x4E, 0x38, 0x19, 0xEF, 0x46, 0xA9, 0xDE, 0xAC, 0xD8,
+    0xA8, 0xFA, 0x76, 0x3F, 0xE3, 0x9C, 0x34, 0x3F, 0xF9, 0xDC, 0xBB, 0xC7, 0xC7, 0x0B, 0x4F, 0x1D,
+    0x8A, 0x51, 0xE0, 0x4B, 0xCD, 0xB4, 0x59, 0x31, 0xC8, 0x9F, 0x7E, 0xC9, 0xD9, 0x78, 0x73, 0x64,
+    0xEA, 0xC5, 0xAC, 0x83, 0x34, 0xD3, 0xEB, 0xC3, 0xC5, 0x81, 0xA0, 0xFF, 0xFA, 0x13, 0x63, 0xEB,
+    0x17, 0x0D, 0xDD, 0x51, 0xB7, 0xF0, 0xDA, 0x49, 0xD3, 0x16, 0x55, 0x26, 0x29, 0xD4, 0x68, 0x9E,
+    0x2B, 0x16, 0xBE, 0x58, 0x7D, 0x47, 0xA1, 0xFC, 0x8F, 0xF8, 0xB8, 0xD1, 0x7A, 0xD0, 0x31, 0xCE,
+    0x45, 0xCB, 0x3A, 0x8F, 0x95, 0x16, 0x04, 0x28, 0xAF, 0xD7, 0xFB, 0xCA, 0xBB, 0x4B, 0x40, 0x7E
+};
+
+/* Low and high halves of the 128-bit product, xor'ed */
+static uint64_t Xxh3Mul128Fold64(uint64_t a, uint64_t b)
+{
+    uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+    uint64_t hi_hi = (a >> 32) * (b >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+
+    return lower ^ upper;
+}
+
+static uint64_t Xxh64Avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+static uint64_t Xxh3Avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    return h ^ (h >> 32);
+}
+
+static uint64_t Xxh3Rrmxmx(uint64_t h, uint64_t length)
+{
+    h ^= Rotl64(h, 49) ^ Rotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + length;
+    h *= XXH_PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+static uint64_t Swap64(uint64_t x)
+{
+    return ((x & 0xFF) << 56) | ((x & 0xFF00) << 40) | ((x & 0xFF0000) << 24) | ((x & 0xFF000000) << 8) |
+        ((x >> 8) & 0xFF000000) | ((x >> 24) & 0xFF0000) | ((x >> 40) & 0xFF00) | (x >> 56);
+}
+
+static uint64_t Xxh3Mix16(const uint8_t *input, const uint8_t *secret)
+{
+    return Xxh3Mul128Fold64(Load64Le(input) ^ Load64Le(secret), Load64Le(input + 8) ^ Load64Le(secret + 8));
+}
+
+static uint64_t Xxh3Short(const uint8_t *input, uint64_t length)
+{
+    const uint8_t *secret = xxh3_secret;
+    uint64_t low;
+    uint64_t high;
+    uint32_t combined;
+
+    if (length > 8) {
+        low = Load64Le(input) ^ (Load64Le(secret + 24) ^ Load64Le(secret + 32));
+        high = Load64Le(input + length - 8) ^ (Load64Le(secret + 40) ^ Load64Le(secret + 48));
+        return Xxh3Avalanche(length + Swap64(low) + high + Xxh3Mul128Fold64(low, high));
+    }
+    if (length >= 4) {
+        low = Load32Le(input + length - 4) + ((uint64_t)Load32Le(input) << 32);
+        return Xxh3Rrmxmx(low ^ (Load64Le(secret + 8) ^ Load64Le(secret + 16)), length);
+    }
+    if (length > 0) {
+        combined = ((uint32_t)input[0] << 16) | ((uint32_t)input[length >> 1] << 24) | input[length - 1] |
+            ((uint32_t)length << 8);
+        return Xxh64Avalanche(combined ^ (uint64_t)(Load32Le(secret) ^ Load32Le(secret + 4)));
+    }
+    return Xxh64Avalanche(Load64Le(secret + 56) ^ Load64Le(secret + 64));
+}
+
+static uint64_t Xxh3Medium(const uint8_t *input, uint64_t length)
+{
+    const uint8_t *secret = xxh3_secret;
+    uint64_t acc = length * XXH_PRIME64_1;
+    uint64_t i;
+
+    if (length <= 128) {
+        if (length > 32) {
+            if (length > 64) {
+                if (length > 96) {
+                    acc += Xxh3Mix16(input + 48, secret + 96);
+                    acc += Xxh3Mix16(input + length - 64, secret + 112);
+                }
+                acc += Xxh3Mix16(input + 32, secret + 64);
+                acc += Xxh3Mix16(input + length - 48, secret + 80);
+            }
+            acc += Xxh3Mix16(input + 16, secret + 32);
+            acc += Xxh3Mix16(input + length - 32, secret + 48);
+        }
+        acc += Xxh3Mix16(input, secret);
+        acc += Xxh3Mix16(input + length - 16, secret + 16);
+        return Xxh3Avalanche(acc);
+    }
+
+    /* 129 to 240 bytes */
+    for (i = 0; i < 8; i++) {
+        acc += Xxh3Mix16(input + 16 * i, secret + 16 * i);
+    }
+    acc = Xxh3Avalanche(acc);
+    for (i = 8; i < length / 16; i++) {
+        acc += Xxh3Mix16(input + 16 * i, secret + 16 * (i - 8) + 3);
+    }
+    acc += Xxh3Mix16(input + length - 16, secret + 136 - 17);
+    return Xxh3Avalanche(acc);
+}
+
+static void Xxh3AccumulatePortable(uint64_t acc[8], const uint8_t *input, const uint8_t *secret, uint64_t stripes)
+{
+    uint64_t data;
+    uint64_t key;
+    uint64_t n;
+    int i;
+
+    for (n = 0; n < stripes; n++) {
+        for (i = 0; i < 8; i++) {
+            data = Load64Le(input + XXH3_STRIPE_LEN * n + 8 * i);
+            key = data ^ Load64Le(secret + 8 * n + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+        }
+    }
+}
+
+static void Xxh3ScramblePortable(uint64_t acc[8], const uint8_t *secret)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        acc[i] = (acc[i] ^ (acc[i] >> 47) ^ Load64Le(secret + 8 * i)) * XXH_PRIME32_1;
+    }
+}
+
+#if defined(DIGEST_X86) && defined(__SSE2__)
+static void Xxh3AccumulateSse2(uint64_t acc[8], const uint8_t *input, const uint8_t *secret, uint64_t stripes)
+{
+    __m128i sums[4];
+    __m128i data, key;
+    uint64_t n;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        sums[i] = _mm_loadu_si128((const __m128i *)acc + i);
+    }
+    for (n = 0; n < stripes; n++) {
+        for (i = 0; i < 4; i++) {
+            data = _mm_loadu_si128((const __m128i *)(input + XXH3_STRIPE_LEN * n + 16 * i));
+            key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)(secret + 8 * n + 16 * i)));
+            sums[i] = _mm_add_epi64(sums[i], _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+            sums[i] = _mm_add_epi64(sums[i], _mm_mul_epu32(key, _mm_srli_epi64(key, 32)));
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i *)acc + i, sums[i]);
+    }
+}
+
+static void Xxh3ScrambleSse2(uint64_t acc[8], const uint8_t *secret)
+{
+    const __m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+    __m128i value;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        value = _mm_loadu_si128((const __m128i *)acc + i);
+        value = _mm_xor_si128(value, _mm_srli_epi64(value, 47));
+        value = _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)(secret + 16 * i)));
+        value = _mm_add_epi64(_mm_mul_epu32(value, prime),
+            _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(value, 32), prime), 32));
+        _mm_storeu_si128((__m128i *)acc + i, value);
+    }
+}
+#endif
+
+#if defined(DIGEST_X86)
+__attribute__((target("avx2"))) static void Xxh3AccumulateAvx2(uint64_t acc[8], const uint8_t *input,
+    const uint8_t *secret, uint64_t stripes)
+{
+    __m256i sums[2];
+    __m256i data, key;
+    uint64_t n;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        sums[i] = _mm256_loadu_si256((const __m256i *)acc + i);
+    }
+    for (n = 0; n < stripes; n++) {
+        for (i = 0; i < 2; i++) {
+            data = _mm256_loadu_si256((const __m256i *)(input + XXH3_STRIPE_LEN * n + 32 * i));
+            key = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i *)(secret + 8 * n + 32 * i)));
+            sums[i] = _mm256_add_epi64(sums[i], _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+            sums[i] = _mm256_add_epi64(sums[i], _mm256_mul_epu32(key, _mm256_srli_epi64(key, 32)));
+        }
+    }
+    for (i = 0; i < 2; i++) {
+        _mm256_storeu_si256((__m256i *)acc + i, sums[i]);
+    }
+}
+
+__attribute__((target("avx2"))) static void Xxh3ScrambleAvx2(uint64_t acc[8], const uint8_t *secret)
+{
+    const __m256i prime = _mm256_set1_epi32((int)XXH_PRIME32_1);
+    __m256i value;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        value = _mm256_loadu_si256((const __m256i *)acc + i);
+        value = _mm256_xor_si256(value, _mm256_srli_epi64(value, 47));
+        value = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)(secret + 32 * i)));
+        value = _mm256_add_epi64(_mm256_mul_epu32(value, prime),
+            _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime), 32));
+        _mm256_storeu_si256((__m256i *)acc + i, value);
+    }
+}
+#endif
+
+/* More than 240 bytes: 8 accumulators, scrambled after each block of 16 stripes */
+static uint64_t Xxh3Long(const uint8_t *input, uint64_t length)
+{
+    void (*accumulate)(uint64_t acc[8], const uint8_t *input, const uint8_t *secret, uint64_t stripes) =
+        Xxh3AccumulatePortable;
+    void (*scramble)(uint64_t acc[8], const uint8_t *secret) = Xxh3ScramblePortable;
+    uint64_t acc[8] = { XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+                        XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1 };
+    const uint64_t block_length = XXH3_STRIPE_LEN * XXH3_STRIPES_PER_BLOCK;
+    uint64_t blocks = (length - 1) / block_length;
+    uint64_t result;
+    uint64_t n;
+    int i;
+
+#if defined(DIGEST_X86) && defined(__SSE2__)
+    accumulate = Xxh3AccumulateSse2;
+    scramble = Xxh3ScrambleSse2;
+#endif
+#if defined(DIGEST_X86)
+    if (CpuFeatures() & CPU_AVX2) {
+        accumulate = Xxh3AccumulateAvx2;
+        scramble = Xxh3ScrambleAvx2;
+    }
+#endif
+
+    for (n = 0; n < blocks; n++) {
+        accumulate(acc, input + n * block_length, xxh3_secret, XXH3_STRIPES_PER_BLOCK);
+        scramble(acc, xxh3_secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN);
+    }
+    accumulate(acc, input + blocks * block_length, xxh3_secret,
+        ((length - 1) - blocks * block_length) / XXH3_STRIPE_LEN);
+    /* Last stripe, ending at the end of the input */
+    accumulate(acc, input + length - XXH3_STRIPE_LEN, xxh3_secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN - 7, 1);
+
+    result = length * XXH_PRIME64_1;
+    for (i = 0; i < 4; i++) {
+        result += Xxh3Mul128Fold64(acc[2 * i] ^ Load64Le(xxh3_secret + 11 + 16 * i),
+            acc[2 * i + 1] ^ Load64Le(xxh3_secret + 11 + 16 * i + 8));
+    }
+    return Xxh3Avalanche(result);
+}
+
+uint64_t Xxh3(const uint8_t *data, uint64_t length)
+{
+    if (length <= 16) {
+        return Xxh3Short(data, length);
+    }
+    if (length <= 240) {
+        return Xxh3Medium(data, length);
+    }
+    return Xxh3Long(data, length);
+}
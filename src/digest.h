@@ -0,0 +1,14 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+#define BLAKE3_SIZE 32
+
+/* Digests of the check range (-k 7 to 9), with the fastest code of the CPU */
+extern void Sha256(const uint8_t *data, uint64_t length, uint8_t digest[SHA256_SIZE]);
+extern void Blake3(const uint8_t *data, uint64_t length, uint8_t digest[BLAKE3_SIZE]);
+extern uint64_t Xxh3(const uint8_t *data, uint64_t length);
+
+#endif
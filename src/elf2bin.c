@@ -0,0 +1,496 @@
+/*
+  elf2bin converts the loadable segments of an ELF file to binary.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  The PT_LOAD segments are placed at their physical address (p_paddr), like
+  objcopy -O ihex does, so that the result is the same as converting the
+  hex file produced from the ELF file with hex2bin.
+  Only the p_filesz part of a segment is stored: the .bss part isn't in
+  the hex file either.
+*/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "checksum.h"
+#include "stats.h"
+#include "arena.h"
+#include "delta.h"
+#include "extract.h"
+#include "watch.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define PROGRAM "elf2bin"
+#define VERSION "1.0"
+
+/* e_ident[] */
+#define EI_CLASS 4
+#define EI_DATA 5
+#define ELFCLASS32 1
+#define ELFCLASS64 2
+#define ELFDATA2LSB 1
+#define ELFDATA2MSB 2
+
+#define PT_LOAD 1
+
+const char *program_name = PROGRAM;
+
+static const uint8_t *elf_image;
+static size_t elf_size;
+static bool elf_class64;
+static bool elf_big_endian;
+
+static uint64_t GetElfValue(size_t offset, uint32_t size)
+{
+    uint64_t value = 0;
+    uint32_t i;
+
+    if ((offset > elf_size) || (size > elf_size - offset)) {
+        fprintf(fp, "ELF file truncated at offset 0x%" PRIX64 "\n", (uint64_t)offset);
+        exit(1);
+    }
+
+    for (i = 0; i < size; i++) {
+        if (elf_big_endian) {
+            value = (value << 8) | elf_image[offset + i];
+        } else {
+            value |= (uint64_t)elf_image[offset + i] << (8 * i);
+        }
+    }
+
+    return value;
+}
+
+/* Map the whole input file; the segments are copied directly from it. */
+static void MapInputFile(char *file_name)
+{
+    FILE *file_in = GetInFile();
+
+#if !defined(_WIN32)
+    struct stat st;
+    void *map;
+
+    if ((fstat(fileno(file_in), &st) != 0) || (st.st_size == 0)) {
+        fprintf(fp, "Input file %s cannot be mapped.\n", file_name);
+        exit(1);
+    }
+
+    elf_size = (size_t)st.st_size;
+    map = mmap(NULL, elf_size, PROT_READ, MAP_PRIVATE, fileno(file_in), 0);
+    if (map == MAP_FAILED) {
+        fprintf(fp, "Input file %s cannot be mapped.\n", file_name);
+        exit(1);
+    }
+    elf_image = map;
+#else
+    uint8_t *buffer;
+
+    /* No mmap: read the file in binary mode instead */
+    file_in = freopen(file_name, "rb", file_in);
+    if ((file_in == NULL) || (fseek(file_in, 0, SEEK_END) != 0)) {
+        fprintf(fp, "Input file %s cannot be read.\n", file_name);
+        exit(1);
+    }
+    elf_size = (size_t)ftell(file_in);
+    rewind(file_in);
+
+    buffer = PoolAlloc(elf_size, NULL);
+    if (fread(buffer, 1, elf_size, file_in) != elf_size) {
+        fprintf(fp, "Input file %s cannot be read.\n", file_name);
+        exit(1);
+    }
+    elf_image = buffer;
+#endif
+}
+
+static void UnmapInputFile(void)
+{
+#if !defined(_WIN32)
+    munmap((void *)elf_image, elf_size);
+#else
+    PoolRelease((uint8_t *)elf_image);
+#endif
+}
+
+static void VerifyElfHeader(void)
+{
+    if ((elf_size < 16) || (memcmp(elf_image, "\177ELF", 4) != 0)) {
+        fprintf(fp, "Not an ELF file\n");
+        exit(1);
+    }
+
+    switch (elf_image[EI_CLASS]) {
+        case ELFCLASS32:
+            elf_class64 = false;
+            break;
+        case ELFCLASS64:
+            elf_class64 = true;
+            break;
+        default:
+            fprintf(fp, "Unknown ELF class %d\n", elf_image[EI_CLASS]);
+            exit(1);
+    }
+
+    switch (elf_image[EI_DATA]) {
+        case ELFDATA2LSB:
+            elf_big_endian = false;
+            break;
+        case ELFDATA2MSB:
+            elf_big_endian = true;
+            break;
+        default:
+            fprintf(fp, "Unknown ELF data encoding %d\n", elf_image[EI_DATA]);
+            exit(1);
+    }
+
+    if (verbose_flag) {
+        fprintf(fp, "ELF%d, %s endian\n", elf_class64 ? 64 : 32, elf_big_endian ? "big" : "little");
+    }
+}
+
+struct ProgramHeader {
+    uint32_t type;
+    uint64_t offset;
+    uint64_t paddr;
+    uint64_t filesz;
+};
+
+static uint32_t GetProgramHeaderCount(void)
+{
+    return (uint32_t)GetElfValue(elf_class64 ? 0x38 : 0x2C, 2);
+}
+
+static void GetProgramHeader(uint32_t index, struct ProgramHeader *ph)
+{
+    uint64_t phoff;
+    uint64_t phentsize;
+    size_t base;
+
+    if (elf_class64) {
+        phoff = GetElfValue(0x20, 8);
+        phentsize = GetElfValue(0x36, 2);
+    } else {
+        phoff = GetElfValue(0x1C, 4);
+        phentsize = GetElfValue(0x2A, 2);
+    }
+    base = (size_t)(phoff + index * phentsize);
+
+    if (elf_class64) {
+        ph->type = (uint32_t)GetElfValue(base, 4);
+        ph->offset = GetElfValue(base + 0x08, 8);
+        ph->paddr = GetElfValue(base + 0x18, 8);
+        ph->filesz = GetElfValue(base + 0x20, 8);
+    } else {
+        ph->type = (uint32_t)GetElfValue(base, 4);
+        ph->offset = GetElfValue(base + 0x04, 4);
+        ph->paddr = GetElfValue(base + 0x0C, 4);
+        ph->filesz = GetElfValue(base + 0x10, 4);
+    }
+}
+
+/* Returns true if the segment has to be copied in the binary file */
+static bool GetLoadSegment(uint32_t index, struct ProgramHeader *ph)
+{
+    GetProgramHeader(index, ph);
+
+    if ((ph->type != PT_LOAD) || (ph->filesz == 0)) {
+        return false;
+    }
+
+    if ((ph->offset > elf_size) || (ph->filesz > elf_size - ph->offset)) {
+        fprintf(fp, "Segment %d outside of the ELF file\n", index);
+        exit(1);
+    }
+
+    if ((ph->paddr + ph->filesz - 1) < ph->paddr) {
+        fprintf(fp, "Segment %d ignored: address 0x%" PRIX64 " wraps around\n", index, ph->paddr);
+        return false;
+    }
+
+    return true;
+}
+
+/* The bytes of a segment between the floor and ceiling addresses; false if none */
+static bool ClipSegment(const struct ProgramHeader *ph, uint64_t *first, uint64_t *last)
+{
+    *first = ph->paddr;
+    *last = ph->paddr + ph->filesz - 1;
+    return ClipFloorCeiling(first, last);
+}
+
+static void get_highest_and_lowest_addresses(void)
+{
+    struct ProgramHeader ph;
+    uint32_t phnum = GetProgramHeaderCount();
+    uint32_t i;
+    uint64_t first;
+    uint64_t last;
+
+    for (i = 0; i < phnum; i++) {
+        if (GetLoadSegment(i, &ph) == false) {
+            continue;
+        }
+
+        STATS_ADD_PHASE(records, 1);
+
+        if (verbose_flag) {
+            fprintf(fp, "PT_LOAD segment %d: %08" PRIX64 ", %" PRIu64 " bytes\n", i, ph.paddr, ph.filesz);
+        }
+
+        /* Floor and ceiling addresses: a segment is cut to them, as the records of a hex file */
+        if (ClipSegment(&ph, &first, &last) == false) {
+            if (verbose_flag) {
+                fprintf(fp, "Segment %d outside of the floor and ceiling addresses\n", i);
+            }
+            continue;
+        }
+
+        /* Set the lowest address as base pointer. */
+        if (first < g_lowest_address) {
+            g_lowest_address = first;
+        }
+
+        /* Same for the top address. */
+        if (last > g_highest_address) {
+            g_highest_address = last;
+        }
+    }
+}
+
+static void read_segments(uint8_t *memory_block)
+{
+    struct ProgramHeader ph;
+    uint32_t phnum = GetProgramHeaderCount();
+    uint32_t i;
+    uint64_t first;
+    uint64_t last;
+
+    for (i = 0; i < phnum; i++) {
+        if (GetLoadSegment(i, &ph) == false) {
+            continue;
+        }
+
+        STATS_ADD_PHASE(records, 1);
+
+        if (ClipSegment(&ph, &first, &last) == false) {
+            STATS_ADD(skipped, ph.filesz);
+            continue;
+        }
+        STATS_ADD(skipped, ph.filesz - (last - first + 1));
+
+        /* Check that the physical address stays in the buffer's range. */
+        if ((first >= g_lowest_address) && (first <= g_highest_address)) {
+            /* The memory block begins at g_lowest_address */
+            g_phys_addr = first - g_lowest_address;
+            WriteDataBytes(elf_image + ph.offset + (first - ph.paddr), memory_block, last - first + 1);
+        } else {
+            fprintf(fp, "Segment %d skipped at %8" PRIX64 "\n", i, first);
+            STATS_ADD(skipped, last - first + 1);
+        }
+    }
+}
+
+/* --extract: the bytes of the segments in the range, at their address; only their pages of the mapped file are read */
+static void extract_segments(void)
+{
+    struct ProgramHeader ph;
+    uint32_t phnum = GetProgramHeaderCount();
+    uint64_t address;
+    uint64_t length;
+    uint64_t first;
+    uint64_t last;
+    uint64_t end;
+    uint32_t i;
+
+    ExtractGetRange(&address, &length);
+    last = address + length - 1;
+    for (i = 0; i < phnum; i++) {
+        if ((GetLoadSegment(i, &ph) == false) || (ph.filesz == 0) || (ph.paddr > last) ||
+            (ph.paddr + ph.filesz - 1 < address)) {
+            continue;
+        }
+        STATS_ADD_PHASE(records, 1);
+
+        first = (ph.paddr < address) ? address : ph.paddr;
+        end = (ph.paddr + ph.filesz - 1 > last) ? last + 1 : ph.paddr + ph.filesz;
+        g_phys_addr = first;
+        WriteDataBytes(elf_image + ph.offset + (first - ph.paddr), NULL, end - first);
+    }
+}
+
+static int Convert(int argc, char *argv[])
+{
+    char extension[MAX_EXTENSION_SIZE];
+    char file_name[MAX_FILE_NAME_SIZE];
+    char elf_name[MAX_FILE_NAME_SIZE];
+    uint64_t records_start;
+    uint8_t *memory_block = NULL;
+    bool verified = true;
+
+    /* Reuses the memory of a previous conversion in the same process */
+    MemoryReset();
+
+    fp = fopen("log.txt", "w");
+    if (fp == NULL) {
+        printf("Failed to open file.\n");
+        return 1;
+    }
+
+    fprintf(fp, "software name: %s version: %s build_time: %s, %s\n\n", PROGRAM, VERSION, __TIME__, __DATE__);
+
+    if (argc == 1) {
+        usage(__func__, __LINE__);
+    }
+
+    strcpy(extension, "bin"); /* default is for binary file extension */
+
+    ParseOptions(argc, argv);
+
+    /* when user enters input file name */
+    /* Assume last parameter is filename */
+    GetFilename(file_name, argv[argc - 1]);
+    strcpy(elf_name, file_name);
+
+    /* The base of --delta is read before the input file is opened */
+    if (DeltaEnabled()) {
+        DeltaReadBase(file_name, NULL, NULL);
+    }
+
+    /* --verify of a binary file: no records to decode */
+    if (GetVerifyOnly() && IsBinaryFileName(file_name)) {
+        verified = VerifyBinaryFile(file_name);
+        fclose(fp);
+        return verified ? 0 : 1;
+    }
+
+    /* Just a normal file name */
+    if (NoFailOpenInputFile(file_name) == false) {
+        return 1;
+    }
+
+    StatsBegin(STATS_SCAN);
+    MapInputFile(elf_name);
+    VerifyElfHeader();
+    StatsEnd();
+
+    /* Each region goes to its own file, the segments are copied once */
+    if (RegionsDefined()) {
+        g_lowest_address = 0;
+        g_highest_address = (uint64_t)-1;
+        StatsBegin(STATS_DECODE);
+        read_segments(NULL);
+        StatsEnd();
+        StatsBegin(STATS_WRITE);
+        RegionsWriteOutFiles(elf_name, extension);
+        StatsEnd();
+        StatsReport();
+
+        UnmapInputFile();
+        NoFailCloseInputFile(NULL);
+        fclose(fp);
+        return 0;
+    }
+
+    PutExtension(file_name, extension);
+    NoFailOpenOutputFile(file_name);
+
+    /*
+     * The program headers give the addresses directly, so the two passes of
+     * hex2bin are only two walks over the program header table.
+     */
+    g_lowest_address = (uint64_t)-1;
+    g_highest_address = 0;
+
+    /* Check if are set Floor and Ceiling address and range is coherent */
+    VerifyRangeFloorCeil();
+
+    if (ExtractEnabled()) {
+        StatsBegin(STATS_DECODE);
+        ImageBegin(0, 0);
+        extract_segments();
+        StatsEnd();
+        StatsBegin(STATS_ALLOCATE);
+        records_start = ImageEnd(&memory_block);
+        StatsEnd();
+    } else {
+        StatsBegin(STATS_SCAN);
+        get_highest_and_lowest_addresses();
+        StatsEnd();
+        if (g_lowest_address > g_highest_address) {
+            fprintf(fp, "No loadable segment found\n");
+            return 1;
+        }
+
+        records_start = g_lowest_address;
+        StatsBegin(STATS_ALLOCATE);
+        Allocate_Memory_And_Rewind(&memory_block);
+        StatsEnd();
+        StatsBegin(STATS_DECODE);
+        read_segments(memory_block);
+        StatsEnd();
+    }
+
+    fprintf(fp, "Binary file start = 0x%08" PRIX64 "\n", g_lowest_address);
+    fprintf(fp, "Records start     = 0x%08" PRIX64 "\n", records_start);
+    fprintf(fp, "Highest address   = 0x%08" PRIX64 "\n", g_highest_address);
+    fprintf(fp, "Pad Byte          = 0x%X\n\n", GetPadByte());
+
+    StatsBegin(STATS_CHECK);
+    SwapWords(memory_block);
+    if (PagesEnabled()) {
+        PagesWrite(file_name, memory_block);
+    }
+    if (GetVerifyOnly()) {
+        verified = VerifyMemory(memory_block);
+    } else {
+        WriteMemory(memory_block);
+    }
+    StatsEnd();
+    StatsBegin(STATS_WRITE);
+    if (DeltaEnabled()) {
+        DeltaWrite(file_name, memory_block);
+    }
+    WriteOutFile(&memory_block);
+    StatsEnd();
+    StatsReport();
+
+    UnmapInputFile();
+
+    NoFailCloseInputFile(NULL);
+    NoFailCloseOutputFile(NULL);
+    fclose(fp);
+
+    return verified ? 0 : 1;
+}
+
+/* The conversion, here, on each change of the files (--watch) or by a resident converter (--daemon, --connect) */
+int main(int argc, char *argv[])
+{
+    return WatchMain(argc, argv, Convert, NULL, NULL);
+}
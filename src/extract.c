@@ -0,0 +1,363 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Extraction of a range of the records without decoding the whole file
+  (--extract=address,length).
+
+  The index of a file of records, file.idx next to it, cuts the file in
+  parts of about INDEX_PART_SIZE bytes, each one starting with a line. For
+  each part it keeps the extended address before its first line and the
+  lowest and highest addresses of its data records. The parts covering the
+  range are read at their offset and decoded, in the order of the file so
+  that a later record is kept as in a conversion; the other ones aren't
+  read. The index is made by a scan of the addresses, with the read ahead
+  of the scanner, and saved with the size, time (to the nanosecond) and
+  inode of the file: it is made again when the file changes. All values
+  are little endian:
+
+  header    "H2BI", version, record start character, number of parts
+            (32 bits each), size, modification time in seconds and its
+            nanoseconds, inode of the file (64 bits each)
+  part      offset and length in the file, lowest and highest addresses
+            (64 bits each), extended address before the part (32 bits),
+            32 bits reserved
+*/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "stats.h"
+#include "scanner.h"
+#include "extract.h"
+
+#if defined(_WIN32) && !defined(S_ISREG)
+#define S_ISREG(mode) (((mode) & _S_IFMT) == _S_IFREG)
+#endif
+
+#define INDEX_MAGIC "H2BI"
+#define INDEX_VERSION 2
+#define INDEX_PART_SIZE 0x10000
+#define INDEX_HEADER_SIZE 48
+#define INDEX_ENTRY_SIZE 40
+
+/* Part of the file: the lines from offset, of length bytes */
+struct IndexEntry {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t lowest; /* of the data records, above highest when there is none */
+    uint64_t highest;
+    uint32_t state;  /* extended address before the first line */
+};
+
+static bool extract_enabled = false;
+static uint64_t extract_address;
+static uint64_t extract_length;
+
+static struct IndexEntry *index_entries = NULL;
+static uint32_t index_count;
+static uint32_t index_allocated;
+
+void ExtractSetRange(uint64_t address, uint64_t length)
+{
+    extract_address = address;
+    extract_length = length;
+    extract_enabled = true;
+}
+
+bool ExtractEnabled(void)
+{
+    return extract_enabled;
+}
+
+/* The range of --extract: the starting address and length of the binary file */
+void ExtractGetRange(uint64_t *address, uint64_t *length)
+{
+    *address = extract_address;
+    *length = extract_length;
+}
+
+static void PutLittleEndian(uint8_t *p, uint64_t value, uint32_t nb_bytes)
+{
+    uint32_t i;
+
+    for (i = 0; i < nb_bytes; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t GetLittleEndian(const uint8_t *p, uint32_t nb_bytes)
+{
+    uint64_t value = 0;
+    uint32_t i;
+
+    for (i = 0; i < nb_bytes; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+static struct IndexEntry *IndexAdd(uint64_t offset, uint32_t state)
+{
+    struct IndexEntry *entry;
+
+    if (index_count == index_allocated) {
+        index_allocated = (index_allocated == 0) ? 256 : index_allocated * 2;
+        index_entries = (struct IndexEntry *)NoFailRealloc(index_entries, index_allocated * sizeof(struct IndexEntry));
+    }
+    entry = &index_entries[index_count++];
+    entry->offset = offset;
+    entry->length = 0;
+    entry->lowest = (uint64_t)-1;
+    entry->highest = 0;
+    entry->state = state;
+    return entry;
+}
+
+/* Nanoseconds of the modification time: a file rewritten in the same second is another file */
+static uint64_t ModificationNanoseconds(const struct stat *st)
+{
+#if defined(_WIN32)
+    (void)st;
+    return 0;
+#else
+    return (uint64_t)st->st_mtim.tv_nsec;
+#endif
+}
+
+/* The index saved for the file of this size and time, false if there is none */
+static bool IndexRead(const char *index_name, char start, const struct stat *st)
+{
+    uint8_t header[INDEX_HEADER_SIZE];
+    uint8_t bytes[INDEX_ENTRY_SIZE];
+    struct IndexEntry *entry;
+    uint32_t count;
+    uint32_t i;
+    FILE *in = fopen(index_name, "rb");
+
+    if (in == NULL) {
+        return false;
+    }
+    if ((fread(header, 1, sizeof(header), in) != sizeof(header)) || (memcmp(header, INDEX_MAGIC, 4) != 0) ||
+        (GetLittleEndian(header + 4, 4) != INDEX_VERSION) || (GetLittleEndian(header + 8, 4) != (uint8_t)start) ||
+        (GetLittleEndian(header + 16, 8) != (uint64_t)st->st_size) ||
+        (GetLittleEndian(header + 24, 8) != (uint64_t)st->st_mtime) ||
+        (GetLittleEndian(header + 32, 8) != ModificationNanoseconds(st)) ||
+        (GetLittleEndian(header + 40, 8) != (uint64_t)st->st_ino)) {
+        fclose(in);
+        return false;
+    }
+
+    count = (uint32_t)GetLittleEndian(header + 12, 4);
+    index_count = 0;
+    for (i = 0; i < count; i++) {
+        if (fread(bytes, 1, sizeof(bytes), in) != sizeof(bytes)) {
+            fclose(in);
+            index_count = 0;
+            return false;
+        }
+        entry = IndexAdd(GetLittleEndian(bytes, 8), (uint32_t)GetLittleEndian(bytes + 32, 4));
+        entry->length = GetLittleEndian(bytes + 8, 8);
+        entry->lowest = GetLittleEndian(bytes + 16, 8);
+        entry->highest = GetLittleEndian(bytes + 24, 8);
+    }
+    fclose(in);
+    return true;
+}
+
+/* In a directory that can't be written, the index is only used by this conversion */
+static void IndexWrite(const char *index_name, char start, const struct stat *st)
+{
+    uint8_t header[INDEX_HEADER_SIZE];
+    uint8_t bytes[INDEX_ENTRY_SIZE];
+    struct IndexEntry *entry;
+    bool written;
+    uint32_t i;
+    FILE *out = fopen(index_name, "wb");
+
+    if (out == NULL) {
+        fprintf(fp, "Index file %s cannot be opened.\n", index_name);
+        return;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, INDEX_MAGIC, 4);
+    PutLittleEndian(header + 4, INDEX_VERSION, 4);
+    PutLittleEndian(header + 8, (uint8_t)start, 4);
+    PutLittleEndian(header + 12, index_count, 4);
+    PutLittleEndian(header + 16, (uint64_t)st->st_size, 8);
+    PutLittleEndian(header + 24, (uint64_t)st->st_mtime, 8);
+    PutLittleEndian(header + 32, ModificationNanoseconds(st), 8);
+    PutLittleEndian(header + 40, (uint64_t)st->st_ino, 8);
+    written = (fwrite(header, 1, sizeof(header), out) == sizeof(header));
+
+    for (i = 0; written && (i < index_count); i++) {
+        entry = &index_entries[i];
+        memset(bytes, 0, sizeof(bytes));
+        PutLittleEndian(bytes, entry->offset, 8);
+        PutLittleEndian(bytes + 8, entry->length, 8);
+        PutLittleEndian(bytes + 16, entry->lowest, 8);
+        PutLittleEndian(bytes + 24, entry->highest, 8);
+        PutLittleEndian(bytes + 32, entry->state, 4);
+        written = (fwrite(bytes, 1, sizeof(bytes), out) == sizeof(bytes));
+    }
+
+    if ((fclose(out) != 0) || !written) {
+        fprintf(fp, "Index file %s cannot be written.\n", index_name);
+        remove(index_name);
+    }
+}
+
+/* Scan of the addresses of the records: a new part begins every INDEX_PART_SIZE bytes */
+static void IndexMake(FILE *in, char start, uint64_t file_size, ExtractRecordFunction read_record)
+{
+    struct Record record;
+    struct IndexEntry *entry = NULL;
+    uint32_t state = 0;
+    uint64_t address;
+    uint64_t offset;
+    uint32_t nb_bytes;
+
+    index_count = 0;
+    rewind(in);
+    ScannerBegin(in, start);
+    while (ScannerNextLine(&record)) {
+        offset = ScannerLineOffset();
+        if ((entry == NULL) || (offset - entry->offset >= INDEX_PART_SIZE)) {
+            if (entry != NULL) {
+                entry->length = offset - entry->offset;
+            }
+            entry = IndexAdd(offset, state);
+        }
+
+        if ((record.length != 0) && read_record(&record, &state, &address, NULL, &nb_bytes)) {
+            if (address < entry->lowest) {
+                entry->lowest = address;
+            }
+            if (address + nb_bytes - 1 > entry->highest) {
+                entry->highest = address + nb_bytes - 1;
+            }
+        }
+    }
+    if (entry != NULL) {
+        entry->length = file_size - entry->offset;
+    }
+    ScannerEnd();
+}
+
+/*
+ * The records of name between extract_address and extract_length bytes
+ * after it, into the single pass image (ImageBegin()): each file of
+ * records is read by read_hex or read_srec, from its first character.
+ */
+void ExtractReadRecords(const char *name, ExtractRecordFunction read_hex, ExtractRecordFunction read_srec)
+{
+    char index_name[MAX_FILE_NAME_SIZE];
+    struct Record record;
+    struct IndexEntry *entry;
+    struct stat st;
+    ExtractRecordFunction read_record;
+    FILE *in = GetInFile();
+    uint8_t data[MAX_LINE_SIZE / 2];
+    uint64_t last = extract_address + extract_length - 1;
+    uint64_t address;
+    uint64_t nb;
+    uint64_t read_bytes = 0;
+    uint32_t read_parts = 0;
+    uint32_t state;
+    uint32_t nb_bytes;
+    uint32_t i;
+    int start;
+
+    /* The parts are read at their offset */
+    if (GetInputStream() || (fstat(fileno(in), &st) != 0) || !S_ISREG(st.st_mode)) {
+        fprintf(fp, "--extract reads a file of records at offsets: not stdin or a compressed file\n");
+        exit(1);
+    }
+    start = FirstRecordCharacter(in);
+    read_record = (start == 'S') ? read_srec : read_hex;
+    if (read_record == NULL) {
+        read_record = read_srec;
+        start = 'S';
+    }
+
+    if (snprintf(index_name, sizeof(index_name), "%s.idx", name) >= (int)sizeof(index_name)) {
+        fprintf(fp, "Index file name of %s is too long\n", name);
+        exit(1);
+    }
+    StatsBegin(STATS_SCAN);
+    if (IndexRead(index_name, (char)start, &st)) {
+        fprintf(fp, "Index file %s: %" PRIu32 " parts\n", index_name, index_count);
+    } else {
+        IndexMake(in, (char)start, (uint64_t)st.st_size, read_record);
+        IndexWrite(index_name, (char)start, &st);
+        fprintf(fp, "Index file %s made: %" PRIu32 " parts\n", index_name, index_count);
+    }
+    StatsEnd();
+
+    StatsBegin(STATS_DECODE);
+    for (i = 0; i < index_count; i++) {
+        entry = &index_entries[i];
+        if ((entry->lowest > last) || (entry->highest < extract_address) || (entry->lowest > entry->highest)) {
+            continue;
+        }
+        if ((entry->length > (uint64_t)SIZE_MAX) ||
+            !ScannerBeginAt(in, (char)start, entry->offset, (size_t)entry->length)) {
+            fprintf(fp, "Part at offset %" PRIu64 " cannot be read: the file changed?\n", entry->offset);
+            exit(1);
+        }
+        read_parts++;
+        read_bytes += entry->length;
+
+        /* The bytes of the range, at their absolute address */
+        state = entry->state;
+        while (ScannerNextLine(&record)) {
+            if ((record.length == 0) || !read_record(&record, &state, &address, data, &nb_bytes)) {
+                continue;
+            }
+            /* As with -s, a record beginning below the address is skipped, one ending after the range is cut */
+            if ((address > last) || (address < extract_address)) {
+                continue;
+            }
+            nb = (address + nb_bytes - 1 > last) ? last + 1 - address : nb_bytes;
+            g_phys_addr = address;
+            WriteDataBytes(data, NULL, nb);
+        }
+    }
+    ScannerEnd();
+    StatsEnd();
+
+    fprintf(fp, "Extract 0x%08" PRIX64 "-0x%08" PRIX64 ": %" PRIu32 " of %" PRIu32 " parts read, %" PRIu64
+        " of %" PRIu64 " bytes\n\n", extract_address, last, read_parts, index_count, read_bytes, (uint64_t)st.st_size);
+    free(index_entries);
+    index_entries = NULL;
+    index_allocated = 0;
+    index_count = 0;
+}
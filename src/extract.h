@@ -0,0 +1,28 @@
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scanner.h"
+
+/*
+ * Address and data of a record, false for a record without data. *state
+ * carries the extended address from a record to the next, 0 at the start
+ * of the file. The data isn't decoded when data is NULL.
+ */
+typedef bool (*ExtractRecordFunction)(const struct Record *record, uint32_t *state, uint64_t *address,
+    uint8_t *data, uint32_t *nb_bytes);
+
+/*
+ * A range of the records (--extract=address,length), decoded from the
+ * records that cover it only: the index of the file, file.idx, tells where
+ * they are. It is made by a first scan and used again while the file is
+ * unchanged.
+ */
+extern void ExtractSetRange(uint64_t address, uint64_t length);
+extern bool ExtractEnabled(void);
+extern void ExtractGetRange(uint64_t *address, uint64_t *length);
+extern void ExtractReadRecords(const char *name, ExtractRecordFunction read_hex, ExtractRecordFunction read_srec);
+
+#endif
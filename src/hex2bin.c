@@ -56,6 +56,13 @@
 #include <string.h>
 #include "common.h"
 #include "checksum.h"
+#include "stats.h"
+#include "arena.h"
+#include "scanner.h"
+#include "srec.h"
+#include "delta.h"
+#include "extract.h"
+#include "watch.h"
 
 #define PROGRAM "hex2bin"
 #define VERSION "3.0"
@@ -67,10 +74,13 @@
 const char *program_name = PROGRAM;
 uint32_t segment_line_select = NO_ADDRESS_TYPE_SELECTED;
 
+/* stdin can't be rewound: it is read once, into a growing image */
+static bool single_pass = false;
+
 static void address_zero(uint32_t nb_bytes, uint32_t first_Word, uint32_t segment, uint32_t upper_address)
 {
     uint32_t address;
-    uint32_t temp;
+    uint64_t temp;
 
     if (nb_bytes == 0) {
         return;
@@ -88,7 +98,7 @@ static void address_zero(uint32_t nb_bytes, uint32_t first_Word, uint32_t segmen
     }
 
     if (verbose_flag) {
-        fprintf(fp, "Physical address: %08X\n", g_phys_addr);
+        fprintf(fp, "Physical address: %08" PRIX64 "\n", g_phys_addr);
     }
 
     /* Floor address */
@@ -112,7 +122,7 @@ static void address_zero(uint32_t nb_bytes, uint32_t first_Word, uint32_t segmen
         g_highest_address = temp;
     }
     if (verbose_flag) {
-        fprintf(fp, "g_highest_address: %08X\n", g_highest_address);
+        fprintf(fp, "g_highest_address: %08" PRIX64 "\n", g_highest_address);
     }
 }
 
@@ -172,21 +182,37 @@ static void address_four(char *p, uint32_t *upper_address, uint16_t record_nb)
         g_phys_addr = (*upper_address << 16);
 
         if (verbose_flag) {
-            fprintf(fp, "Physical address: %08X\n", g_phys_addr);
+            fprintf(fp, "Physical address: %08" PRIX64 "\n", g_phys_addr);
         }
     } else {
         fprintf(fp, "Ignored extended segment address record %d\n", record_nb);
     }
 }
 
-static void get_highest_and_lowest_addresses(char *line)
+/* Header of a record, ":llaaaatt"; returns the number of fields read, as sscanf() */
+static int read_record_header(const struct Record *record, uint32_t *nb_bytes, uint32_t *first_word, uint32_t *type)
 {
-    uint32_t i;
-    FILE *fileIn = NULL;
+    const char *p = record->text;
+
+    if ((*p != ':') || (GetHexDigits(p + 1, 2, nb_bytes) == false)) {
+        return 0;
+    }
+    if (GetHexDigits(p + 3, 4, first_word) == false) {
+        return 1;
+    }
+    if (GetHexDigits(p + 7, 2, type) == false) {
+        return 2;
+    }
+
+    return (record->length > 9) ? 4 : 3;
+}
+
+static void get_highest_and_lowest_addresses(void)
+{
+    struct Record record;
     int result;
     uint32_t first_word;
     uint32_t type;
-    uint8_t data_str[MAX_LINE_SIZE];
     char *p;
 
     uint32_t segment = 0x00;
@@ -194,34 +220,25 @@ static void get_highest_and_lowest_addresses(char *line)
     uint16_t recordNb = 0;
     uint32_t nb_bytes = 0;
 
-    /* get highest and lowest addresses so that we can allocate the rintervallo incoerenteight size */
-    do {
-        /* Read a line from input file. */
-        fileIn = GetInFile();
-        GetLine(line, fileIn);
+    /* get highest and lowest addresses so that we can allocate the right size */
+    ScannerBegin(GetInFile(), ':');
+    while (ScannerNextLine(&record)) {
         recordNb++;
 
-        /* Remove carriage return/line feed at the end of line. */
-        i = strlen(line);
-
-        if (--i == 0) {
+        if (record.length == 0) {
             continue;
         }
 
-        if (line[i] == '\n') {
-            line[i] = '\0';
-        }
-
         /* Scan the first two bytes and nb of bytes.
             The two bytes are read in first_word since its use depend on the
             record type: if it's an extended address record or a data record.
             */
-        result = sscanf(line, ":%2x%4x%2x%s", &nb_bytes, &first_word, &type, data_str);
+        result = read_record_header(&record, &nb_bytes, &first_word, &type);
         if (result != 4) {
             fprintf(fp, "Error in line %d of hex file\n", recordNb);
         }
 
-        p = (char *)data_str;
+        p = record.text + ((record.length > 9) ? 9 : record.length);
 
         /* If we're reading the last record, ignore it. */
         switch (type) {
@@ -256,13 +273,14 @@ static void get_highest_and_lowest_addresses(char *line)
                 }
                 break;
         }
-    } while (!feof(fileIn));
+    }
 }
 
 static void VerifyChecksumValue(uint8_t cs, uint16_t record_nb)
 {
     if ((cs != 0) && GetEnableChecksumError()) {
         fprintf(fp, "checksum error in record %d: should be %02X\n", record_nb, (256 - cs) & 0xFF);
+        STATS_ADD(checksum_errors, 1);
         SetStatusChecksumError(true);
     }
 }
@@ -270,7 +288,6 @@ static void VerifyChecksumValue(uint8_t cs, uint16_t record_nb)
 static void lines_zero(char *p, uint8_t *memory_block, uint8_t *cs, uint32_t first_Word, uint32_t nb_bytes,
     uint32_t upper_address, uint32_t segment, uint32_t offset, uint16_t record_nb)
 {
-    int result;
     uint32_t address;
     uint32_t temp2;
 
@@ -294,6 +311,13 @@ static void lines_zero(char *p, uint8_t *memory_block, uint8_t *cs, uint32_t fir
         }
     }
 
+    /* Without the first pass, the floor and ceiling addresses are checked here */
+    if (single_pass && (!check_floor_address() || !check_ceiling_address(g_phys_addr + nb_bytes - 1))) {
+        fprintf(fp, "Data record skipped at %8" PRIX64 "\n", g_phys_addr);
+        STATS_ADD(skipped, nb_bytes);
+        return;
+    }
+
     /* Check that the physical address stays in the buffer's range. */
     if ((g_phys_addr >= g_lowest_address) && (g_phys_addr <= g_highest_address)) {
         /* The memory block begins at g_lowest_address */
@@ -302,9 +326,9 @@ static void lines_zero(char *p, uint8_t *memory_block, uint8_t *cs, uint32_t fir
         p = ReadDataBytes(p, memory_block, cs, record_nb, nb_bytes);
 
         /* Read the checksum value. */
-        result = sscanf(p, "%2x", &temp2);
-        if (result != 1) {
+        if (GetHexDigits(p, 2, &temp2) == false) {
             fprintf(fp, "Error in line %d of hex file\n", record_nb);
+            temp2 = 0;
         }
 
         /* Verify checksum value. */
@@ -314,8 +338,9 @@ static void lines_zero(char *p, uint8_t *memory_block, uint8_t *cs, uint32_t fir
         if (segment_line_select == SEGMENTED_ADDRESS) {
             fprintf(fp, "Data record skipped at %4X:%4X\n", segment, address);
         } else {
-            fprintf(fp, "Data record skipped at %8X\n", g_phys_addr);
+            fprintf(fp, "Data record skipped at %8" PRIX64 "\n", g_phys_addr);
         }
+        STATS_ADD(skipped, nb_bytes);
     }
 }
 
@@ -377,14 +402,12 @@ static void lines_four(char *p, uint8_t *cs, uint32_t *upper_address, uint32_t *
     }
 }
 
-static void read_file_process_lines(uint8_t *memory_block, char *line)
+static void read_file_process_lines(uint8_t *memory_block)
 {
-    uint32_t i;
-    FILE *fileIn = NULL;
+    struct Record record;
     int result;
     uint32_t first_word;
     uint32_t type;
-    uint8_t data_str[MAX_LINE_SIZE];
     char *p;
 
     uint32_t segment = 0x00;
@@ -396,36 +419,26 @@ static void read_file_process_lines(uint8_t *memory_block, char *line)
     uint32_t nb_bytes = 0;
 
     /* Read the file & process the lines. */
-    do { /* repeat until EOF(fileIn) */
-        /* Read a line from input file. */
-        fileIn = GetInFile();
-        GetLine(line, fileIn);
+    ScannerBegin(GetInFile(), ':');
+    while (ScannerNextLine(&record)) {
         recordNb++;
 
-        /* Remove carriage return/line feed at the end of line. */
-        i = strlen(line);
-
-        // fprintf(fp,"Record: %d; length: %d\n", recordNb, i);
-
-        if (--i == 0) {
+        if (record.length == 0) {
             continue;
         }
-        if (line[i] == '\n') {
-            line[i] = '\0';
-        }
 
         /* Scan the first two bytes and nb of bytes.
             The two bytes are read in first_word since its use depend on the
             record type: if it's an extended address record or a data record.
         */
-        result = sscanf(line, ":%2x%4x%2x%s", &nb_bytes, &first_word, &type, data_str);
+        result = read_record_header(&record, &nb_bytes, &first_word, &type);
         if (result != 4) {
             fprintf(fp, "Error in line %d of hex file\n", recordNb);
         }
 
         checksum = nb_bytes + (first_word >> 8) + (first_word & 0xFF) + type;
 
-        p = (char *)data_str;
+        p = record.text + ((record.length > 9) ? 9 : record.length);
 
         /* If we're reading the last record, ignore it. */
         switch (type) {
@@ -459,16 +472,90 @@ static void read_file_process_lines(uint8_t *memory_block, char *line)
                 fprintf(fp, "Unknown record type\n");
                 break;
         }
-    } while (!feof(fileIn));
+    }
 }
 
-int main(int argc, char *argv[])
+/*
+ * --extract: address and data of an Intel HEX record. *state is the
+ * extended address, as read_file_process_lines() keeps it: the address
+ * type in the bits 16 and 17, the segment or upper address below.
+ */
+static bool ExtractHexRecord(const struct Record *record, uint32_t *state, uint64_t *address, uint8_t *data,
+    uint32_t *nb_bytes)
+{
+    uint8_t bytes[5 + 255];
+    uint32_t select = *state >> 16;
+    uint32_t value = *state & 0xFFFF;
+    uint32_t first_word;
+    uint32_t type;
+    uint8_t cs = 0;
+    uint32_t i;
+
+    if (read_record_header(record, nb_bytes, &first_word, &type) != 4) {
+        return false;
+    }
+
+    /* The first extended address record gives the type, the records of the other type are ignored */
+    if ((type == 2) || (type == 4)) {
+        if (select == NO_ADDRESS_TYPE_SELECTED) {
+            select = (type == 2) ? SEGMENTED_ADDRESS : LINEAR_ADDRESS;
+        }
+        if ((select == ((type == 2) ? SEGMENTED_ADDRESS : LINEAR_ADDRESS)) &&
+            GetHexDigits(record->text + 9, 4, &first_word)) {
+            value = first_word;
+        }
+        *state = (select << 16) | value;
+        return false;
+    }
+    if ((type != 0) || (*nb_bytes == 0)) {
+        return false;
+    }
+
+    if (select == SEGMENTED_ADDRESS) {
+        *address = ((uint64_t)value << 4) + first_word;
+    } else {
+        *address = ((uint64_t)value << 16) + first_word;
+    }
+    if (data == NULL) {
+        return true;
+    }
+
+    /* Count, address, type, data and checksum */
+    if (DecodeHexData(record->text + 1, bytes, *nb_bytes + 5) < *nb_bytes + 5) {
+        fprintf(fp, "Error in record at %08" PRIX64 "\n", *address);
+        return false;
+    }
+    for (i = 0; i < *nb_bytes + 5; i++) {
+        cs += bytes[i];
+    }
+    if ((cs != 0) && GetEnableChecksumError()) {
+        fprintf(fp, "checksum error in record at %08" PRIX64 "\n", *address);
+        STATS_ADD(checksum_errors, 1);
+        SetStatusChecksumError(true);
+    }
+    memcpy(data, bytes + 4, *nb_bytes);
+    return true;
+}
+
+/* An Intel HEX file among several input files, each one with its own address records */
+static void ReadHexRecords(void)
+{
+    segment_line_select = NO_ADDRESS_TYPE_SELECTED;
+    read_file_process_lines(NULL);
+}
+
+static int Convert(int argc, char *argv[])
 {
-    char line[MAX_LINE_SIZE];
     char extension[MAX_EXTENSION_SIZE];
     char file_name[MAX_FILE_NAME_SIZE];
-    uint32_t records_start;
+    uint64_t records_start;
     uint8_t *memory_block = NULL;
+    bool verified = true;
+    int first_file;
+    int nb_files;
+
+    /* Reuses the memory of a previous conversion in the same process */
+    MemoryReset();
 
     fp = fopen("log.txt", "w");
     if (fp == NULL) {
@@ -484,18 +571,56 @@ int main(int argc, char *argv[])
 
     strcpy(extension, "bin"); /* default is for binary file extension */
 
-    ParseOptions(argc, argv);
+    first_file = ParseOptions(argc, argv);
+    nb_files = argc - first_file;
 
-    /* when user enters input file name */
-    /* Assume last parameter is filename */
-    GetFilename(file_name, argv[argc - 1]);
+    /* The file names follow the options, the binary file is named after the first one */
+    GetFilename(file_name, argv[first_file]);
 
-    /* Just a normal file name */
-    if (NoFailOpenInputFile(file_name) == false) {
+    /* The base of --delta is read before the input file is opened */
+    if (DeltaEnabled()) {
+        DeltaReadBase(file_name, ReadHexRecords, SrecReadRecords);
+        segment_line_select = NO_ADDRESS_TYPE_SELECTED;
+    }
+
+    /* --verify of a binary file: no records to decode */
+    if (GetVerifyOnly() && IsBinaryFileName(file_name)) {
+        verified = VerifyBinaryFile(file_name);
+        fclose(fp);
+        return verified ? 0 : 1;
+    }
+
+    /* Several files are opened one after the other by ReadInputFiles() */
+    if ((nb_files == 1) && (NoFailOpenInputFile(file_name) == false)) {
         return 1;
     }
+
+    /*
+     * Each region goes to its own file. The region buffers grow with the
+     * records, so the file is read once and the absolute address is used.
+     */
+    if (RegionsDefined()) {
+        g_lowest_address = 0;
+        g_highest_address = (uint64_t)-1;
+        StatsBegin(STATS_DECODE);
+        if (nb_files > 1) {
+            ReadInputFiles(nb_files, argv + first_file, ReadHexRecords, SrecReadRecords);
+        } else {
+            read_file_process_lines(NULL);
+        }
+        StatsEnd();
+        StatsBegin(STATS_WRITE);
+        RegionsWriteOutFiles(file_name, extension);
+        StatsEnd();
+        StatsReport();
+
+        ScannerEnd();
+        NoFailCloseInputFile(NULL);
+        fclose(fp);
+        return (GetStatusChecksumError() && GetEnableChecksumError()) ? 1 : 0;
+    }
+
     PutExtension(file_name, extension);
-    NoFailOpenOutputFile(file_name);
 
     /*
      * When the hex file is opened, the program will read it in 2 passes.
@@ -509,43 +634,108 @@ int main(int argc, char *argv[])
      * beginning of memory. While reading each records, subsequent addresses will raise this number.
      * At the end of the input file, this value will be the highest address.
      */
-    g_lowest_address = (uint32_t)-1;
+    g_lowest_address = (uint64_t)-1;
     g_highest_address = 0;
 
     /* Check if are set Floor and Ceiling address and range is coherent */
     VerifyRangeFloorCeil();
 
-    get_highest_and_lowest_addresses(line);
+    if (ExtractEnabled()) {
+        /* --extract: only the records of the range are decoded, found with the index of the file */
+        ImageBegin(0, 0);
+        ExtractReadRecords(argv[first_file], ExtractHexRecord, SrecExtractRecord);
+        NoFailOpenOutputFile(file_name);
+        StatsBegin(STATS_ALLOCATE);
+        records_start = ImageEnd(&memory_block);
+        StatsEnd();
+    } else if (GetInputStream() || (nb_files > 1)) {
+        /*
+         * stdin or a compressed file is read once, as mot2bin reads its
+         * files: the image grows with the records and is cut to the
+         * addresses found at the end.
+         * Several files, Intel HEX or S-records, are read into the same
+         * image, and the check value and padding apply to all of them.
+         */
+        if (GetAddressAlignmentWord()) {
+            fprintf(fp, "-a needs two passes and can't be used with stdin, a compressed file or several files\n");
+            return 1;
+        }
+        single_pass = true;
+        StatsBegin(STATS_DECODE);
+        ImageBegin(0, 0);
+        if (nb_files > 1) {
+            ReadInputFiles(nb_files, argv + first_file, ReadHexRecords, SrecReadRecords);
+        } else {
+            read_file_process_lines(NULL);
+        }
+        StatsEnd();
+
+        /* The decompressor of the file is checked before the binary file is created */
+        ScannerEnd();
+        NoFailCloseInputFile(NULL);
+        NoFailOpenOutputFile(file_name);
+        StatsBegin(STATS_ALLOCATE);
+        records_start = ImageEnd(&memory_block);
+        StatsEnd();
+    } else {
+        StatsBegin(STATS_SCAN);
+        get_highest_and_lowest_addresses();
+        StatsEnd();
 
-    if (GetAddressAlignmentWord()) {
-        g_highest_address += (g_highest_address - g_lowest_address) + 1;
-    }
+        if (GetAddressAlignmentWord()) {
+            g_highest_address += (g_highest_address - g_lowest_address) + 1;
+        }
 
-    records_start = g_lowest_address;
-    Allocate_Memory_And_Rewind(&memory_block);
-    read_file_process_lines(memory_block, line);
+        records_start = g_lowest_address;
+        NoFailOpenOutputFile(file_name);
+        StatsBegin(STATS_ALLOCATE);
+        Allocate_Memory_And_Rewind(&memory_block);
+        StatsEnd();
+        StatsBegin(STATS_DECODE);
+        read_file_process_lines(memory_block);
+        StatsEnd();
+    }
 
-    fprintf(fp, "Binary file start = 0x%08X\n", g_lowest_address);
-    fprintf(fp, "Records start     = 0x%08X\n", records_start);
-    fprintf(fp, "Highest address   = 0x%08X\n", g_highest_address);
+    fprintf(fp, "Binary file start = 0x%08" PRIX64 "\n", g_lowest_address);
+    fprintf(fp, "Records start     = 0x%08" PRIX64 "\n", records_start);
+    fprintf(fp, "Highest address   = 0x%08" PRIX64 "\n", g_highest_address);
     fprintf(fp, "Pad Byte          = 0x%X\n\n", GetPadByte());
 
-    WriteMemory(memory_block);
+    StatsBegin(STATS_CHECK);
+    SwapWords(memory_block);
+    if (PagesEnabled()) {
+        PagesWrite(file_name, memory_block);
+    }
+    if (GetVerifyOnly()) {
+        verified = VerifyMemory(memory_block);
+    } else {
+        WriteMemory(memory_block);
+    }
+    StatsEnd();
+    StatsBegin(STATS_WRITE);
+    if (DeltaEnabled()) {
+        DeltaWrite(file_name, memory_block);
+    }
     WriteOutFile(&memory_block);
+    StatsEnd();
+    StatsReport();
 
-#ifdef USE_FILE_BUFFERS
-    free(FilinBuf);
-    free(FiloutBuf);
-#endif
-
+    ScannerEnd();
     NoFailCloseInputFile(NULL);
     NoFailCloseOutputFile(NULL);
-    fclose(fp);
 
     if (GetStatusChecksumError() && GetEnableChecksumError()) {
         fprintf(fp, "checksum error detected.\n");
+        fclose(fp);
         return 1;
     }
 
-    return 0;
+    fclose(fp);
+    return verified ? 0 : 1;
+}
+
+/* The conversion, here, on each change of the files (--watch) or by a resident converter (--daemon, --connect) */
+int main(int argc, char *argv[])
+{
+    return WatchMain(argc, argv, Convert, ExtractHexRecord, SrecExtractRecord);
 }
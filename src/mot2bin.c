@@ -52,270 +52,33 @@
 #include <string.h>
 #include "common.h"
 #include "checksum.h"
+#include "stats.h"
+#include "arena.h"
+#include "scanner.h"
+#include "srec.h"
+#include "delta.h"
+#include "extract.h"
+#include "watch.h"
 
 #define PROGRAM "mot2bin"
 #define VERSION "2.5"
 
 const char *program_name = PROGRAM;
 
-static void get_highest_and_lowest_addresses(char *line)
+static int Convert(int argc, char *argv[])
 {
-    uint32_t i;
-    FILE *fileIn = NULL;
-    uint16_t recordNb = 0;
-    uint32_t nb_bytes = 0;
-    int result;
-    uint32_t temp;
-    uint32_t type;
-    uint32_t first_word;
-
-    /* get highest and lowest addresses so that we can allocate the right size */
-    do {
-        /* Read a line from input file. */
-        fileIn = GetInFile();
-        GetLine(line, fileIn);
-        recordNb++;
-
-        /* Remove carriage return/line feed at the end of line. */
-        i = strlen(line);
-
-        if (--i != 0) {
-            if (line[i] == '\n') {
-                line[i] = '\0';
-            }
-
-            switch (line[1]) {
-                case '0':
-                    nb_bytes = 1; /* This is to fix the g_highest_address set to -1 when nb_bytes = 0 */
-                    break;
-
-                /* 16 bits address */
-                case '1':
-                    result = sscanf(line, "S%1x%2x%4x", &type, &nb_bytes, &first_word);
-                    if (result != 3)
-                        fprintf(fp, "Error in line %d of hex file\n", recordNb);
-
-                    /* Adjust nb_bytes for the number of data bytes */
-                    nb_bytes = nb_bytes - 3;
-                    break;
-
-                /* 24 bits address */
-                case '2':
-                    result = sscanf(line, "S%1x%2x%6x", &type, &nb_bytes, &first_word);
-                    if (result != 3)
-                        fprintf(fp, "Error in line %d of hex file\n", recordNb);
-
-                    /* Adjust nb_bytes for the number of data bytes */
-                    nb_bytes = nb_bytes - 4;
-                    break;
-
-                /* 32 bits address */
-                case '3':
-                    result = sscanf(line, "S%1x%2x%8x", &type, &nb_bytes, &first_word);
-                    if (result != 3)
-                        fprintf(fp, "Error in line %d of hex file\n", recordNb);
-
-                    /* Adjust nb_bytes for the number of data bytes */
-                    nb_bytes = nb_bytes - 5;
-                    break;
-            }
-
-            g_phys_addr = first_word;
-
-            /* Set the lowest address as base pointer. */
-            if (g_phys_addr < g_lowest_address) {
-                g_lowest_address = g_phys_addr;
-            }
-
-            /* Same for the top address. */
-            temp = g_phys_addr + nb_bytes - 1;
-
-            if (temp > g_highest_address) {
-                g_highest_address = temp;
-            }
-        }
-    } while (!feof(fileIn));
-}
-
-static void verify_checksum(uint32_t record_checksum, uint8_t cs, uint16_t record_nb)
-{
-    /* Verify checksum value. */
-    if (((record_checksum + cs) != 0xFF) && GetEnableChecksumError()) {
-        fprintf(fp, "checksum error in record %d: should be %02X\n", record_nb, 255 - cs);
-        SetStatusChecksumError(true);
-    }
-}
-
-static void read_file_process_lines(uint8_t *memory_block, char *line)
-{
-    int i;
-    FILE *fileIn = NULL;
-    uint16_t recordNb = 0;
-    uint32_t nb_bytes = 0;
-    int result;
-
-    uint32_t exec_address;
-    uint32_t record_count;
-    uint32_t record_checksum;
-    uint32_t type;
-    uint32_t address;
-    uint8_t checksum = 0;
-
-    uint8_t data_str[MAX_LINE_SIZE];
-    char *p;
-
-    /* Read the file & process the lines. */
-    do { /* repeat until EOF(fileIn) */
-        /* Read a line from input file. */
-        fileIn = GetInFile();
-        GetLine(line, fileIn);
-        recordNb++;
-
-        /* Remove carriage return/line feed at the end of line. */
-        i = strlen(line);
-
-        if (--i == 0) {
-            continue;
-        }
-        if (line[i] == '\n') {
-            line[i] = '\0';
-        }
-
-        /* Scan starting address and nb of bytes. */
-        /* Look at the record type after the 'S' */
-        type = 0;
-        p = (char *)data_str;
-
-        switch (line[1]) {
-            case '0':
-                result = sscanf(line, "S0%2x0000484452%2x", &nb_bytes, &record_checksum);
-                if (result != 2)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + 0x48 + 0x44 + 0x52;
-
-                /* Adjust nb_bytes for the number of data bytes */
-                nb_bytes = 0;
-                break;
-            /* 16 bits address */
-            case '1':
-                result = sscanf(line, "S%1x%2x%4x%s", &type, &nb_bytes, &address, p);
-                if (result != 4)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + (address >> 8) + (address & 0xFF);
-
-                /* Adjust nb_bytes for the number of data bytes */
-                nb_bytes = nb_bytes - 3;
-                break;
-            /* 24 bits address */
-            case '2':
-                result = sscanf(line, "S%1x%2x%6x%s", &type, &nb_bytes, &address, p);
-                if (result != 4)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + (address >> 16) + (address >> 8) + (address & 0xFF);
-
-                /* Adjust nb_bytes for the number of data bytes */
-                nb_bytes = nb_bytes - 4;
-                break;
-            /* 32 bits address */
-            case '3':
-                result = sscanf(line, "S%1x%2x%8x%s", &type, &nb_bytes, &address, p);
-                if (result != 4)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + (address >> 24) + (address >> 16) + (address >> 8) + (address & 0xFF);
-
-                /* Adjust nb_bytes for the number of data bytes */
-                nb_bytes = nb_bytes - 5;
-                break;
-            case '5':
-                result = sscanf(line, "S%1x%2x%4x%2x", &type, &nb_bytes, &record_count, &record_checksum);
-                if (result != 4)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + (record_count >> 8) + (record_count & 0xFF);
-
-                /* Adjust nb_bytes for the number of data bytes */
-                nb_bytes = 0;
-                break;
-            case '7':
-                result = sscanf(line, "S%1x%2x%8x%2x", &type, &nb_bytes, &exec_address, &record_checksum);
-                if (result != 4)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + (exec_address >> 24) + (exec_address >> 16) + (exec_address >> 8) +
-                    (exec_address & 0xFF);
-                nb_bytes = 0;
-                break;
-            case '8':
-                result = sscanf(line, "S%1x%2x%6x%2x", &type, &nb_bytes, &exec_address, &record_checksum);
-                if (result != 4)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + (exec_address >> 16) + (exec_address >> 8) + (exec_address & 0xFF);
-                nb_bytes = 0;
-                break;
-            case '9':
-                result = sscanf(line, "S%1x%2x%4x%2x", &type, &nb_bytes, &exec_address, &record_checksum);
-                if (result != 4)
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                checksum = nb_bytes + (exec_address >> 8) + (exec_address & 0xFF);
-                nb_bytes = 0;
-                break;
-        }
-
-        /* If we're reading the last record, ignore it. */
-        switch (type) {
-            /* Data record */
-            case 1:
-            case 2:
-            case 3:
-                if (nb_bytes == 0) {
-                    fprintf(fp, "0 byte length Data record ignored\n");
-                    break;
-                }
-                g_phys_addr = address;
-
-                p = ReadDataBytes(p, memory_block, &checksum, recordNb, nb_bytes);
-
-                /* Read the checksum value. */
-                result = sscanf(p, "%2x", &record_checksum);
-                if (result != 1) {
-                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
-                }
-                break;
-
-            case 5:
-                fprintf(fp, "Record total: %d\n", record_count);
-                break;
-
-            case 7:
-                fprintf(fp, "Execution address (unused): %08X\n", exec_address);
-                break;
-
-            case 8:
-                fprintf(fp, "Execution address (unused): %06X\n", exec_address);
-                break;
-
-            case 9:
-                fprintf(fp, "Execution address (unused): %04X\n", exec_address);
-                break;
-
-            /* Ignore all other records */
-            default:;
-        }
-
-        record_checksum &= 0xFF;
-
-        /* Verify checksum value. */
-        verify_checksum(record_checksum, checksum, recordNb);
-    } while (!feof(fileIn));
-}
-
-int main(int argc, char *argv[])
-{
-    /* line inputted from file */
-    char line[MAX_LINE_SIZE];
-
     char extension[MAX_EXTENSION_SIZE];
     char file_name[MAX_FILE_NAME_SIZE];
-    uint32_t records_start;
+    uint64_t records_start;
+    uint64_t file_size;
+    uint32_t record_count;
     uint8_t *memory_block = NULL;
+    bool verified = true;
+    int first_file;
+    int nb_files;
+
+    /* Reuses the memory of a previous conversion in the same process */
+    MemoryReset();
 
     fp = fopen("log.txt", "w");
     if (fp == NULL) {
@@ -331,60 +94,129 @@ int main(int argc, char *argv[])
 
     strcpy(extension, "bin"); /* default is for binary file extension */
 
-    ParseOptions(argc, argv);
+    first_file = ParseOptions(argc, argv);
+    nb_files = argc - first_file;
+
+    /* The file names follow the options, the binary file is named after the first one */
+    GetFilename(file_name, argv[first_file]);
 
-    /* when user enters input file name */
-    /* Assume last parameter is filename */
-    GetFilename(file_name, argv[argc - 1]);
+    /* The base of --delta is read before the input file is opened */
+    if (DeltaEnabled()) {
+        DeltaReadBase(file_name, NULL, SrecReadRecords);
+    }
+
+    /* --verify of a binary file: no records to decode */
+    if (GetVerifyOnly() && IsBinaryFileName(file_name)) {
+        verified = VerifyBinaryFile(file_name);
+        fclose(fp);
+        return verified ? 0 : 1;
+    }
 
-    /* Just a normal file name */
-    if (NoFailOpenInputFile(file_name) == false) {
+    /* Several files are opened one after the other by ReadInputFiles() */
+    if ((nb_files == 1) && (NoFailOpenInputFile(file_name) == false)) {
         return 1;
     }
+
+    /*
+     * Each region goes to its own file. The region buffers grow with the
+     * records, so the file is read once and the absolute address is used.
+     */
+    if (RegionsDefined()) {
+        g_lowest_address = 0;
+        g_highest_address = (uint64_t)-1;
+        StatsBegin(STATS_DECODE);
+        if (nb_files > 1) {
+            ReadInputFiles(nb_files, argv + first_file, NULL, SrecReadRecords);
+        } else {
+            SrecReadRecords();
+        }
+        StatsEnd();
+        StatsBegin(STATS_WRITE);
+        RegionsWriteOutFiles(file_name, extension);
+        StatsEnd();
+        StatsReport();
+
+        ScannerEnd();
+        NoFailCloseInputFile(NULL);
+        fclose(fp);
+        return (GetStatusChecksumError() && GetEnableChecksumError()) ? 1 : 0;
+    }
+
     PutExtension(file_name, extension);
-    NoFailOpenOutputFile(file_name);
 
     /*
-     * When the hex file is opened, the program will read it in 2 passes.
-     * The first pass gets the highest and lowest addresses so that we can allocate the right size.
-     * The second pass processes the hex data.
-     *
-     * To begin, assume the lowest address is at the end of the memory.
-     * While reading each records, subsequent addresses will lower this number.
-     * At the end of the input file, this value will be the lowest address.
-     * A similar assumption is made for highest address. It starts at the
-     * beginning of memory. While reading each records, subsequent addresses will raise this number.
-     * At the end of the input file, this value will be the highest address.
+     * The file is read once: the image grows with the records and is cut to
+     * the lowest and highest addresses at the end. The S5/S6 record count,
+     * with the size of the first record, gives the size to allocate first.
+     * Several files are read into the same image.
      */
-    g_lowest_address = (uint32_t)-1;
-    g_highest_address = 0;
+    if (ExtractEnabled()) {
+        /* --extract: only the records of the range are decoded, found with the index of the file */
+        ImageBegin(0, 0);
+        ExtractReadRecords(argv[first_file], NULL, SrecExtractRecord);
+    } else if (nb_files > 1) {
+        StatsBegin(STATS_DECODE);
+        ImageBegin(0, 0);
+        ReadInputFiles(nb_files, argv + first_file, NULL, SrecReadRecords);
+        StatsEnd();
+    } else {
+        StatsBegin(STATS_SCAN);
+        record_count = SrecRecordCountHint(&file_size);
+        StatsEnd();
+        StatsBegin(STATS_DECODE);
+        ImageBegin(record_count, file_size / 2);
+        SrecReadRecords();
+        StatsEnd();
+    }
 
-    get_highest_and_lowest_addresses(line);
-    records_start = g_lowest_address;
-    Allocate_Memory_And_Rewind(&memory_block);
-    read_file_process_lines(memory_block, line);
+    /* The decompressor of the file is checked before the binary file is created */
+    ScannerEnd();
+    NoFailCloseInputFile(NULL);
+    NoFailOpenOutputFile(file_name);
+    StatsBegin(STATS_ALLOCATE);
+    records_start = ImageEnd(&memory_block);
+    StatsEnd();
 
-    fprintf(fp, "Binary file start = 0x%08X\n", g_lowest_address);
-    fprintf(fp, "Records start     = 0x%08X\n", records_start);
-    fprintf(fp, "Highest address   = 0x%08X\n", g_highest_address);
+    fprintf(fp, "Binary file start = 0x%08" PRIX64 "\n", g_lowest_address);
+    fprintf(fp, "Records start     = 0x%08" PRIX64 "\n", records_start);
+    fprintf(fp, "Highest address   = 0x%08" PRIX64 "\n", g_highest_address);
     fprintf(fp, "Pad Byte          = 0x%X\n\n", GetPadByte());
 
-    WriteMemory(memory_block);
+    StatsBegin(STATS_CHECK);
+    SwapWords(memory_block);
+    if (PagesEnabled()) {
+        PagesWrite(file_name, memory_block);
+    }
+    if (GetVerifyOnly()) {
+        verified = VerifyMemory(memory_block);
+    } else {
+        WriteMemory(memory_block);
+    }
+    StatsEnd();
+    StatsBegin(STATS_WRITE);
+    if (DeltaEnabled()) {
+        DeltaWrite(file_name, memory_block);
+    }
     WriteOutFile(&memory_block);
+    StatsEnd();
+    StatsReport();
 
-#ifdef USE_FILE_BUFFERS
-    free(FilinBuf);
-    free(FiloutBuf);
-#endif
-
+    ScannerEnd();
     NoFailCloseInputFile(NULL);
     NoFailCloseOutputFile(NULL);
-    fclose(fp);
 
     if (GetStatusChecksumError() && GetEnableChecksumError()) {
         fprintf(fp, "checksum error detected.\n");
+        fclose(fp);
         return 1;
     }
 
-    return 0;
+    fclose(fp);
+    return verified ? 0 : 1;
+}
+
+/* The conversion, here, on each change of the files (--watch) or by a resident converter (--daemon, --connect) */
+int main(int argc, char *argv[])
+{
+    return WatchMain(argc, argv, Convert, NULL, SrecExtractRecord);
 }
@@ -0,0 +1,238 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Record scanner: the input file is read by blocks and each line is
+  returned in place, without copy. The line ends are found with memchr().
+  LF, CR LF and CR line ends are supported, and lines of any length.
+  The file offset of each line is kept for the index of --extract, which
+  also reads a part of the file alone (ScannerBeginAt()).
+*/
+#if defined(__linux__)
+#define _GNU_SOURCE
+#elif !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "stats.h"
+#include "aio.h"
+#include "arena.h"
+#include "scanner.h"
+
+#define SCAN_BLOCK_SIZE 0x10000
+
+#if defined(_WIN32)
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+static FILE *scan_in = NULL;
+static char *scan_buffer = NULL;
+static size_t scan_size;  /* without the byte for the '\0' after the last line */
+static size_t scan_begin; /* first byte not returned yet */
+static size_t scan_end;   /* end of the bytes read */
+static bool scan_eof;
+static char scan_start; /* record start character */
+static char scan_eol;   /* '\n', '\r' for files with CR line ends, 0 until the first line end */
+static uint64_t scan_base; /* file offset of the first byte of the buffer */
+static uint64_t scan_line; /* file offset of the last line */
+
+/* Start reading in at its current position */
+void ScannerBegin(FILE *in, char start)
+{
+    int64_t position = (int64_t)ftello(in);
+
+    if (scan_buffer == NULL) {
+        scan_size = SCAN_BLOCK_SIZE;
+        scan_buffer = (char *)PoolAlloc(scan_size + 1, NULL);
+    }
+
+    scan_base = (position > 0) ? (uint64_t)position : 0;
+    scan_line = scan_base;
+    AioBegin(in);
+    scan_in = in;
+    scan_begin = 0;
+    scan_end = 0;
+    scan_eof = false;
+    scan_start = start;
+    scan_eol = 0;
+}
+
+/* Read the length bytes of in at offset only, for --extract; false if they can't be read */
+bool ScannerBeginAt(FILE *in, char start, uint64_t offset, size_t length)
+{
+    if ((scan_buffer == NULL) || (scan_size < length)) {
+        PoolRelease((uint8_t *)scan_buffer);
+        scan_size = (length > SCAN_BLOCK_SIZE) ? length : SCAN_BLOCK_SIZE;
+        scan_buffer = (char *)PoolAlloc(scan_size + 1, NULL);
+    }
+
+    AioEnd();
+    scan_in = in;
+    scan_base = offset;
+    scan_line = offset;
+    scan_begin = 0;
+    scan_end = 0;
+    scan_eof = true;
+    scan_start = start;
+    scan_eol = 0;
+    if ((fseeko(in, (off_t)offset, SEEK_SET) != 0) || (fread(scan_buffer, 1, length, in) != length)) {
+        return false;
+    }
+    scan_end = length;
+    return true;
+}
+
+/* File offset of the line returned last */
+uint64_t ScannerLineOffset(void)
+{
+    return scan_line;
+}
+
+/* File offset of the text of the record returned last */
+uint64_t ScannerRecordOffset(const struct Record *record)
+{
+    return scan_base + (uint64_t)(record->text - scan_buffer);
+}
+
+void ScannerEnd(void)
+{
+    AioEnd();
+    PoolRelease((uint8_t *)scan_buffer);
+    scan_buffer = NULL;
+    scan_in = NULL;
+}
+
+/* Read the next block after the current line, the buffer grows for long lines */
+static void ScannerFill(void)
+{
+    size_t nb;
+
+    if (scan_begin != 0) {
+        scan_base += scan_begin;
+        memmove(scan_buffer, scan_buffer + scan_begin, scan_end - scan_begin);
+        scan_end -= scan_begin;
+        scan_begin = 0;
+    }
+
+    if (scan_end == scan_size) {
+        scan_size *= 2;
+        scan_buffer = (char *)PoolRealloc((uint8_t *)scan_buffer, scan_size + 1);
+    }
+
+    nb = AioRead(scan_buffer + scan_end, scan_size - scan_end);
+    scan_end += nb;
+    if (nb == 0) {
+        if (ferror(scan_in)) {
+            fprintf(fp, "Error occurred while reading from file\n");
+        }
+        scan_eof = true;
+
+        /* The file position is now at the end, as with fread */
+        AioEnd();
+    }
+}
+
+/* Returns the line end, NULL if it isn't in the buffer yet */
+static char *FindLineEnd(char *line, size_t nb)
+{
+    char *end = line + nb;
+    char *p;
+
+    /* The first line end gives the line end of the file */
+    if (scan_eol == 0) {
+        for (p = line; p < end; p++) {
+            if ((*p == '\n') || (*p == '\r')) {
+                break;
+            }
+        }
+        if (p == end) {
+            return NULL;
+        }
+        if (*p == '\r') {
+            if ((p + 1 == end) && !scan_eof) {
+                return NULL;
+            }
+            scan_eol = ((p + 1 < end) && (p[1] == '\n')) ? '\n' : '\r';
+        } else {
+            scan_eol = '\n';
+        }
+    }
+
+    return (char *)memchr(line, scan_eol, nb);
+}
+
+/* Returns false at the end of the file */
+bool ScannerNextLine(struct Record *record)
+{
+    char *line;
+    char *eol;
+    char *start;
+    size_t length;
+
+    for (;;) {
+        line = scan_buffer + scan_begin;
+        eol = FindLineEnd(line, scan_end - scan_begin);
+        if (eol != NULL) {
+            scan_begin = (size_t)(eol - scan_buffer) + 1;
+            break;
+        }
+        if (scan_eof) {
+            /* Last line without line end */
+            if (scan_begin == scan_end) {
+                return false;
+            }
+            eol = scan_buffer + scan_end;
+            scan_begin = scan_end;
+            break;
+        }
+        ScannerFill();
+    }
+
+    scan_line = scan_base + (uint64_t)(line - scan_buffer);
+    length = (size_t)(eol - line);
+    if ((scan_eol == '\n') && (length != 0) && (line[length - 1] == '\r')) {
+        length--;
+    }
+    line[length] = '\0';
+
+    /* Skip what comes before the record start */
+    if ((length != 0) && (*line != scan_start)) {
+        start = (char *)memchr(line, scan_start, length);
+        if (start != NULL) {
+            length -= (size_t)(start - line);
+            line = start;
+        }
+    }
+
+    record->text = line;
+    record->length = length;
+    STATS_ADD_PHASE(records, 1);
+
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* A line of the input file, in the scanner buffer */
+struct Record {
+    char *text;    /* record start character, or first character of the line */
+    size_t length; /* without the line end; text[length] is '\0' */
+};
+
+extern void ScannerBegin(FILE *in, char start);
+extern bool ScannerNextLine(struct Record *record);
+extern void ScannerEnd(void);
+extern bool ScannerBeginAt(FILE *in, char start, uint64_t offset, size_t length);
+extern uint64_t ScannerLineOffset(void);
+extern uint64_t ScannerRecordOffset(const struct Record *record);
+
+#endif
@@ -0,0 +1,330 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Motorola S-record decoder, from mot2bin: used by mot2bin and by hex2bin
+  for the S-record files among its inputs.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "stats.h"
+#include "scanner.h"
+#include "srec.h"
+
+/* Bytes read at the end of the file for the S5/S6 record */
+#define COUNT_TAIL_SIZE 512
+
+/*
+ * The S5/S6 record count is near the end of the file: read the last lines
+ * to size the image before the single pass. Returns 0 if there is none.
+ */
+uint32_t SrecRecordCountHint(uint64_t *file_size)
+{
+    FILE *fileIn = GetInFile();
+    char line[MAX_LINE_SIZE];
+    long size;
+    uint32_t nb_bytes;
+    uint32_t count;
+    uint32_t record_checksum;
+    uint32_t hint = 0;
+
+    *file_size = 0;
+    if ((fseek(fileIn, 0, SEEK_END) != 0) || ((size = ftell(fileIn)) < 0)) {
+        return 0;
+    }
+    *file_size = (uint64_t)size;
+
+    fseek(fileIn, (size > COUNT_TAIL_SIZE) ? size - COUNT_TAIL_SIZE : 0, SEEK_SET);
+    while (fgets(line, sizeof(line), fileIn) != NULL) {
+        /* The first line can be cut: only records with a good checksum are used */
+        if (sscanf(line, "S503%4x%2x", &count, &record_checksum) == 2) {
+            nb_bytes = 3 + (count >> 8) + (count & 0xFF) + record_checksum;
+        } else if (sscanf(line, "S604%6x%2x", &count, &record_checksum) == 2) {
+            nb_bytes = 4 + (count >> 16) + ((count >> 8) & 0xFF) + (count & 0xFF) + record_checksum;
+        } else {
+            continue;
+        }
+        if ((nb_bytes & 0xFF) == 0xFF) {
+            hint = count;
+        }
+    }
+
+    rewind(fileIn);
+    return hint;
+}
+
+static void verify_checksum(uint32_t record_checksum, uint8_t cs, uint16_t record_nb)
+{
+    /* Verify checksum value. */
+    if (((record_checksum + cs) != 0xFF) && GetEnableChecksumError()) {
+        fprintf(fp, "checksum error in record %d: should be %02X\n", record_nb, 255 - cs);
+        STATS_ADD(checksum_errors, 1);
+        SetStatusChecksumError(true);
+    }
+}
+
+/* Header of a data record, "Stlladdress"; returns the number of fields read, as sscanf() */
+static int read_data_header(const struct Record *record, uint32_t address_digits, uint32_t *type,
+    uint32_t *nb_bytes, uint32_t *address, char **data)
+{
+    char *p = record->text;
+
+    *data = p + ((record->length > 4 + address_digits) ? 4 + address_digits : record->length);
+
+    if ((*p != 'S') || (GetHexDigits(p + 1, 1, type) == false)) {
+        return 0;
+    }
+    if (GetHexDigits(p + 2, 2, nb_bytes) == false) {
+        return 1;
+    }
+    if (GetHexDigits(p + 4, address_digits, address) == false) {
+        return 2;
+    }
+
+    return (record->length > 4 + address_digits) ? 4 : 3;
+}
+
+/* --extract: address and data of a data record (S1, S2 or S3); the addresses have no state */
+bool SrecExtractRecord(const struct Record *record, uint32_t *state, uint64_t *address, uint8_t *data,
+    uint32_t *nb_bytes)
+{
+    uint8_t bytes[256];
+    uint32_t address_bytes;
+    uint32_t value;
+    uint32_t count;
+    uint32_t type;
+    uint8_t cs = 0;
+    uint32_t i;
+    char *p;
+
+    (void)state;
+    if ((record->length < 2) || (record->text[0] != 'S') || (record->text[1] < '1') || (record->text[1] > '3')) {
+        return false;
+    }
+    address_bytes = (uint32_t)(record->text[1] - '0') + 1;
+    if ((read_data_header(record, 2 * address_bytes, &type, &count, &value, &p) != 4) ||
+        (count <= address_bytes + 1)) {
+        return false;
+    }
+    *address = value;
+    *nb_bytes = count - address_bytes - 1;
+    if (data == NULL) {
+        return true;
+    }
+
+    /* Count, address, data and checksum */
+    if (DecodeHexData(record->text + 2, bytes, count + 1) < count + 1) {
+        fprintf(fp, "Error in record at %08" PRIX64 "\n", *address);
+        return false;
+    }
+    for (i = 0; i <= count; i++) {
+        cs += bytes[i];
+    }
+    if ((cs != 0xFF) && GetEnableChecksumError()) {
+        fprintf(fp, "checksum error in record at %08" PRIX64 "\n", *address);
+        STATS_ADD(checksum_errors, 1);
+        SetStatusChecksumError(true);
+    }
+    memcpy(data, bytes + 1 + address_bytes, *nb_bytes);
+    return true;
+}
+
+void SrecReadRecords(void)
+{
+    struct Record record;
+    char *line;
+    uint16_t recordNb = 0;
+    uint32_t nb_bytes = 0;
+    int result;
+    uint32_t data_records = 0;
+    bool count_record = false;
+
+    uint32_t exec_address;
+    uint32_t record_count;
+    uint32_t record_checksum;
+    uint32_t type;
+    uint32_t address;
+    uint8_t checksum = 0;
+    char *p = NULL;
+
+    /* Read the file & process the lines. */
+    ScannerBegin(GetInFile(), 'S');
+    while (ScannerNextLine(&record)) {
+        recordNb++;
+
+        if (record.length == 0) {
+            continue;
+        }
+        line = record.text;
+
+        /* Scan starting address and nb of bytes. */
+        /* Look at the record type after the 'S' */
+        type = 0;
+        result = 0;
+
+        switch (line[1]) {
+            case '0':
+                result = sscanf(line, "S0%2x0000484452%2x", &nb_bytes, &record_checksum);
+                if (result != 2)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + 0x48 + 0x44 + 0x52;
+
+                /* Adjust nb_bytes for the number of data bytes */
+                nb_bytes = 0;
+                break;
+            /* 16 bits address */
+            case '1':
+                result = read_data_header(&record, 4, &type, &nb_bytes, &address, &p);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (address >> 8) + (address & 0xFF);
+
+                /* Adjust nb_bytes for the number of data bytes */
+                nb_bytes = nb_bytes - 3;
+                break;
+            /* 24 bits address */
+            case '2':
+                result = read_data_header(&record, 6, &type, &nb_bytes, &address, &p);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (address >> 16) + (address >> 8) + (address & 0xFF);
+
+                /* Adjust nb_bytes for the number of data bytes */
+                nb_bytes = nb_bytes - 4;
+                break;
+            /* 32 bits address */
+            case '3':
+                result = read_data_header(&record, 8, &type, &nb_bytes, &address, &p);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (address >> 24) + (address >> 16) + (address >> 8) + (address & 0xFF);
+
+                /* Adjust nb_bytes for the number of data bytes */
+                nb_bytes = nb_bytes - 5;
+                break;
+            case '5':
+                result = sscanf(line, "S%1x%2x%4x%2x", &type, &nb_bytes, &record_count, &record_checksum);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (record_count >> 8) + (record_count & 0xFF);
+
+                /* Adjust nb_bytes for the number of data bytes */
+                nb_bytes = 0;
+                break;
+            case '6':
+                result = sscanf(line, "S%1x%2x%6x%2x", &type, &nb_bytes, &record_count, &record_checksum);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (record_count >> 16) + (record_count >> 8) + (record_count & 0xFF);
+
+                /* Adjust nb_bytes for the number of data bytes */
+                nb_bytes = 0;
+                break;
+            case '7':
+                result = sscanf(line, "S%1x%2x%8x%2x", &type, &nb_bytes, &exec_address, &record_checksum);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (exec_address >> 24) + (exec_address >> 16) + (exec_address >> 8) +
+                    (exec_address & 0xFF);
+                nb_bytes = 0;
+                break;
+            case '8':
+                result = sscanf(line, "S%1x%2x%6x%2x", &type, &nb_bytes, &exec_address, &record_checksum);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (exec_address >> 16) + (exec_address >> 8) + (exec_address & 0xFF);
+                nb_bytes = 0;
+                break;
+            case '9':
+                result = sscanf(line, "S%1x%2x%4x%2x", &type, &nb_bytes, &exec_address, &record_checksum);
+                if (result != 4)
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                checksum = nb_bytes + (exec_address >> 8) + (exec_address & 0xFF);
+                nb_bytes = 0;
+                break;
+        }
+
+        /* If we're reading the last record, ignore it. */
+        switch (type) {
+            /* Data record */
+            case 1:
+            case 2:
+            case 3:
+                data_records++;
+                if (result < 3) {
+                    break;
+                }
+                if (nb_bytes == 0) {
+                    fprintf(fp, "0 byte length Data record ignored\n");
+                    break;
+                }
+                if (nb_bytes > MAX_LINE_SIZE / 2) {
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                    break;
+                }
+
+                /* Single pass or regions: g_lowest_address is 0 */
+                g_phys_addr = (uint64_t)address - g_lowest_address;
+
+                p = ReadDataBytes(p, NULL, &checksum, recordNb, nb_bytes);
+
+                /* Read the checksum value. */
+                if (GetHexDigits(p, 2, &record_checksum) == false) {
+                    fprintf(fp, "Error in line %d of hex file\n", recordNb);
+                }
+                break;
+
+            case 5:
+            case 6:
+                fprintf(fp, "Record total: %d\n", record_count);
+                count_record = true;
+                break;
+
+            case 7:
+                fprintf(fp, "Execution address (unused): %08X\n", exec_address);
+                break;
+
+            case 8:
+                fprintf(fp, "Execution address (unused): %06X\n", exec_address);
+                break;
+
+            case 9:
+                fprintf(fp, "Execution address (unused): %04X\n", exec_address);
+                break;
+
+            /* Ignore all other records */
+            default:;
+        }
+
+        record_checksum &= 0xFF;
+
+        /* Verify checksum value. */
+        verify_checksum(record_checksum, checksum, recordNb);
+    }
+
+    if (count_record && (record_count != data_records)) {
+        fprintf(fp, "Record count %u differs from the %u data records read\n", record_count, data_records);
+    }
+}
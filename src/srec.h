@@ -0,0 +1,15 @@
+#ifndef SREC_H
+#define SREC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct Record;
+
+/* Decoder of Motorola S-record files, in a single pass (ImageBegin()) or into regions */
+extern uint32_t SrecRecordCountHint(uint64_t *file_size);
+extern void SrecReadRecords(void);
+extern bool SrecExtractRecord(const struct Record *record, uint32_t *state, uint64_t *address, uint8_t *data,
+    uint32_t *nb_bytes);
+
+#endif
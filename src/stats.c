@@ -0,0 +1,200 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Time and counters of each phase of a conversion (--stats option).
+*/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "common.h"
+#include "stats.h"
+
+struct Stats stats;
+
+static bool stats_enabled = false;
+static bool stats_json = false;
+static uint64_t phase_start_ns;
+static long phase_start_pos;
+
+static const char *phase_names[STATS_PHASES] = {
+    "scan",
+    "allocate",
+    "decode",
+    "check",
+    "write",
+};
+
+static uint64_t GetTimeNs(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER count;
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)(count.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Position in the input file, to count the bytes read by a phase */
+static long GetInputPosition(void)
+{
+    FILE *file_in = GetInFile();
+
+    return (file_in != NULL) ? ftell(file_in) : 0;
+}
+
+/* Peak resident size of this process image in KB, 0 if unknown */
+static uint64_t GetPeakRss(void)
+{
+    uint64_t peak = 0;
+#if defined(__linux__)
+    /* Not getrusage(): its maximum includes the parent's memory before exec() */
+    char line[128];
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (status == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (sscanf(line, "VmHWM: %" SCNu64, &peak) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+#endif
+    return peak;
+}
+
+void StatsEnable(bool json)
+{
+    stats_enabled = true;
+    stats_json = json;
+}
+
+bool StatsEnabled(void)
+{
+    return stats_enabled;
+}
+
+void StatsBegin(enum StatsPhase phase)
+{
+    stats.current = phase;
+
+    if (stats_enabled) {
+        phase_start_pos = GetInputPosition();
+        phase_start_ns = GetTimeNs();
+    }
+}
+
+void StatsEnd(void)
+{
+    struct StatsPhaseCounters *counters = &stats.phase[stats.current];
+    long position;
+
+    if (stats_enabled) {
+        counters->time_ns += GetTimeNs() - phase_start_ns;
+
+        /* After rewind() or at EOF ftell() gives the bytes read by the phase */
+        position = GetInputPosition();
+        if (position > phase_start_pos) {
+            counters->input_bytes += (uint64_t)(position - phase_start_pos);
+        }
+    }
+}
+
+static void StatsReportText(FILE *out)
+{
+    uint64_t total_ns = 0;
+    uint32_t i;
+
+    fprintf(out, "%s statistics\n", program_name);
+    fprintf(out, "phase        time (ms)      records  input bytes   data bytes\n");
+    for (i = 0; i < STATS_PHASES; i++) {
+        total_ns += stats.phase[i].time_ns;
+        fprintf(out, "%-9s %12.3f %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n", phase_names[i],
+            stats.phase[i].time_ns / 1e6, stats.phase[i].records, stats.phase[i].input_bytes,
+            stats.phase[i].data_bytes);
+    }
+    fprintf(out, "%-9s %12.3f\n", "total", total_ns / 1e6);
+    fprintf(out,
+        "overlapped bytes: %" PRIu64 ", file conflicts: %" PRIu64 ", skipped bytes: %" PRIu64
+        ", checksum errors: %" PRIu64 "\n",
+        stats.overlaps, stats.conflicts, stats.skipped, stats.checksum_errors);
+    fprintf(out, "allocations: %" PRIu64 ", allocated bytes: %" PRIu64 ", recycled buffers: %" PRIu64
+                 ", spilled bytes: %" PRIu64 ", peak RSS: %" PRIu64 " KB\n",
+        stats.allocations, stats.allocated_bytes, stats.recycled, stats.spilled_bytes, GetPeakRss());
+}
+
+static void StatsReportJson(FILE *out)
+{
+    uint64_t total_ns = 0;
+    uint32_t i;
+
+    fprintf(out, "{\"program\": \"%s\", \"phases\": {", program_name);
+    for (i = 0; i < STATS_PHASES; i++) {
+        total_ns += stats.phase[i].time_ns;
+        fprintf(out, "%s\"%s\": {\"time_ms\": %.3f, \"records\": %" PRIu64 ", \"input_bytes\": %" PRIu64
+                     ", \"data_bytes\": %" PRIu64 "}",
+            (i == 0) ? "" : ", ", phase_names[i], stats.phase[i].time_ns / 1e6, stats.phase[i].records,
+            stats.phase[i].input_bytes, stats.phase[i].data_bytes);
+    }
+    fprintf(out,
+        "}, \"total_ms\": %.3f, \"overlaps\": %" PRIu64 ", \"conflicts\": %" PRIu64 ", \"skipped\": %" PRIu64
+        ", \"checksum_errors\": %" PRIu64 ", \"allocations\": %" PRIu64 ", \"allocated_bytes\": %" PRIu64
+        ", \"recycled\": %" PRIu64 ", \"spilled_bytes\": %" PRIu64 ", \"peak_rss_kb\": %" PRIu64 "}\n",
+        total_ns / 1e6, stats.overlaps, stats.conflicts, stats.skipped, stats.checksum_errors, stats.allocations,
+        stats.allocated_bytes, stats.recycled, stats.spilled_bytes, GetPeakRss());
+}
+
+/* The report goes to stdout, or stderr when the binary file does; the messages stay in log.txt */
+void StatsReport(void)
+{
+    FILE *out = GetOutputStdout() ? stderr : stdout;
+
+    if (!stats_enabled) {
+        return;
+    }
+
+    if (stats_json) {
+        StatsReportJson(out);
+    } else {
+        StatsReportText(out);
+    }
+}
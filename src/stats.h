@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Phases of a conversion, in the order they run */
+enum StatsPhase {
+    STATS_SCAN = 0, /* first pass: highest and lowest addresses */
+    STATS_ALLOCATE, /* image allocation and pad fill */
+    STATS_DECODE,   /* second pass: records to image */
+    STATS_CHECK,    /* check value or forced value */
+    STATS_WRITE,    /* output file */
+    STATS_PHASES
+};
+
+struct StatsPhaseCounters {
+    uint64_t time_ns;
+    uint64_t records;     /* lines read */
+    uint64_t input_bytes; /* bytes read from the input file */
+    uint64_t data_bytes;  /* bytes stored in the image or written out */
+};
+
+struct Stats {
+    struct StatsPhaseCounters phase[STATS_PHASES];
+    enum StatsPhase current;
+    uint64_t overlaps;  /* bytes written over data */
+    uint64_t conflicts; /* address ranges written by two input files */
+    uint64_t skipped;  /* data bytes outside of the image */
+    uint64_t checksum_errors;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint64_t recycled; /* buffers given again by the pool */
+    uint64_t spilled_bytes; /* buffers in temporary files, --max-memory */
+};
+
+extern struct Stats stats;
+
+/*
+ * The counters are simple additions, always done; only the clock and the
+ * file position are read when --stats is given. Define NO_STATS to remove
+ * the counters too.
+ */
+#ifdef NO_STATS
+#define STATS_ADD(counter, n)
+#define STATS_ADD_PHASE(counter, n)
+#else
+#define STATS_ADD(counter, n) (stats.counter += (n))
+#define STATS_ADD_PHASE(counter, n) (stats.phase[stats.current].counter += (n))
+#endif
+
+extern void StatsEnable(bool json);
+extern bool StatsEnabled(void);
+extern void StatsBegin(enum StatsPhase phase);
+extern void StatsEnd(void);
+extern void StatsReport(void);
+
+#endif
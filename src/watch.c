@@ -0,0 +1,726 @@
+/*
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  Watch mode (--watch): the input files are watched with inotify and
+  converted again on each change, by a process forked for the conversion
+  as with --daemon. The options are parsed once, here. The binary file is
+  patched in place: only the blocks that changed are written.
+
+  After the conversion of a file of records, its lines are kept with the
+  address, length and extended address of their records. On a change,
+  the new lines are compared with them: when the lines that changed are
+  data records of the same address and length, with the same extended
+  address after them, the image is the same but for their data. A process
+  decodes these records only into the binary file, mapped, and writes the
+  check value again. Any other change, records that overlap or an option
+  that doesn't write the image as it is (-R, -w, --delta...) give a
+  conversion.
+*/
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "checksum.h"
+#include "scanner.h"
+#include "extract.h"
+#include "daemon.h"
+#include "watch.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Exit status of a patch when the file has to be converted instead */
+#define WATCH_CONVERT 2
+
+/* Blocks of the input file compared */
+#define WATCH_BLOCK_SIZE 0x1000
+
+/* A line of the input file and its record */
+struct WatchLine {
+    uint64_t text;     /* file offset of the record */
+    uint64_t address;  /* of the data */
+    uint32_t length;   /* of the record, without the line end */
+    uint32_t state;    /* extended address after the line */
+    uint32_t nb_bytes; /* 0 for a line without data */
+};
+
+/* Image written by the last conversion, sent back by its process */
+struct WatchImage {
+    uint64_t address;
+    uint64_t length; /* without the padding */
+    char output[MAX_FILE_NAME_SIZE];
+};
+
+static ExtractRecordFunction watch_read_hex;
+static ExtractRecordFunction watch_read_srec;
+
+/*
+ * The lines of the file converted last, its text and the image written;
+ * the text read on a change.
+ */
+static bool watch_valid = false;
+static struct WatchLine *watch_lines = NULL;
+static uint32_t watch_line_count;
+static uint32_t watch_line_allocated = 0;
+static ExtractRecordFunction watch_record;
+static char *watch_text = NULL;
+static char *watch_next_text = NULL;
+static uint64_t watch_text_size;
+static uint64_t watch_text_allocated = 0;
+static struct WatchImage watch_image;
+
+/* Lines whose data changed */
+static uint32_t *watch_changed = NULL;
+static uint32_t watch_changed_count;
+static uint32_t watch_changed_allocated = 0;
+
+/* A record out of a text, ended by '\0' for the decoding */
+static char *watch_record_text = NULL;
+static size_t watch_record_allocated = 0;
+
+/* Opens name and reads it all in *text; the record decoding function is found from its first character */
+static FILE *ReadText(const char *name, char **text, struct stat *st, ExtractRecordFunction *record, int *start)
+{
+    FILE *in = fopen(name, "rb");
+
+    if (in == NULL) {
+        return NULL;
+    }
+    if ((fstat(fileno(in), st) != 0) || !S_ISREG(st->st_mode) || ((uint64_t)st->st_size >= SIZE_MAX / 2)) {
+        fclose(in);
+        return NULL;
+    }
+
+    /* Intel HEX or S-records, as the conversion found them */
+    *start = FirstRecordCharacter(in);
+    *record = (*start == ':') ? watch_read_hex : ((*start == 'S') ? watch_read_srec : NULL);
+    if (*record == NULL) {
+        fclose(in);
+        return NULL;
+    }
+
+    if (watch_text_allocated < (uint64_t)st->st_size + 1) {
+        watch_text_allocated = (uint64_t)st->st_size + 1;
+        watch_text = (char *)NoFailRealloc(watch_text, (size_t)watch_text_allocated);
+        watch_next_text = (char *)NoFailRealloc(watch_next_text, (size_t)watch_text_allocated);
+    }
+    rewind(in);
+    if (fread(*text, 1, (size_t)st->st_size, in) != (size_t)st->st_size) {
+        fclose(in);
+        return NULL;
+    }
+    return in;
+}
+
+/*
+ * After a conversion: the lines of the file name, with the address and
+ * the extended address of their records. False if it isn't a file of
+ * records or if it isn't the file converted, of status st.
+ */
+static bool IndexLines(const char *name, const struct stat *converted)
+{
+    struct WatchLine *line;
+    struct Record record;
+    uint64_t address = 0;
+    uint32_t nb_bytes;
+    uint32_t state = 0;
+    struct stat st;
+    FILE *in;
+    int start;
+    bool data;
+
+    in = ReadText(name, &watch_text, &st, &watch_record, &start);
+    if (in == NULL) {
+        return false;
+    }
+    if ((st.st_size != converted->st_size) || (st.st_ino != converted->st_ino) ||
+        (st.st_mtim.tv_sec != converted->st_mtim.tv_sec) || (st.st_mtim.tv_nsec != converted->st_mtim.tv_nsec) ||
+        !ScannerBeginAt(in, (char)start, 0, (size_t)st.st_size)) {
+        ScannerEnd();
+        fclose(in);
+        return false;
+    }
+    watch_text_size = (uint64_t)st.st_size;
+
+    watch_line_count = 0;
+    while (ScannerNextLine(&record)) {
+        if (watch_line_count == watch_line_allocated) {
+            watch_line_allocated = (watch_line_allocated == 0) ? 4096 : watch_line_allocated * 2;
+            watch_lines = (struct WatchLine *)NoFailRealloc(watch_lines, watch_line_allocated * sizeof(struct WatchLine));
+        }
+        nb_bytes = 0;
+        data = watch_record(&record, &state, &address, NULL, &nb_bytes);
+
+        line = &watch_lines[watch_line_count++];
+        line->text = ScannerRecordOffset(&record);
+        line->length = (uint32_t)record.length;
+        line->address = data ? address : 0;
+        line->nb_bytes = data ? nb_bytes : 0;
+        line->state = state;
+    }
+    ScannerEnd();
+    fclose(in);
+    return true;
+}
+
+/* The record of the line index in text, with the extended address of the line before */
+static bool DecodeLine(const char *text, uint32_t index, uint8_t *data, uint64_t *address, uint32_t *nb_bytes,
+    uint32_t *state)
+{
+    const struct WatchLine *line = &watch_lines[index];
+    struct Record record;
+
+    if (watch_record_allocated < (size_t)line->length + 1) {
+        watch_record_allocated = (size_t)line->length + 1;
+        watch_record_text = (char *)NoFailRealloc(watch_record_text, watch_record_allocated);
+    }
+    memcpy(watch_record_text, text + line->text, line->length);
+    watch_record_text[line->length] = '\0';
+    record.text = watch_record_text;
+    record.length = line->length;
+
+    *state = (index == 0) ? 0 : watch_lines[index - 1].state;
+    *nb_bytes = 0;
+    return watch_record(&record, state, address, data, nb_bytes);
+}
+
+/* The line whose record has the byte at offset of the text, -1 if none */
+static int64_t FindLine(uint64_t offset)
+{
+    uint32_t low = 0;
+    uint32_t high = watch_line_count;
+    uint32_t middle;
+
+    while (high - low > 1) {
+        middle = low + (high - low) / 2;
+        if (watch_lines[middle].text <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    if ((watch_line_count == 0) || (offset < watch_lines[low].text) ||
+        (offset >= watch_lines[low].text + watch_lines[low].length)) {
+        return -1;
+    }
+    return low;
+}
+
+static void AddChanged(uint32_t index)
+{
+    if (watch_changed_count == watch_changed_allocated) {
+        watch_changed_allocated = (watch_changed_allocated == 0) ? 256 : watch_changed_allocated * 2;
+        watch_changed = (uint32_t *)NoFailRealloc(watch_changed, watch_changed_allocated * sizeof(uint32_t));
+    }
+    watch_changed[watch_changed_count++] = index;
+}
+
+/*
+ * On a change: the file name is read and compared with the text of its
+ * lines, by blocks. True when the bytes that changed are in data records
+ * of the lines, which keep their address, length and extended address
+ * after them, and are in the image: they are listed in watch_changed.
+ */
+static bool CompareLines(const char *name)
+{
+    const struct WatchLine *line;
+    ExtractRecordFunction record;
+    uint64_t offset = 0;
+    uint64_t address;
+    uint64_t nb;
+    uint32_t nb_bytes;
+    uint32_t state;
+    int64_t index;
+    struct stat st;
+    FILE *in;
+    int start;
+
+    watch_changed_count = 0;
+    in = ReadText(name, &watch_next_text, &st, &record, &start);
+    if (in == NULL) {
+        return false;
+    }
+    fclose(in);
+    if ((record != watch_record) || ((uint64_t)st.st_size != watch_text_size)) {
+        return false;
+    }
+
+    while (offset < watch_text_size) {
+        nb = (watch_text_size - offset < WATCH_BLOCK_SIZE) ? watch_text_size - offset : WATCH_BLOCK_SIZE;
+        if (memcmp(watch_text + offset, watch_next_text + offset, (size_t)nb) == 0) {
+            offset += nb;
+            continue;
+        }
+        while (watch_text[offset] == watch_next_text[offset]) {
+            offset++;
+        }
+
+        index = FindLine(offset);
+        if (index < 0) {
+            return false;
+        }
+        line = &watch_lines[index];
+        if ((line->nb_bytes == 0) || !DecodeLine(watch_next_text, (uint32_t)index, NULL, &address, &nb_bytes, &state) ||
+            (address != line->address) || (nb_bytes != line->nb_bytes) || (state != line->state) ||
+            (address < watch_image.address) || (address + nb_bytes > watch_image.address + watch_image.length)) {
+            return false;
+        }
+        AddChanged((uint32_t)index);
+        offset = line->text + line->length;
+    }
+    return true;
+}
+
+struct WatchRange {
+    uint64_t first;
+    uint64_t end;
+};
+
+static int CompareRanges(const void *a, const void *b)
+{
+    const struct WatchRange *range_a = (const struct WatchRange *)a;
+    const struct WatchRange *range_b = (const struct WatchRange *)b;
+
+    return (range_a->first > range_b->first) - (range_a->first < range_b->first);
+}
+
+/* True if data records overlap: the record written last would have to be found */
+static bool LinesOverlap(void)
+{
+    struct WatchRange *ranges;
+    uint64_t end = 0;
+    uint32_t count = 0;
+    uint32_t i;
+    bool overlap = false;
+
+    /* Most files are in the order of the addresses */
+    for (i = 0; i < watch_line_count; i++) {
+        if (watch_lines[i].nb_bytes == 0) {
+            continue;
+        }
+        if (watch_lines[i].address < end) {
+            break;
+        }
+        end = watch_lines[i].address + watch_lines[i].nb_bytes;
+    }
+    if (i == watch_line_count) {
+        return false;
+    }
+
+    ranges = (struct WatchRange *)NoFailMalloc(watch_line_count * sizeof(struct WatchRange));
+    for (i = 0; i < watch_line_count; i++) {
+        if (watch_lines[i].nb_bytes != 0) {
+            ranges[count].first = watch_lines[i].address;
+            ranges[count].end = watch_lines[i].address + watch_lines[i].nb_bytes;
+            count++;
+        }
+    }
+    qsort(ranges, count, sizeof(struct WatchRange), CompareRanges);
+    for (i = 1; (i < count) && !overlap; i++) {
+        overlap = (ranges[i].first < ranges[i - 1].end);
+    }
+    free(ranges);
+    return overlap;
+}
+
+/*
+ * In the process of the patch: the changed records are decoded into the
+ * binary file, mapped, and the check value is updated from the bytes that
+ * changed. When it has to be computed again, the bytes it replaced are put
+ * back first: pad bytes or the data of the records there. Returns the
+ * exit status of a conversion, WATCH_CONVERT if the file has to be
+ * converted.
+ */
+static int PatchRecords(void)
+{
+    const struct WatchLine *line;
+    uint8_t data[256];
+    uint64_t value_address;
+    uint64_t value_size;
+    uint64_t address;
+    uint64_t first;
+    uint64_t last;
+    uint32_t nb_bytes;
+    uint32_t state;
+    uint32_t i;
+    uint8_t *image;
+    struct stat st;
+    bool updated;
+    int status = 0;
+    int fd;
+
+    fp = fopen("log.txt", "w");
+    if (fp == NULL) {
+        return 1;
+    }
+
+    fd = open(watch_image.output, O_RDWR);
+    if ((fd < 0) || (fstat(fd, &st) != 0) || ((uint64_t)st.st_size < watch_image.length)) {
+        fprintf(fp, "Output file %s changed, the input file is converted\n", watch_image.output);
+        fclose(fp);
+        return WATCH_CONVERT;
+    }
+    image = (uint8_t *)mmap(NULL, (size_t)watch_image.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED) {
+        fprintf(fp, "Can't map the output file, the input file is converted\n");
+        close(fd);
+        fclose(fp);
+        return WATCH_CONVERT;
+    }
+    g_lowest_address = watch_image.address;
+    g_highest_address = watch_image.address + watch_image.length - 1;
+
+    updated = ChecksumChangeBegin(image);
+    if (!updated && GetCheckValueRange(&value_address, &value_size)) {
+        first = (value_address > g_lowest_address) ? value_address : g_lowest_address;
+        last = value_address + value_size - 1;
+        if (last > g_highest_address) {
+            last = g_highest_address;
+        }
+        if (first <= last) {
+            memset(image + (first - g_lowest_address), GetPadByte(), (size_t)(last - first + 1));
+            for (i = 0; (i < watch_line_count) && (status == 0); i++) {
+                line = &watch_lines[i];
+                if ((line->nb_bytes == 0) || (line->address > last) || (line->address + line->nb_bytes <= first)) {
+                    continue;
+                }
+                if (!DecodeLine(watch_next_text, i, data, &address, &nb_bytes, &state)) {
+                    status = WATCH_CONVERT;
+                }
+                for (; (status == 0) && (address < line->address + nb_bytes); address++) {
+                    if ((address >= first) && (address <= last)) {
+                        image[address - g_lowest_address] = data[address - line->address];
+                    }
+                }
+            }
+        }
+    }
+
+    for (i = 0; (i < watch_changed_count) && (status == 0); i++) {
+        if (!DecodeLine(watch_next_text, watch_changed[i], data, &address, &nb_bytes, &state)) {
+            status = WATCH_CONVERT;
+            break;
+        }
+        ChecksumChange(address, image + (address - g_lowest_address), data, nb_bytes);
+        memcpy(image + (address - g_lowest_address), data, nb_bytes);
+    }
+
+    if (status == 0) {
+        fprintf(fp, "%" PRIu32 " records patched into %s\n", watch_changed_count, watch_image.output);
+        if (updated) {
+            ChecksumChangeEnd(image);
+        } else {
+            WriteMemory(image);
+        }
+        futimens(fd, NULL);
+    } else {
+        fprintf(fp, "Record error, the input file is converted\n");
+    }
+    munmap(image, (size_t)watch_image.length);
+    close(fd);
+
+    if ((status == 0) && GetStatusChecksumError() && GetEnableChecksumError()) {
+        fprintf(fp, "checksum error detected.\n");
+        status = 1;
+    }
+    fclose(fp);
+    return status;
+}
+
+static int WaitStatus(pid_t pid)
+{
+    int status;
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+/* Patches the changed records in a process, as a conversion could exit */
+static int RunPatch(void)
+{
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        return WATCH_CONVERT;
+    }
+    if (pid == 0) {
+        exit(PatchRecords());
+    }
+    return WaitStatus(pid);
+}
+
+/* Converts in a process; its image, in *image, is sent back on a pipe */
+static int RunConversion(int argc, char *argv[], int (*convert)(int argc, char *argv[]), struct WatchImage *image,
+    bool *written)
+{
+    int result_pipe[2];
+    const char *output;
+    pid_t pid;
+    int status;
+
+    *written = false;
+    if (pipe(result_pipe) != 0) {
+        return 1;
+    }
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        close(result_pipe[0]);
+        status = convert(argc, argv);
+        output = GetOutputFileName();
+        if ((status == 0) && GetImageWritten(&image->address, &image->length) && (output != NULL) &&
+            (strlen(output) < sizeof(image->output))) {
+            strcpy(image->output, output);
+            if (write(result_pipe[1], image, sizeof(*image)) != (ssize_t)sizeof(*image)) {
+                status = 1;
+            }
+        }
+        exit(status);
+    }
+
+    close(result_pipe[1]);
+    *written = (read(result_pipe[0], image, sizeof(*image)) == (ssize_t)sizeof(*image));
+    close(result_pipe[0]);
+    return WaitStatus(pid);
+}
+
+static double Milliseconds(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e3 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* The input files changed: the records are patched if only their data changed, else converted */
+static void WatchChange(int argc, char *argv[], int first_file, int (*convert)(int argc, char *argv[]))
+{
+    const char *name = argv[first_file];
+    struct timespec start;
+    struct stat st;
+    char *text;
+    bool written;
+    int status;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (watch_valid) {
+        watch_valid = false;
+        if (CompareLines(name)) {
+            status = (watch_changed_count == 0) ? 0 : RunPatch();
+            if (status != WATCH_CONVERT) {
+                if (status == 0) {
+                    text = watch_text;
+                    watch_text = watch_next_text;
+                    watch_next_text = text;
+                    watch_valid = true;
+                    printf("%s: %" PRIu32 " records patched in %.1f ms\n", name, watch_changed_count,
+                        Milliseconds(&start));
+                } else {
+                    printf("%s: patch failed, see log.txt\n", name);
+                }
+                fflush(stdout);
+                return;
+            }
+        }
+    }
+
+    /* The lines are kept if the file didn't change during the conversion */
+    if (stat(name, &st) != 0) {
+        memset(&st, 0, sizeof(st));
+    }
+    status = RunConversion(argc, argv, convert, &watch_image, &written);
+    if (status == 0) {
+        printf("%s: converted in %.1f ms\n", name, Milliseconds(&start));
+    } else {
+        printf("%s: conversion failed, see log.txt\n", name);
+    }
+    fflush(stdout);
+
+    if ((status == 0) && written && (argc - first_file == 1) && OutputPatchable() && IndexLines(name, &st)) {
+        watch_valid = !LinesOverlap();
+    }
+}
+
+/* True if an event of the buffer is a write or a rename of one of the input files */
+static bool InputChanged(const char *events, ssize_t length, int count, char *names[], const int *watches)
+{
+    const struct inotify_event *event;
+    const char *base;
+    ssize_t offset;
+    int i;
+
+    for (offset = 0; offset < length; offset += (ssize_t)(sizeof(struct inotify_event) + event->len)) {
+        event = (const struct inotify_event *)(events + offset);
+        if (event->len == 0) {
+            continue;
+        }
+        for (i = 0; i < count; i++) {
+            base = strrchr(names[i], '/');
+            base = (base != NULL) ? base + 1 : names[i];
+            if ((event->wd == watches[i]) && (strcmp(event->name, base) == 0)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int Watch(int argc, char *argv[], int (*convert)(int argc, char *argv[]))
+{
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } events;
+    struct pollfd pending;
+    char *directory;
+    char *slash;
+    int *watches;
+    int first_file;
+    int count;
+    int fd;
+    int i;
+    bool changed;
+    ssize_t nb;
+
+    fp = fopen("log.txt", "w");
+    if (fp == NULL) {
+        printf("Failed to open file.\n");
+        return 1;
+    }
+    if (argc == 1) {
+        usage(__func__, __LINE__);
+    }
+    first_file = ParseOptions(argc, argv);
+    if (first_file >= argc) {
+        usage(__func__, __LINE__);
+    }
+    fclose(fp);
+    fp = stderr;
+    SetOptionsParsed(first_file);
+    SetOutputPatched(true);
+
+    fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: --watch: %s\n", program_name, strerror(errno));
+        return 1;
+    }
+
+    /* The directory of each file is watched: a file replaced by a rename is seen too */
+    count = argc - first_file;
+    watches = (int *)NoFailMalloc(count * sizeof(int));
+    for (i = 0; i < count; i++) {
+        if (strcmp(argv[first_file + i], "-") == 0) {
+            fprintf(stderr, "%s: --watch needs input files, not stdin\n", program_name);
+            return 1;
+        }
+        directory = (char *)NoFailMalloc(strlen(argv[first_file + i]) + 2);
+        strcpy(directory, argv[first_file + i]);
+        slash = strrchr(directory, '/');
+        if (slash == NULL) {
+            strcpy(directory, ".");
+        } else {
+            slash[(slash == directory) ? 1 : 0] = '\0';
+        }
+        watches[i] = inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watches[i] < 0) {
+            fprintf(stderr, "%s: --watch: %s: %s\n", program_name, directory, strerror(errno));
+            return 1;
+        }
+        free(directory);
+    }
+
+    WatchChange(argc, argv, first_file, convert);
+    pending.fd = fd;
+    pending.events = POLLIN;
+    for (;;) {
+        nb = read(fd, events.bytes, sizeof(events.bytes));
+        if (nb <= 0) {
+            if ((nb < 0) && (errno == EINTR)) {
+                continue;
+            }
+            fprintf(stderr, "%s: --watch: %s\n", program_name, strerror(errno));
+            return 1;
+        }
+        changed = InputChanged(events.bytes, nb, count, argv + first_file, watches);
+
+        /* The other events already there are of the same change */
+        while (poll(&pending, 1, 0) > 0) {
+            nb = read(fd, events.bytes, sizeof(events.bytes));
+            if (nb <= 0) {
+                break;
+            }
+            changed = InputChanged(events.bytes, nb, count, argv + first_file, watches) || changed;
+        }
+        if (changed) {
+            WatchChange(argc, argv, first_file, convert);
+        }
+    }
+}
+#endif
+
+int WatchMain(int argc, char *argv[], int (*convert)(int argc, char *argv[]), ExtractRecordFunction read_hex,
+    ExtractRecordFunction read_srec)
+{
+    if ((argc < 2) || (strcmp(argv[1], "--watch") != 0)) {
+        return DaemonMain(argc, argv, convert);
+    }
+
+#if defined(__linux__)
+    watch_read_hex = read_hex;
+    watch_read_srec = read_srec;
+    argv[1] = argv[0];
+    return Watch(argc - 1, argv + 1, convert);
+#else
+    (void)read_hex;
+    (void)read_srec;
+    fprintf(stderr, "%s: --watch needs inotify, on Linux only\n", program_name);
+    return 1;
+#endif
+}
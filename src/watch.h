@@ -0,0 +1,17 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "extract.h"
+
+/*
+ * "--watch [options] file..." as first arguments: the files are converted,
+ * and converted again on each change (Linux, inotify). When only the data
+ * of some records changed, these records are patched into the binary file
+ * and the check value is written again. read_hex and read_srec decode a
+ * record, as for --extract, NULL for a converter without records. Without
+ * --watch, the conversion is done by DaemonMain().
+ */
+extern int WatchMain(int argc, char *argv[], int (*convert)(int argc, char *argv[]), ExtractRecordFunction read_hex,
+    ExtractRecordFunction read_srec);
+
+#endif